@@ -0,0 +1,50 @@
+/**
+ * Builds a string table image for StringId::loadImage(), so the engine's
+ * known strings don't have to be hashed and interned at every launch.
+ *
+ * usage: StringTableBuilder <strings.txt> <image out>
+ *        strings.txt has one string per line, blank lines are skipped
+ */
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "StringId.h"
+
+int main(int argc, char* argv[])
+{
+	if (argc != 3)
+	{
+		fprintf(stderr, "usage: %s <strings.txt> <image out>\n", argv[0]);
+		return 1;
+	}
+
+	std::ifstream in(argv[1]);
+	if (!in)
+	{
+		fprintf(stderr, "can't open %s\n", argv[1]);
+		return 1;
+	}
+
+	std::vector<std::string> lines;
+	std::string line;
+	while (std::getline(in, line))
+	{
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		if (!line.empty())
+			lines.push_back(line);
+	}
+
+	std::vector<std::string_view> strings(lines.begin(), lines.end());
+	if (!sentinel::StringId::writeImage(argv[2], strings))
+	{
+		fprintf(stderr, "can't write %s\n", argv[2]);
+		return 1;
+	}
+
+	printf("wrote %zu strings to %s\n", strings.size(), argv[2]);
+	return 0;
+}
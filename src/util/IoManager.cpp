@@ -3,13 +3,16 @@
 namespace sentinel
 {
 
-const FileHandle NULL_FILE_HANDLE = nullptr;
+const FileHandle NULL_FILE_HANDLE = NULL_POOL_HANDLE;
+
+static const std::size_t MAX_OPEN_FILES = 1024;
 
 
 /*ctor*/
 IoManager::IoManager() :
 	m_thread_pool(nullptr),
-	m_async_file_pool(sizeof(AsyncFile))
+	m_async_file_pool(sizeof(AsyncFile)),
+	m_open_files(sizeof(AsyncFile*), MAX_OPEN_FILES)
 {
 }
 
@@ -57,17 +60,27 @@ FileHandle IoManager::openFile(const std::string& file_path, bool clear)
     if(!f)
         return NULL_FILE_HANDLE;
 
+    FileHandle handle = m_open_files.alloc();
+    S_ASSERT(handle != NULL_FILE_HANDLE, "too many open files");
+    if(handle == NULL_FILE_HANDLE)
+    {
+        fclose(f);
+        return NULL_FILE_HANDLE;
+    }
+
     void* mem_ptr = m_async_file_pool.alloc();
+    S_ASSERT(mem_ptr != nullptr, "out of memory for open files");
     AsyncFile* async_file = new(mem_ptr) AsyncFile(f);
+    *reinterpret_cast<AsyncFile**>(m_open_files.get(handle)) = async_file;
 
-    return reinterpret_cast<FileHandle>(async_file);
+    return handle;
 }
 
 /**
  * Closes a file. It is the programmers responsibility
- * to close files. Closing a file while there are outstanding
- * asynchronous jobs on the file leads to undefined
- * behavior.
+ * to close files. Ops already running on the file finish
+ * first, ones still queued fail with IO_FAILED. The file
+ * is freed once the last op using it is done.
  *
  * @param handle the file handle to close
  */
@@ -75,15 +88,20 @@ void IoManager::closeFile(FileHandle handle)
 {
     S_ASSERT(handle != NULL_FILE_HANDLE);
 
-    AsyncFile* async_file = reinterpret_cast<AsyncFile*>(handle);
-    
-	LockT lock(async_file->mut);
-    async_file->deleted = true;//avoid race in next line
+    LockT open_files_lock(m_open_files_mut);
+    AsyncFile* async_file = getAsyncFile(handle);
+    S_ASSERT(async_file != nullptr, "closing a file that isn't open");
+    if(!async_file)
+        return;
+    m_open_files.freeHandle(handle); //any copies of handle are stale now
+    open_files_lock.unlock();
+
+    LockT lock(async_file->mut);
+    async_file->deleted = true;
     fclose(async_file->file);
-	lock.unlock();
+    lock.unlock();
 
-    async_file->~AsyncFile();
-    m_async_file_pool.freeBlock(async_file);
+    releaseAsyncFile(async_file); //the open handle's ref
 }
 
 /**
@@ -100,7 +118,13 @@ std::size_t IoManager::readFile(FileHandle handle, char* buffer,
             std::size_t buffer_size, FileOpStatus& status)
 {
     //check file still exists
-    AsyncFile* async_file = reinterpret_cast<AsyncFile*>(handle);
+    AsyncFileRef file_ref(this, handle);
+    AsyncFile* async_file = file_ref.get();
+    if(!async_file)
+    {
+        status = IO_FAILED;
+        return 0;
+    }
     LockT lock(async_file->mut);
 
     if(async_file->deleted)
@@ -142,8 +166,13 @@ std::size_t IoManager::readFile(FileHandle handle, char* buffer,
 std::size_t IoManager::writeFile(FileHandle handle, const char* buffer, 
             std::size_t buffer_size, FileOpStatus& status)
 {
-    AsyncFile* async_file = reinterpret_cast<AsyncFile*>(handle);
-    S_ASSERT(async_file);
+    AsyncFileRef file_ref(this, handle);
+    AsyncFile* async_file = file_ref.get();
+    if(!async_file)
+    {
+        status = IO_FAILED;
+        return 0;
+    }
 
     LockT lock(async_file->mut);
     if(async_file->deleted)
@@ -186,7 +215,13 @@ std::size_t IoManager::writeFile(FileHandle handle, const char* buffer,
 std::size_t IoManager::writeFileUnbuffered(FileHandle handle, 
         const char* buffer, std::size_t buffer_size, FileOpStatus& status)
 {
-    AsyncFile* async_file = reinterpret_cast<AsyncFile*>(handle);
+    AsyncFileRef file_ref(this, handle);
+    AsyncFile* async_file = file_ref.get();
+    if(!async_file)
+    {
+        status = IO_FAILED;
+        return 0;
+    }
 
     LockT lock(async_file->mut);
     if(async_file->deleted)
@@ -316,4 +351,98 @@ AsyncJobHandle IoManager::asyncWriteUnbuffered(FileHandle handle,
 	}, immediate);
 }
 
+#ifdef COROUTINES_ENABLED
+
+/**
+ * co_await to read a file on the io threads. The awaiting
+ * coroutine resumes on the io thread that did the read.
+ *
+ * @param handle: the FileHandle to read from
+ * @param buffer: the char* to read into, must outlive the co_await
+ * @param buffer_size: size of the buffer
+ * @returns an awaitable giving an IoResult (status and bytes read)
+ */
+IoManager::IoAwaitable IoManager::read(FileHandle handle, char* buffer, std::size_t buffer_size)
+{
+    return IoAwaitable{this, handle, buffer, nullptr, buffer_size, {IO_FAILED, 0}};
+}
+
+/**
+ * co_await to do a buffered write on the io threads. The
+ * awaiting coroutine resumes on the io thread that wrote.
+ *
+ * @param handle: the FileHandle to write to
+ * @param buffer: the const char* to write from, must outlive the co_await
+ * @param buffer_size: size of the buffer
+ * @returns an awaitable giving an IoResult (status and bytes written)
+ */
+IoManager::IoAwaitable IoManager::write(FileHandle handle, const char* buffer, std::size_t buffer_size)
+{
+    return IoAwaitable{this, handle, nullptr, buffer, buffer_size, {IO_FAILED, 0}};
+}
+
+void IoManager::IoAwaitable::await_suspend(std::coroutine_handle<> awaiting)
+{
+    //the awaitable lives in the suspended frame, so it's safe to fill in from the job
+    m_io->m_thread_pool->asyncDo([this, awaiting]()
+    {
+        if (m_read_buffer)
+            m_result.m_bytes = m_io->readFile(m_handle, m_read_buffer, m_buffer_size, m_result.m_status);
+        else
+            m_result.m_bytes = m_io->writeFile(m_handle, m_write_buffer, m_buffer_size, m_result.m_status);
+        awaiting.resume();
+    });
+}
+
+#endif //COROUTINES_ENABLED
+
+/**
+ * resolves a FileHandle to its AsyncFile, call with
+ * m_open_files_mut held
+ *
+ * @param handle: the FileHandle
+ * @returns the AsyncFile*, or nullptr if the handle is stale (closed)
+ */
+IoManager::AsyncFile* IoManager::getAsyncFile(FileHandle handle)
+{
+    AsyncFile** slot = reinterpret_cast<AsyncFile**>(m_open_files.get(handle));
+    return slot ? *slot : nullptr;
+}
+
+/**
+ * drops a reference to an AsyncFile, freeing it with the last one
+ *
+ * @param async_file: the AsyncFile to release
+ */
+void IoManager::releaseAsyncFile(AsyncFile* async_file)
+{
+    if(async_file->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    async_file->~AsyncFile();
+    m_async_file_pool.freeBlock(async_file);
+}
+
+/**
+ * ctor. Looks a file up and holds a reference to it, so
+ * a concurrent closeFile() can't free it from under us
+ *
+ * @param io: the IoManager the file is open in
+ * @param handle: the FileHandle
+ */
+IoManager::AsyncFileRef::AsyncFileRef(IoManager* io, FileHandle handle) :
+    m_io(io)
+{
+    LockT open_files_lock(io->m_open_files_mut);
+    m_file = io->getAsyncFile(handle);
+    if(m_file)
+        m_file->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+IoManager::AsyncFileRef::~AsyncFileRef()
+{
+    if(m_file)
+        m_io->releaseAsyncFile(m_file);
+}
+
 }//namespace s_util
@@ -1,6 +1,7 @@
 #ifndef IO_MANAGER_H
 #define IO_MANAGER_H
 
+#include <atomic>
 #include <condition_variable>
 #include <functional>
 #include <mutex>
@@ -9,14 +10,19 @@
 #include <stdio.h>
 #include <thread>
 
-#include "MemoryPool.h"
+#include "HandlePool.h"
+#include "MagazinePool.h"
 #include "SentinelConfig.h"
 #include "ThreadPool.h"
 
+#ifdef COROUTINES_ENABLED
+#include <coroutine>
+#endif
+
 namespace sentinel
 {
 
-typedef void* FileHandle; //points to an AsyncFile
+typedef PoolHandle FileHandle; //an AsyncFile's slot in the open files pool
 extern const FileHandle NULL_FILE_HANDLE;
 
 enum FileOpStatus : int
@@ -59,25 +65,69 @@ public:
             const char* buffer, std::size_t buffer_size, 
             const std::function<void (FileOpStatus, std::size_t)>& cb, bool immediate=false);
 
+#ifdef COROUTINES_ENABLED
+    struct IoResult
+    {
+        FileOpStatus m_status;
+        std::size_t m_bytes;
+    };
+
+    //does the read/write as a job on the io threads, then resumes there
+    struct IoAwaitable
+    {
+        IoManager* m_io;
+        FileHandle m_handle;
+        char* m_read_buffer; //nullptr for a write
+        const char* m_write_buffer;
+        std::size_t m_buffer_size;
+        IoResult m_result;
+
+        bool await_ready() noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> awaiting);
+        IoResult await_resume() noexcept { return m_result; }
+    };
+
+    //co_await versions of asyncRead/asyncWrite, for Task coroutines
+    IoAwaitable read(FileHandle handle, char* buffer, std::size_t buffer_size);
+    IoAwaitable write(FileHandle handle, const char* buffer, std::size_t buffer_size);
+#endif
+
 private:
 
     typedef std::mutex MutexT;
     typedef std::unique_lock<MutexT> LockT;
 
-    friend FileHandle;
-
     //a file struct & supports multiple access
     struct AsyncFile
     {
         FILE* file;
         MutexT mut;
         bool deleted;
+        std::atomic<int> refs; //one for the open handle, one per op using it
 
-        AsyncFile(FILE* f) : file(f), deleted(false) {}
+        AsyncFile(FILE* f) : file(f), deleted(false), refs(1) {}
     };
 
+    //keeps an AsyncFile alive while an op uses it, even if it's closed meanwhile
+    class AsyncFileRef
+    {
+    public:
+        AsyncFileRef(IoManager* io, FileHandle handle);
+        ~AsyncFileRef();
+        AsyncFile* get() { return m_file; }
+
+    private:
+        IoManager* m_io;
+        AsyncFile* m_file;
+    };
+
+    AsyncFile* getAsyncFile(FileHandle handle);
+    void releaseAsyncFile(AsyncFile* async_file);
+
 	ThreadPool* m_thread_pool; //* so we can realloc
-    MemoryPool m_async_file_pool;
+    MagazinePool m_async_file_pool;
+    HandlePool m_open_files; //holds an AsyncFile* per open file
+    MutexT m_open_files_mut; //lookups vs closeFile() freeing the handle
 
 };
 
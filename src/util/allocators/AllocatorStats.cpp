@@ -0,0 +1,264 @@
+#include "AllocatorStats.h"
+
+#include <new>
+#include <sstream>
+
+namespace sentinel
+{
+
+//head of the intrusive list of every live AllocatorStats
+static AllocatorStats* s_registry_head = nullptr;
+
+//never destroyed, allocators may outlive static destruction
+static std::mutex& getRegistryMutex()
+{
+	alignas(std::mutex) static unsigned char s_storage[sizeof(std::mutex)];
+	static std::mutex* s_mut = new(s_storage) std::mutex();
+	return *s_mut;
+}
+
+/**
+ * ctor, registers the counters
+ *
+ * @param (optional) name: shows up in snapshots, must outlive the stats
+ */
+AllocatorStats::AllocatorStats(const char* name) :
+	m_name(name),
+	m_current_bytes(0),
+	m_peak_bytes(0),
+	m_num_allocs(0),
+	m_num_frees(0),
+	m_num_failed_allocs(0),
+	m_last_frame_peak_bytes(0),
+	m_max_frame_peak_bytes(0),
+	m_prev(nullptr),
+	m_next(nullptr)
+{
+	for (std::atomic<std::size_t>& bucket : m_size_histogram)
+		bucket.store(0, std::memory_order_relaxed);
+
+	link();
+}
+
+/**
+ * move ctor, the new stats register separately and take over
+ * the counts, leaving the source's zeroed
+ */
+AllocatorStats::AllocatorStats(AllocatorStats&& other) :
+	AllocatorStats(other.m_name)
+{
+	*this = std::move(other);
+}
+
+AllocatorStats& AllocatorStats::operator = (AllocatorStats&& other)
+{
+	if (this != &other)
+	{
+		//the source stays registered, zero it so snapshots don't count it twice
+		m_name = other.m_name;
+		m_current_bytes.store(other.m_current_bytes.exchange(0));
+		m_peak_bytes.store(other.m_peak_bytes.exchange(0));
+		m_num_allocs.store(other.m_num_allocs.exchange(0));
+		m_num_frees.store(other.m_num_frees.exchange(0));
+		m_num_failed_allocs.store(other.m_num_failed_allocs.exchange(0));
+		m_last_frame_peak_bytes.store(other.m_last_frame_peak_bytes.exchange(0));
+		m_max_frame_peak_bytes.store(other.m_max_frame_peak_bytes.exchange(0));
+		for (std::size_t i = 0; i < AllocatorStatsSnapshot::NUM_HISTOGRAM_BUCKETS; i++)
+			m_size_histogram[i].store(other.m_size_histogram[i].exchange(0));
+	}
+
+	return *this;
+}
+
+/**
+ * dtor, unregisters
+ */
+AllocatorStats::~AllocatorStats()
+{
+	unlink();
+}
+
+void AllocatorStats::setName(const char* name)
+{
+	std::lock_guard<std::mutex> lock(getRegistryMutex());
+	m_name = name;
+}
+
+/**
+ * counts a successful allocation
+ *
+ * @param size_bytes: bytes handed out
+ */
+void AllocatorStats::recordAlloc(std::size_t size_bytes)
+{
+	m_num_allocs.fetch_add(1, std::memory_order_relaxed);
+	m_size_histogram[histogramBucket(size_bytes)].fetch_add(1, std::memory_order_relaxed);
+
+	std::size_t current = m_current_bytes.fetch_add(size_bytes,
+		std::memory_order_relaxed) + size_bytes;
+	raise(m_peak_bytes, current);
+}
+
+/**
+ * counts an allocation the allocator couldn't serve
+ *
+ * @param size_bytes: bytes asked for
+ */
+void AllocatorStats::recordFailedAlloc(std::size_t size_bytes)
+{
+	m_num_failed_allocs.fetch_add(1, std::memory_order_relaxed);
+	m_size_histogram[histogramBucket(size_bytes)].fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * counts a free (or a stack rolling back)
+ *
+ * @param size_bytes: bytes given back
+ */
+void AllocatorStats::recordFree(std::size_t size_bytes)
+{
+	m_num_frees.fetch_add(1, std::memory_order_relaxed);
+	m_current_bytes.fetch_sub(size_bytes, std::memory_order_relaxed);
+}
+
+/**
+ * for per-frame allocators, records how much a frame needed
+ *
+ * @param frame_bytes: the frame's peak bytes
+ */
+void AllocatorStats::recordFrame(std::size_t frame_bytes)
+{
+	m_last_frame_peak_bytes.store(frame_bytes, std::memory_order_relaxed);
+	raise(m_max_frame_peak_bytes, frame_bytes);
+}
+
+/**
+ * @returns a copy of the counters. Each counter is read atomically,
+ *          but not all of them at the same instant.
+ */
+AllocatorStatsSnapshot AllocatorStats::snapshot()
+{
+	AllocatorStatsSnapshot snap;
+	{
+		std::lock_guard<std::mutex> lock(getRegistryMutex());
+		snap.m_name = m_name;
+	}
+	snap.m_current_bytes = m_current_bytes.load(std::memory_order_relaxed);
+	snap.m_peak_bytes = m_peak_bytes.load(std::memory_order_relaxed);
+	snap.m_num_allocs = m_num_allocs.load(std::memory_order_relaxed);
+	snap.m_num_frees = m_num_frees.load(std::memory_order_relaxed);
+	snap.m_num_failed_allocs = m_num_failed_allocs.load(std::memory_order_relaxed);
+	snap.m_last_frame_peak_bytes = m_last_frame_peak_bytes.load(std::memory_order_relaxed);
+	snap.m_max_frame_peak_bytes = m_max_frame_peak_bytes.load(std::memory_order_relaxed);
+	for (std::size_t i = 0; i < AllocatorStatsSnapshot::NUM_HISTOGRAM_BUCKETS; i++)
+		snap.m_size_histogram[i] = m_size_histogram[i].load(std::memory_order_relaxed);
+
+	return snap;
+}
+
+/**
+ * @returns a snapshot of every live allocator's stats
+ */
+std::vector<AllocatorStatsSnapshot> AllocatorStats::snapshotAll()
+{
+	std::vector<AllocatorStats*> live;
+	{
+		std::lock_guard<std::mutex> lock(getRegistryMutex());
+		for (AllocatorStats* stats = s_registry_head; stats; stats = stats->m_next)
+			live.push_back(stats);
+	}
+
+	//snapshot() takes the registry lock itself, and vector may allocate
+	//through an instrumented allocator, so do it unlocked. Stats can't go
+	//away meanwhile as long as allocators aren't destroyed concurrently.
+	std::vector<AllocatorStatsSnapshot> snapshots;
+	snapshots.reserve(live.size());
+	for (AllocatorStats* stats : live)
+		snapshots.push_back(stats->snapshot());
+
+	return snapshots;
+}
+
+/**
+ * @param snapshots: the snapshots to dump
+ * @returns the snapshots as a JSON array of objects
+ */
+std::string AllocatorStats::toJson(const std::vector<AllocatorStatsSnapshot>& snapshots)
+{
+	std::ostringstream json;
+	json << "[";
+	for (std::size_t i = 0; i < snapshots.size(); i++)
+	{
+		const AllocatorStatsSnapshot& snap = snapshots[i];
+		json << (i ? ",\n " : "\n ") << "{"
+			<< "\"name\": \"" << (snap.m_name ? snap.m_name : "") << "\", "
+			<< "\"current_bytes\": " << snap.m_current_bytes << ", "
+			<< "\"peak_bytes\": " << snap.m_peak_bytes << ", "
+			<< "\"num_allocs\": " << snap.m_num_allocs << ", "
+			<< "\"num_frees\": " << snap.m_num_frees << ", "
+			<< "\"num_failed_allocs\": " << snap.m_num_failed_allocs << ", "
+			<< "\"last_frame_peak_bytes\": " << snap.m_last_frame_peak_bytes << ", "
+			<< "\"max_frame_peak_bytes\": " << snap.m_max_frame_peak_bytes << ", "
+			<< "\"size_histogram\": [";
+		for (std::size_t b = 0; b < AllocatorStatsSnapshot::NUM_HISTOGRAM_BUCKETS; b++)
+			json << (b ? ", " : "") << snap.m_size_histogram[b];
+		json << "]}";
+	}
+	json << (snapshots.empty() ? "]" : "\n]");
+
+	return json.str();
+}
+
+/**
+ * @returns the power of 2 bucket for a size: <= 16 bytes is
+ *          bucket 0, <= 32 is bucket 1, and so on
+ */
+std::size_t AllocatorStats::histogramBucket(std::size_t size_bytes)
+{
+	std::size_t bucket = 0;
+	std::size_t bucket_top = 16;
+	while (size_bytes > bucket_top &&
+		bucket < AllocatorStatsSnapshot::NUM_HISTOGRAM_BUCKETS - 1)
+	{
+		bucket_top <<= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+/**
+ * atomically raises peak to at least value
+ */
+void AllocatorStats::raise(std::atomic<std::size_t>& peak, std::size_t value)
+{
+	std::size_t old_peak = peak.load(std::memory_order_relaxed);
+	while (value > old_peak &&
+		!peak.compare_exchange_weak(old_peak, value, std::memory_order_relaxed))
+	{
+	}
+}
+
+void AllocatorStats::link()
+{
+	std::lock_guard<std::mutex> lock(getRegistryMutex());
+
+	m_prev = nullptr;
+	m_next = s_registry_head;
+	if (s_registry_head)
+		s_registry_head->m_prev = this;
+	s_registry_head = this;
+}
+
+void AllocatorStats::unlink()
+{
+	std::lock_guard<std::mutex> lock(getRegistryMutex());
+
+	if (m_prev)
+		m_prev->m_next = m_next;
+	else
+		s_registry_head = m_next;
+	if (m_next)
+		m_next->m_prev = m_prev;
+}
+
+} //namespace sentinel
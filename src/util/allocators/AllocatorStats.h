@@ -0,0 +1,96 @@
+#ifndef ALLOCATOR_STATS_H
+#define ALLOCATOR_STATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "SentinelConfig.h"
+
+//ALLOC_STATS(...) keeps its contents only when stats are compiled in, so
+//allocators pay nothing for their counters (not even the member) otherwise
+#ifdef ALLOCATOR_STATS_ENABLED
+#define ALLOC_STATS(...) __VA_ARGS__
+#else
+#define ALLOC_STATS(...)
+#endif
+
+namespace sentinel
+{
+
+/**
+ * a copy of one allocator's counters at a point in time
+ */
+struct AllocatorStatsSnapshot
+{
+	static constexpr std::size_t NUM_HISTOGRAM_BUCKETS = 16;
+
+	const char* m_name;
+	std::size_t m_current_bytes;
+	std::size_t m_peak_bytes;
+	std::size_t m_num_allocs;
+	std::size_t m_num_frees;
+	std::size_t m_num_failed_allocs;
+	std::size_t m_last_frame_peak_bytes; //only set by per-frame allocators
+	std::size_t m_max_frame_peak_bytes;
+	//bucket i counts allocs of (16 << (i-1), 16 << i] bytes, the last is everything bigger
+	std::size_t m_size_histogram[NUM_HISTOGRAM_BUCKETS];
+};
+
+/**
+ * Counters for one allocator. Every instance links itself into a global
+ * registry for its lifetime, so snapshotAll() can enumerate every live
+ * allocator. Counters are relaxed atomics, cheap enough for debug builds
+ * but still not free, so allocators only hold one inside ALLOC_STATS().
+ */
+class AllocatorStats
+{
+public:
+	AllocatorStats(const char* name="allocator");
+	AllocatorStats(AllocatorStats&& other);
+	AllocatorStats& operator = (AllocatorStats&& other);
+	AllocatorStats(const AllocatorStats& other)              = delete;
+	AllocatorStats& operator = (const AllocatorStats& other) = delete;
+	~AllocatorStats();
+
+	void setName(const char* name);
+
+	void recordAlloc(std::size_t size_bytes);
+	void recordFailedAlloc(std::size_t size_bytes);
+	void recordFree(std::size_t size_bytes);
+	void recordFrame(std::size_t frame_bytes);
+
+	AllocatorStatsSnapshot snapshot();
+
+	static std::vector<AllocatorStatsSnapshot> snapshotAll();
+	static std::string toJson(const std::vector<AllocatorStatsSnapshot>& snapshots);
+
+private:
+	static std::size_t histogramBucket(std::size_t size_bytes);
+	static void raise(std::atomic<std::size_t>& peak, std::size_t value);
+
+	void link();
+	void unlink();
+
+	const char* m_name;
+	std::atomic<std::size_t> m_current_bytes;
+	std::atomic<std::size_t> m_peak_bytes;
+	std::atomic<std::size_t> m_num_allocs;
+	std::atomic<std::size_t> m_num_frees;
+	std::atomic<std::size_t> m_num_failed_allocs;
+	std::atomic<std::size_t> m_last_frame_peak_bytes;
+	std::atomic<std::size_t> m_max_frame_peak_bytes;
+	std::atomic<std::size_t> m_size_histogram[AllocatorStatsSnapshot::NUM_HISTOGRAM_BUCKETS];
+
+	//intrusive registry links (guarded by the registry mutex) so
+	//registering never allocates, even under SMALL_OBJECT_NEW_ENABLED
+	AllocatorStats* m_prev;
+	AllocatorStats* m_next;
+};
+
+} //namespace sentinel
+
+#endif //ALLOCATOR_STATS_H
@@ -1,38 +1,115 @@
 #include "DbFrameAllocator.h"
 
+#include <cstdlib>
+#include <iostream>
+
 
 namespace sentinel
 {
 
+DbFrameAllocator::FrameBuffer::FrameBuffer(std::size_t stack_size_bytes,
+        std::size_t thread_slice_size_bytes, std::size_t max_threads) :
+    m_stack(stack_size_bytes),
+    m_thread_stack(thread_slice_size_bytes, max_threads),
+    m_overflow_bytes(0),
+    m_overflowed(false)
+{
+    ALLOC_STATS(m_stack.getStats().setName("DbFrameAllocator buffer");)
+}
+
 /*
  * ctor
+ *
+ * @param stack_size_bytes: size of each shared frame buffer
+ * @param thread_slice_size_bytes: per-thread frame memory, per buffer
+ * @param max_threads: live threads that get a slice of per-thread frame
+ *        memory, others overflow to the heap (default 0 means no
+ *        per-thread frame memory, every thread local alloc overflows)
+ * @param num_buffers: how many frames can be alive at once (default 2)
  */
-DbFrameAllocator::DbFrameAllocator(std::size_t stack_size_bytes) :
-    m_buffers{ MemoryStack(stack_size_bytes) },
-    m_current_buffer(0)
+DbFrameAllocator::DbFrameAllocator(std::size_t stack_size_bytes,
+        std::size_t thread_slice_size_bytes, std::size_t max_threads,
+        std::size_t num_buffers) :
+    m_current_buffer(0),
+    m_high_water(0)
 {
+    S_ASSERT(num_buffers > 0);
+    ALLOC_STATS(m_stats.setName("DbFrameAllocator");)
+
+    m_buffers.reserve(num_buffers);
+    for (std::size_t i = 0; i < num_buffers; i++)
+        m_buffers.emplace_back(new FrameBuffer(stack_size_bytes,
+            thread_slice_size_bytes, max_threads));
 }
 
 /*dtor*/
 DbFrameAllocator::~DbFrameAllocator()
 {
-    //do nothing!
+    for (std::unique_ptr<FrameBuffer>& buffer : m_buffers)
+    {
+        for (OverflowBlock& block : buffer->m_overflow_blocks)
+            free(block.m_raw);
+    }
+}
+
+std::size_t DbFrameAllocator::getNumBuffers()
+{
+    return m_buffers.size();
+}
+
+std::size_t DbFrameAllocator::getCurrentBuffer()
+{
+    return m_current_buffer;
 }
 
 /*
- * clears the current buffer 
+ * the most bytes any single frame has needed so far (shared stack,
+ * thread slices and overflow), as of its last clearCurrentBuffer()
+ */
+std::size_t DbFrameAllocator::getHighWaterMark()
+{
+    return m_high_water;
+}
+
+/*
+ * clears the current buffer, including every thread's
+ * slice of it and any overflow. No thread should be
+ * allocating meanwhile.
  */
 void DbFrameAllocator::clearCurrentBuffer()
 {
-    m_buffers[m_current_buffer].clear();
+    FrameBuffer& buffer = *m_buffers[m_current_buffer];
+
+    std::size_t frame_bytes = buffer.m_stack.getHighWaterMark() +
+        buffer.m_thread_stack.getUsedBytes() + buffer.m_overflow_bytes;
+    if (frame_bytes > m_high_water)
+        m_high_water = frame_bytes;
+    ALLOC_STATS(m_stats.recordFrame(frame_bytes);)
+
+    if (buffer.m_overflow_bytes > 0)
+    {
+        std::cerr << "DbFrameAllocator: frame overflowed buffer " << m_current_buffer
+            << " by " << buffer.m_overflow_bytes << " bytes, high-water mark "
+            << frame_bytes << " bytes\n";
+
+        for (OverflowBlock& block : buffer.m_overflow_blocks)
+            free(block.m_raw);
+        buffer.m_overflow_blocks.clear();
+        buffer.m_overflow_bytes = 0;
+        buffer.m_overflowed.store(false, std::memory_order_relaxed);
+    }
+
+    buffer.m_stack.clear();
+    buffer.m_stack.resetHighWaterMark();
+    buffer.m_thread_stack.clearAll();
 }
 
 /*
- * swaps the currently active buffer
+ * moves on to the next buffer in the ring
  */
 void DbFrameAllocator::swapBuffers()
 {
-    m_current_buffer = (m_current_buffer == 1) ? 0 : 1 ;
+    m_current_buffer = (m_current_buffer + 1) % m_buffers.size();
 }
 
 /*
@@ -40,7 +117,7 @@ void DbFrameAllocator::swapBuffers()
  */
 void* DbFrameAllocator::getStackPtr()
 {
-    return m_buffers[m_current_buffer].getStackPtr();
+    return m_buffers[m_current_buffer]->m_stack.getStackPtr();
 }
 
 /*
@@ -50,7 +127,8 @@ void* DbFrameAllocator::getStackPtr()
  */
 void* DbFrameAllocator::alloc(std::size_t size_bytes)
 {
-    return m_buffers[m_current_buffer].alloc(size_bytes);
+    void* p = m_buffers[m_current_buffer]->m_stack.alloc(size_bytes);
+    return p ? p : allocOverflow(size_bytes, 1);
 }
 
 /*
@@ -61,7 +139,8 @@ void* DbFrameAllocator::alloc(std::size_t size_bytes)
  */
 void* DbFrameAllocator::allocAligned(std::size_t size_bytes, std::size_t alignment)
 {
-    return m_buffers[m_current_buffer].allocAligned(size_bytes, alignment);
+    void* p = m_buffers[m_current_buffer]->m_stack.allocAligned(size_bytes, alignment);
+    return p ? p : allocOverflow(size_bytes, alignment);
 }
 
 /*
@@ -69,7 +148,8 @@ void* DbFrameAllocator::allocAligned(std::size_t size_bytes, std::size_t alignme
  */
 void DbFrameAllocator::freeTo(void* marker)
 {
-    m_buffers[m_current_buffer].freeTo(marker);
+    if (!isOverflowBlock(marker))
+        m_buffers[m_current_buffer]->m_stack.freeTo(marker);
 }
 
 /*
@@ -78,7 +158,120 @@ void DbFrameAllocator::freeTo(void* marker)
  */
 void DbFrameAllocator::freeToAligned(void* marker)
 {
-    m_buffers[m_current_buffer].freeToAligned(marker);
+    if (!isOverflowBlock(marker))
+        m_buffers[m_current_buffer]->m_stack.freeToAligned(marker);
+}
+
+/*
+ * gets a marker from the calling thread's slice
+ * of the current buffer
+ */
+void* DbFrameAllocator::getThreadStackPtr()
+{
+    return m_buffers[m_current_buffer]->m_thread_stack.getStackPtr();
+}
+
+/*
+ * allocates from the calling thread's slice of the
+ * current buffer without taking any locks
+ *
+ * @param size_bytes: how many bytes to alloc
+ */
+void* DbFrameAllocator::allocThreadLocal(std::size_t size_bytes)
+{
+    void* p = m_buffers[m_current_buffer]->m_thread_stack.alloc(size_bytes);
+    return p ? p : allocOverflow(size_bytes, 1);
+}
+
+/*
+ * aligned version of allocThreadLocal
+ *
+ * @param size_bytes: bytes to allocate
+ * @param alignment: byte alignment
+ */
+void* DbFrameAllocator::allocAlignedThreadLocal(std::size_t size_bytes,
+        std::size_t alignment)
+{
+    void* p = m_buffers[m_current_buffer]->m_thread_stack.allocAligned(size_bytes, alignment);
+    return p ? p : allocOverflow(size_bytes, alignment);
+}
+
+/*
+ * frees the calling thread's frame memory up to a marker
+ */
+void DbFrameAllocator::freeToThreadLocal(void* marker)
+{
+    if (!isOverflowBlock(marker))
+        m_buffers[m_current_buffer]->m_thread_stack.freeTo(marker);
+}
+
+/*
+ * frees the calling thread's frame memory up to a
+ * marker gotten after an aligned alloc
+ */
+void DbFrameAllocator::freeToAlignedThreadLocal(void* marker)
+{
+    if (!isOverflowBlock(marker))
+        m_buffers[m_current_buffer]->m_thread_stack.freeToAligned(marker);
+}
+
+/*
+ * the slow path once the current frame's buffer (or the calling
+ * thread's slice of it) is full: reports the overflow once per
+ * frame, then hands out heap memory that lives until this buffer
+ * is next cleared.
+ *
+ * @param size_bytes: bytes to allocate
+ * @param alignment: byte alignment (1 for unaligned)
+ */
+void* DbFrameAllocator::allocOverflow(std::size_t size_bytes, std::size_t alignment)
+{
+    FrameBuffer& buffer = *m_buffers[m_current_buffer];
+
+    void* raw = malloc(size_bytes + alignment);
+    if (!raw)
+        return nullptr;
+
+    uintptr_t raw_address = reinterpret_cast<uintptr_t>(raw);
+    uintptr_t misalignment = raw_address & (alignment - 1);
+    uintptr_t aligned_address = raw_address + (alignment - misalignment);
+
+    //same layout as an aligned stack alloc, adjustment in the byte before
+    *reinterpret_cast<uint8_t*>(aligned_address - 1) =
+        static_cast<uint8_t>(aligned_address - raw_address);
+
+    ALLOC_STATS(m_stats.recordFailedAlloc(size_bytes);)
+
+    LockT lock(buffer.m_overflow_mut);
+    if (buffer.m_overflow_bytes == 0)
+    {
+        std::cerr << "DbFrameAllocator: buffer " << m_current_buffer << " ("
+            << buffer.m_stack.getSize() << " bytes) is full, overflowing to the heap\n";
+    }
+    buffer.m_overflow_blocks.push_back({ raw, reinterpret_cast<void*>(aligned_address) });
+    buffer.m_overflow_bytes += size_bytes + alignment;
+    buffer.m_overflowed.store(true, std::memory_order_release);
+
+    return reinterpret_cast<void*>(aligned_address);
+}
+
+/*
+ * true if p was handed out by allocOverflow() this frame. Freeing
+ * to one is a no-op, it goes back when the buffer is cleared.
+ */
+bool DbFrameAllocator::isOverflowBlock(void* p)
+{
+    FrameBuffer& buffer = *m_buffers[m_current_buffer];
+    if (!buffer.m_overflowed.load(std::memory_order_acquire))
+        return false; //the usual case, nothing to search
+
+    LockT lock(buffer.m_overflow_mut);
+    for (OverflowBlock& block : buffer.m_overflow_blocks)
+    {
+        if (block.m_ptr == p)
+            return true;
+    }
+    return false;
 }
 
 } //namespace s_util
@@ -1,20 +1,44 @@
 #ifndef DB_FRAME_ALLOCATOR_H
 #define DB_FRAME_ALLOCATOR_H
 
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #include "MemoryStack.h"
+#include "ThreadLocalStack.h"
 
 namespace sentinel
 {
 
+/**
+ * A ring of frame buffers. Frame N allocates from buffer N % num_buffers,
+ * so with a pipeline num_buffers deep (e.g. simulate -> render -> GPU)
+ * a frame's data survives until the ring comes back around to it.
+ *
+ * Each buffer has a shared, locked stack and optional lock free per-thread
+ * slices for worker threads. A frame that outgrows its buffer doesn't get
+ * nullptr: the overflow is reported and served from the heap until that
+ * buffer is next cleared, and getHighWaterMark() says how big the buffers
+ * need to be.
+ */
 class DbFrameAllocator
 {
 public:
-    DbFrameAllocator(std::size_t stack_size_bytes=625000);
+    DbFrameAllocator(std::size_t stack_size_bytes=625000,
+            std::size_t thread_slice_size_bytes=0, std::size_t max_threads=0,
+            std::size_t num_buffers=2);
     DbFrameAllocator(const DbFrameAllocator& other)              = delete;
     DbFrameAllocator& operator = (const DbFrameAllocator& other) = delete;
     DbFrameAllocator(DbFrameAllocator&& other)                   = default;
     DbFrameAllocator& operator = (DbFrameAllocator&& other)      = default;
     ~DbFrameAllocator();
+
+    std::size_t getNumBuffers();
+    std::size_t getCurrentBuffer();
+    std::size_t getHighWaterMark();
     
     void clearCurrentBuffer();
     void swapBuffers();
@@ -26,9 +50,51 @@ public:
     void freeTo(void* marker);
     void freeToAligned(void* marker);
 
+    //per-thread frame memory (lock free, one slice per thread)
+    void* getThreadStackPtr();
+    void* allocThreadLocal(std::size_t size_bytes);
+    void* allocAlignedThreadLocal(std::size_t size_bytes, std::size_t alignment);
+
+    void freeToThreadLocal(void* marker);
+    void freeToAlignedThreadLocal(void* marker);
+
+    //frame peaks and overflows, each buffer's shared stack counts its own allocs
+    ALLOC_STATS(AllocatorStats& getStats() { return m_stats; })
+
 private:
-    MemoryStack m_buffers[2];
+    struct OverflowBlock
+    {
+        void* m_raw; //what malloc gave us
+        void* m_ptr; //what we handed out
+    };
+
+    typedef std::mutex MutexT;
+    typedef std::unique_lock<MutexT> LockT;
+
+    struct FrameBuffer
+    {
+        MemoryStack m_stack;
+        ThreadLocalStack m_thread_stack;
+
+        //heap blocks, freed on clear. m_overflowed lets frees skip the lock
+        std::vector<OverflowBlock> m_overflow_blocks;
+        std::size_t m_overflow_bytes;
+        std::atomic<bool> m_overflowed;
+        MutexT m_overflow_mut;
+
+        FrameBuffer(std::size_t stack_size_bytes,
+            std::size_t thread_slice_size_bytes, std::size_t max_threads);
+    };
+
+    void* allocOverflow(std::size_t size_bytes, std::size_t alignment);
+    bool isOverflowBlock(void* p);
+
+    //pointers so we stay movable
+    std::vector<std::unique_ptr<FrameBuffer>> m_buffers;
     std::size_t m_current_buffer;
+    std::size_t m_high_water; //most bytes any one frame has needed
+
+    ALLOC_STATS(AllocatorStats m_stats;)
 };
 
 } //namespace s_util
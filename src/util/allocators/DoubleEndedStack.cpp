@@ -0,0 +1,214 @@
+#include "DoubleEndedStack.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace sentinel
+{
+
+/**
+ * ctor
+ *
+ * @param (optional) size_bytes: the budget both stacks share
+ */
+DoubleEndedStack::DoubleEndedStack(std::size_t size_bytes) :
+	m_total_size(size_bytes),
+	m_stack_bottom(reinterpret_cast<uintptr_t>(malloc(size_bytes))),
+	m_stack_top(m_stack_bottom + m_total_size),
+	m_lower_marker(m_stack_bottom),
+	m_upper_marker(m_stack_top)
+{
+	if (!reinterpret_cast<void*>(m_stack_bottom))
+		throw std::bad_alloc();
+}
+
+DoubleEndedStack::~DoubleEndedStack()
+{
+	free(reinterpret_cast<void*>(m_stack_bottom));
+}
+
+std::size_t DoubleEndedStack::getSize()
+{
+	return m_total_size;
+}
+
+/**
+ * @returns bytes left between the two stacks
+ */
+std::size_t DoubleEndedStack::getFreeBytes()
+{
+	LockT lock(m_mut);
+	return m_upper_marker - m_lower_marker;
+}
+
+void* DoubleEndedStack::getLowerStackPtr()
+{
+	LockT lock(m_mut);
+	return reinterpret_cast<void*>(m_lower_marker);
+}
+
+/**
+ * Reserves space at the bottom of the free gap
+ *
+ * @param size_bytes: bytes to reserve
+ * @returns a pointer to the reserved data (nullptr if it would
+ *          run into the upper stack)
+ */
+void* DoubleEndedStack::allocLower(std::size_t size_bytes)
+{
+	LockT lock(m_mut);
+
+	if (size_bytes > m_upper_marker - m_lower_marker)
+		return nullptr;
+
+	void* mark = reinterpret_cast<void*>(m_lower_marker);
+	m_lower_marker += size_bytes;
+	return mark;
+}
+
+/**
+ * Allocates an aligned block from the lower stack, same
+ * rules as MemoryStack::allocAligned
+ *
+ * @param size_bytes: size of allocated block in bytes
+ * @param alignment: alignment in bytes
+ */
+void* DoubleEndedStack::allocAlignedLower(std::size_t size_bytes, std::size_t alignment)
+{
+	S_ASSERT(alignment >= 1);
+	S_ASSERT(alignment <= 128);
+	S_ASSERT((alignment & (alignment - 1)) == 0); //pwr of 2
+
+	void* raw_ptr = allocLower(size_bytes + alignment);
+	if (!raw_ptr)
+		return nullptr;
+
+	uintptr_t raw_address = reinterpret_cast<uintptr_t>(raw_ptr);
+	std::size_t mask = (alignment - 1);
+	uintptr_t misalignment = (raw_address & mask);
+	std::ptrdiff_t adjustment = alignment - misalignment;
+
+	uintptr_t aligned_address = raw_address + adjustment;
+
+	//write the adjustment to the preceding byte
+	S_ASSERT(adjustment < 256);
+	uint8_t* adjustment_ptr = reinterpret_cast<uint8_t*>(aligned_address - 1);
+	*adjustment_ptr = static_cast<uint8_t>(adjustment);
+
+	return reinterpret_cast<void*>(aligned_address);
+}
+
+/**
+ * Rolls the lower stack back to a marker
+ *
+ * @param marker: the marker to roll back to
+ */
+void DoubleEndedStack::freeToLower(void* marker)
+{
+	LockT lock(m_mut);
+	S_ASSERT(reinterpret_cast<uintptr_t>(marker) <= m_lower_marker);
+	S_ASSERT(reinterpret_cast<uintptr_t>(marker) >= m_stack_bottom);
+
+	m_lower_marker = reinterpret_cast<uintptr_t>(marker);
+}
+
+/**
+ * Rolls the lower stack back to just before an aligned allocation
+ *
+ * @param marker: a ptr returned by allocAlignedLower()
+ */
+void DoubleEndedStack::freeToAlignedLower(void* marker)
+{
+	uintptr_t raw_marker = reinterpret_cast<uintptr_t>(marker);
+	uint8_t adjustment = *(reinterpret_cast<uint8_t*>(raw_marker - 1));
+
+	freeToLower(reinterpret_cast<void*>(raw_marker - adjustment));
+}
+
+void DoubleEndedStack::clearLower()
+{
+	LockT lock(m_mut);
+	m_lower_marker = m_stack_bottom;
+}
+
+void* DoubleEndedStack::getUpperStackPtr()
+{
+	LockT lock(m_mut);
+	return reinterpret_cast<void*>(m_upper_marker);
+}
+
+/**
+ * Reserves space at the top of the free gap
+ *
+ * @param size_bytes: bytes to reserve
+ * @returns a pointer to the start of the reserved data (nullptr if
+ *          it would run into the lower stack)
+ */
+void* DoubleEndedStack::allocUpper(std::size_t size_bytes)
+{
+	LockT lock(m_mut);
+
+	if (size_bytes > m_upper_marker - m_lower_marker)
+		return nullptr;
+
+	m_upper_marker -= size_bytes;
+	return reinterpret_cast<void*>(m_upper_marker);
+}
+
+/**
+ * Allocates an aligned block from the upper stack. Growing down, the
+ * block can just be placed at the highest aligned address that fits,
+ * so no adjustment byte is needed.
+ *
+ * @param size_bytes: size of allocated block in bytes
+ * @param alignment: alignment in bytes (a power of 2)
+ */
+void* DoubleEndedStack::allocAlignedUpper(std::size_t size_bytes, std::size_t alignment)
+{
+	S_ASSERT(alignment >= 1);
+	S_ASSERT((alignment & (alignment - 1)) == 0); //pwr of 2
+
+	LockT lock(m_mut);
+
+	if (size_bytes > m_upper_marker - m_lower_marker)
+		return nullptr;
+
+	uintptr_t aligned_address = (m_upper_marker - size_bytes) & ~(uintptr_t(alignment) - 1);
+	if (aligned_address < m_lower_marker)
+		return nullptr;
+
+	m_upper_marker = aligned_address;
+	return reinterpret_cast<void*>(aligned_address);
+}
+
+/**
+ * Rolls the upper stack back to a marker
+ *
+ * @param marker: a marker from getUpperStackPtr()
+ */
+void DoubleEndedStack::freeToUpper(void* marker)
+{
+	LockT lock(m_mut);
+	S_ASSERT(reinterpret_cast<uintptr_t>(marker) >= m_upper_marker);
+	S_ASSERT(reinterpret_cast<uintptr_t>(marker) <= m_stack_top);
+
+	m_upper_marker = reinterpret_cast<uintptr_t>(marker);
+}
+
+void DoubleEndedStack::clearUpper()
+{
+	LockT lock(m_mut);
+	m_upper_marker = m_stack_top;
+}
+
+/**
+ * clears both stacks
+ */
+void DoubleEndedStack::clear()
+{
+	LockT lock(m_mut);
+	m_lower_marker = m_stack_bottom;
+	m_upper_marker = m_stack_top;
+}
+
+} //namespace sentinel
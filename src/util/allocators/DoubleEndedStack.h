@@ -0,0 +1,65 @@
+#ifndef DOUBLE_ENDED_STACK_H
+#define DOUBLE_ENDED_STACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "SentinelAssert.h"
+
+namespace sentinel
+{
+
+/**
+ * Two stacks in one block: the lower stack grows up from the bottom and
+ * the upper stack grows down from the top, each with its own marker.
+ * Long lived data (e.g. a level) and short lived data (e.g. load scratch)
+ * can share one budget instead of each wasting its own headroom. An
+ * allocation that would make the markers cross fails with nullptr.
+ *
+ * Upper allocations return the lowest address of their block like any
+ * other allocator, so roll the upper stack back with markers from
+ * getUpperStackPtr(), not with returned pointers.
+ */
+class DoubleEndedStack
+{
+public:
+	DoubleEndedStack(std::size_t size_bytes=625000);
+	DoubleEndedStack(const DoubleEndedStack& other)              = delete;
+	DoubleEndedStack& operator = (const DoubleEndedStack& other) = delete;
+	~DoubleEndedStack();
+
+	std::size_t getSize();
+	std::size_t getFreeBytes();
+
+	void* getLowerStackPtr();
+	void* allocLower(std::size_t size_bytes);
+	void* allocAlignedLower(std::size_t size_bytes, std::size_t alignment);
+	void freeToLower(void* marker);
+	void freeToAlignedLower(void* marker);
+	void clearLower();
+
+	void* getUpperStackPtr();
+	void* allocUpper(std::size_t size_bytes);
+	void* allocAlignedUpper(std::size_t size_bytes, std::size_t alignment);
+	void freeToUpper(void* marker);
+	void clearUpper();
+
+	void clear();
+
+private:
+	std::size_t m_total_size;
+	uintptr_t m_stack_bottom;
+	uintptr_t m_stack_top;
+	uintptr_t m_lower_marker; //first free byte above the lower stack
+	uintptr_t m_upper_marker; //lowest byte used by the upper stack
+
+	typedef std::mutex MutexT;
+	typedef std::unique_lock<MutexT> LockT;
+
+	MutexT m_mut;
+};
+
+} //namespace sentinel
+
+#endif //DOUBLE_ENDED_STACK_H
@@ -0,0 +1,304 @@
+#include "Fiber.h"
+
+#ifdef FIBERS_ENABLED
+
+#ifdef _WIN32
+#error "fibers are POSIX only, turn FIBERS_ENABLED off"
+#endif
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define S_FIBER_ASAN
+#endif
+#if __has_feature(thread_sanitizer)
+#define S_FIBER_TSAN
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__) && !defined(S_FIBER_ASAN)
+#define S_FIBER_ASAN
+#endif
+#if defined(__SANITIZE_THREAD__) && !defined(S_FIBER_TSAN)
+#define S_FIBER_TSAN
+#endif
+
+#ifdef S_FIBER_ASAN
+#include <sanitizer/asan_interface.h>
+#include <sanitizer/common_interface_defs.h>
+#endif
+#ifdef S_FIBER_TSAN
+#include <sanitizer/tsan_interface.h>
+#endif
+
+#ifndef S_FIBER_UCONTEXT
+/*
+ * sentinel_fiber_switch(void** from_sp, void* to_sp)
+ * pushes the callee saved registers (and the SSE/x87 control words)
+ * onto the current stack, saves the stack pointer into *from_sp, then
+ * loads to_sp and pops the other fiber's registers back off it.
+ *
+ * sentinel_fiber_start is where a new fiber's first switch returns to,
+ * with the entry function in r12 and its argument in r13.
+ */
+asm(R"(
+	.pushsection .text
+	.p2align 4
+	.globl sentinel_fiber_switch
+	.hidden sentinel_fiber_switch
+	.type sentinel_fiber_switch,@function
+sentinel_fiber_switch:
+	pushq %rbp
+	pushq %rbx
+	pushq %r12
+	pushq %r13
+	pushq %r14
+	pushq %r15
+	subq $8, %rsp
+	stmxcsr (%rsp)
+	fnstcw 4(%rsp)
+	movq %rsp, (%rdi)
+	movq %rsi, %rsp
+	ldmxcsr (%rsp)
+	fldcw 4(%rsp)
+	addq $8, %rsp
+	popq %r15
+	popq %r14
+	popq %r13
+	popq %r12
+	popq %rbx
+	popq %rbp
+	ret
+	.size sentinel_fiber_switch,.-sentinel_fiber_switch
+
+	.p2align 4
+	.globl sentinel_fiber_start
+	.hidden sentinel_fiber_start
+	.type sentinel_fiber_start,@function
+sentinel_fiber_start:
+	movq %r13, %rdi
+	callq *%r12
+	ud2
+	.size sentinel_fiber_start,.-sentinel_fiber_start
+	.popsection
+)");
+
+extern "C" void sentinel_fiber_switch(void** from_sp, void* to_sp);
+extern "C" void sentinel_fiber_start();
+#endif //!S_FIBER_UCONTEXT
+
+namespace sentinel
+{
+
+static const unsigned char STACK_PAINT = 0xCD;
+static const std::uint32_t DEFAULT_MXCSR = 0x1F80; //all exceptions masked, round to nearest
+static const std::uint16_t DEFAULT_FPU_CW = 0x037F;
+
+#ifdef S_FIBER_ASAN
+//the fiber we're switching away from, so the one we land in can
+//record a thread's stack bounds (only asan knows them)
+static thread_local Fiber* s_asan_switched_from = nullptr;
+#endif
+
+/**
+ * ctor. A fiber for the calling thread, with no stack of its own.
+ */
+Fiber::Fiber() :
+	m_stack_mem(nullptr),
+	m_stack_mem_size(0),
+	m_stack_size(0),
+	m_stack_bottom(nullptr),
+	m_entry(nullptr),
+	m_arg(nullptr),
+#ifndef S_FIBER_UCONTEXT
+	m_sp(nullptr),
+#endif
+	m_asan_bottom(nullptr),
+	m_asan_size(0),
+	m_tsan_fiber(nullptr)
+{
+}
+
+/**
+ * ctor. Maps a guarded stack, which starts running entry(arg)
+ * the first time something switches to it.
+ *
+ * @param entry: the fiber's function, it must never return
+ * @param arg: passed to entry
+ * @param stack_size: usable stack size, rounded up to whole pages
+ */
+Fiber::Fiber(EntryT entry, void* arg, std::size_t stack_size) :
+	m_entry(entry),
+	m_arg(arg),
+	m_tsan_fiber(nullptr)
+{
+	std::size_t page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+	m_stack_size = ((stack_size + page_size - 1) / page_size) * page_size;
+	m_stack_mem_size = m_stack_size + page_size;
+
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_STACK
+	flags |= MAP_STACK;
+#endif
+	m_stack_mem = mmap(nullptr, m_stack_mem_size, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (m_stack_mem == MAP_FAILED)
+		throw std::bad_alloc();
+
+	//stacks grow down, so the guard goes at the low end
+	mprotect(m_stack_mem, page_size, PROT_NONE);
+	m_stack_bottom = static_cast<unsigned char*>(m_stack_mem) + page_size;
+#ifdef S_FIBER_ASAN
+	//frames of an old stack mapped here were never unwound, clear their poison
+	__asan_unpoison_memory_region(m_stack_bottom, m_stack_size);
+#endif
+	std::memset(m_stack_bottom, STACK_PAINT, m_stack_size);
+
+	m_asan_bottom = m_stack_bottom;
+	m_asan_size = m_stack_size;
+
+#ifdef S_FIBER_UCONTEXT
+	getcontext(&m_context);
+	m_context.uc_stack.ss_sp = m_stack_bottom;
+	m_context.uc_stack.ss_size = m_stack_size;
+	m_context.uc_link = nullptr;
+	std::uint64_t self = reinterpret_cast<std::uintptr_t>(this);
+	makecontext(&m_context, reinterpret_cast<void (*)()>(&Fiber::enterSplit), 2,
+		static_cast<unsigned int>(self >> 32), static_cast<unsigned int>(self));
+#else
+	//a frame laid out the way sentinel_fiber_switch pops it
+	std::uint64_t* frame = reinterpret_cast<std::uint64_t*>(
+		static_cast<unsigned char*>(m_stack_bottom) + m_stack_size) - 8;
+	frame[0] = DEFAULT_MXCSR | (static_cast<std::uint64_t>(DEFAULT_FPU_CW) << 32);
+	frame[1] = 0; //r15
+	frame[2] = 0; //r14
+	frame[3] = reinterpret_cast<std::uintptr_t>(this); //r13, enter()'s arg
+	frame[4] = reinterpret_cast<std::uintptr_t>(&Fiber::enter); //r12
+	frame[5] = 0; //rbx
+	frame[6] = 0; //rbp
+	frame[7] = reinterpret_cast<std::uintptr_t>(&sentinel_fiber_start); //returned to
+	m_sp = frame;
+#endif
+
+#ifdef S_FIBER_TSAN
+	m_tsan_fiber = __tsan_create_fiber(0);
+#endif
+}
+
+/**
+ * dtor. Unmaps the stack, anything still on it is never unwound.
+ */
+Fiber::~Fiber()
+{
+#ifdef S_FIBER_TSAN
+	if (m_stack_mem)
+		__tsan_destroy_fiber(m_tsan_fiber);
+#endif
+	if (m_stack_mem)
+	{
+#ifdef S_FIBER_ASAN
+		__asan_unpoison_memory_region(m_stack_bottom, m_stack_size);
+#endif
+		munmap(m_stack_mem, m_stack_mem_size);
+	}
+}
+
+/**
+ * saves the running context into from and resumes to. Returns
+ * once something switches back to from.
+ *
+ * @param from: the fiber running now
+ * @param to: the fiber to run
+ */
+void Fiber::switchTo(Fiber& from, Fiber& to)
+{
+#ifdef S_FIBER_TSAN
+	if (!from.m_tsan_fiber)
+		from.m_tsan_fiber = __tsan_get_current_fiber();
+	__tsan_switch_to_fiber(to.m_tsan_fiber, 0);
+#endif
+#ifdef S_FIBER_ASAN
+	void* fake_stack = nullptr;
+	s_asan_switched_from = &from;
+	__sanitizer_start_switch_fiber(&fake_stack, to.m_asan_bottom, to.m_asan_size);
+#endif
+
+#ifdef S_FIBER_UCONTEXT
+	swapcontext(&from.m_context, &to.m_context);
+#else
+	sentinel_fiber_switch(&from.m_sp, to.m_sp);
+#endif
+
+#ifdef S_FIBER_ASAN
+	const void* bottom = nullptr;
+	std::size_t size = 0;
+	__sanitizer_finish_switch_fiber(fake_stack, &bottom, &size);
+	if (!s_asan_switched_from->m_stack_mem)
+	{
+		s_asan_switched_from->m_asan_bottom = bottom;
+		s_asan_switched_from->m_asan_size = size;
+	}
+#endif
+}
+
+std::size_t Fiber::getStackSize()
+{
+	return m_stack_size;
+}
+
+/**
+ * @returns the most stack this fiber has used, found by
+ *          scanning up from the bottom for the first byte
+ *          that isn't still paint
+ */
+#ifdef S_FIBER_ASAN
+__attribute__((no_sanitize_address)) //reads redzones of suspended frames
+#endif
+std::size_t Fiber::getStackUsed()
+{
+	if (!m_stack_mem)
+		return 0;
+
+	const unsigned char* bottom = static_cast<const unsigned char*>(m_stack_bottom);
+	std::size_t untouched = 0;
+	while (untouched < m_stack_size && bottom[untouched] == STACK_PAINT)
+		untouched++;
+	return m_stack_size - untouched;
+}
+
+/**
+ * the first thing a new fiber runs
+ */
+void Fiber::enter(Fiber* fiber)
+{
+#ifdef S_FIBER_ASAN
+	const void* bottom = nullptr;
+	std::size_t size = 0;
+	__sanitizer_finish_switch_fiber(nullptr, &bottom, &size);
+	if (!s_asan_switched_from->m_stack_mem)
+	{
+		s_asan_switched_from->m_asan_bottom = bottom;
+		s_asan_switched_from->m_asan_size = size;
+	}
+#endif
+
+	fiber->m_entry(fiber->m_arg);
+
+	S_ASSERT(false, "a fiber's entry function returned");
+	std::abort();
+}
+
+#ifdef S_FIBER_UCONTEXT
+void Fiber::enterSplit(unsigned int hi, unsigned int lo)
+{
+	enter(reinterpret_cast<Fiber*>((static_cast<std::uintptr_t>(hi) << 32) | lo));
+}
+#endif
+
+} //namespace sentinel
+
+#endif //FIBERS_ENABLED
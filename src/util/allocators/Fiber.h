@@ -0,0 +1,81 @@
+#ifndef FIBER_H
+#define FIBER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "SentinelAssert.h"
+
+#ifdef FIBERS_ENABLED
+
+#if !(defined(__x86_64__) && defined(__linux__)) && !defined(_WIN32)
+#include <ucontext.h>
+#define S_FIBER_UCONTEXT
+#endif
+
+namespace sentinel
+{
+
+/**
+ * A user mode thread of execution: its own stack plus the saved
+ * registers to resume it with. Switching between fibers is a plain
+ * function call that swaps callee saved registers and the stack
+ * pointer, with no syscall and no trip through the kernel scheduler.
+ *
+ * Stacks are mmap'd with a PROT_NONE guard page below them, so an
+ * overflow faults instead of scribbling over a neighbour. They're
+ * painted on creation, so getStackUsed() can report the deepest a
+ * fiber has ever gone, for tuning stack sizes.
+ *
+ * x86-64 linux switches with a few instructions of assembly, other
+ * POSIX targets fall back to ucontext (which costs a sigprocmask
+ * syscall per switch). Windows isn't supported.
+ *
+ * A default constructed Fiber has no stack of its own, it stands for
+ * the thread that first switches away from it, so there's somewhere
+ * to switch back to.
+ */
+class Fiber
+{
+public:
+	typedef void (*EntryT)(void* arg); //must never return, switch away instead
+
+	Fiber();
+	Fiber(EntryT entry, void* arg, std::size_t stack_size);
+	Fiber(const Fiber& other)              = delete;
+	Fiber& operator = (const Fiber& other) = delete;
+	~Fiber();
+
+	static void switchTo(Fiber& from, Fiber& to);
+
+	std::size_t getStackSize();
+	std::size_t getStackUsed(); //high water mark, a scan of the stack so not free
+
+private:
+	static void enter(Fiber* fiber);
+
+	void* m_stack_mem; //guard page and stack, nullptr for a thread's fiber
+	std::size_t m_stack_mem_size;
+	std::size_t m_stack_size;
+	void* m_stack_bottom; //lowest usable address
+	EntryT m_entry;
+	void* m_arg;
+
+#ifdef S_FIBER_UCONTEXT
+	static void enterSplit(unsigned int hi, unsigned int lo); //makecontext only passes ints
+	ucontext_t m_context;
+#else
+	void* m_sp; //saved stack pointer, the registers are pushed under it
+#endif
+
+	//sanitizers need telling about stack switches
+	const void* m_asan_bottom;
+	std::size_t m_asan_size;
+	void* m_tsan_fiber;
+};
+
+} //namespace sentinel
+
+#endif //FIBERS_ENABLED
+
+#endif //FIBER_H
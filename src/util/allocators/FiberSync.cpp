@@ -0,0 +1,142 @@
+#include "FiberSync.h"
+
+#ifdef FIBERS_ENABLED
+
+namespace sentinel
+{
+
+FiberMutex::FiberMutex() :
+	m_locked(false),
+	m_num_thread_waiters(0)
+{
+}
+
+/**
+ * takes the mutex, suspending the calling fiber (or
+ * blocking the calling thread) until it's free
+ */
+void FiberMutex::lock()
+{
+	LockT lock(m_mut);
+	while (m_locked)
+	{
+		Fiber* fiber = ThreadPool::getCurrentFiber();
+		if (fiber)
+		{
+			//unlock() resumes us, it may do so before we're switched out
+			m_fiber_waiters.push_back(fiber);
+			lock.unlock();
+			ThreadPool::suspendCurrentFiber();
+			lock.lock();
+		}
+		else
+		{
+			m_num_thread_waiters++;
+			m_cond.wait(lock);
+			m_num_thread_waiters--;
+		}
+	}
+	m_locked = true;
+}
+
+/**
+ * @returns true if the mutex was free and is now held
+ */
+bool FiberMutex::try_lock()
+{
+	LockT lock(m_mut);
+	if (m_locked)
+		return false;
+
+	m_locked = true;
+	return true;
+}
+
+/**
+ * releases the mutex and wakes one waiter, fibers first
+ */
+void FiberMutex::unlock()
+{
+	LockT lock(m_mut);
+	S_ASSERT(m_locked, "unlocking a FiberMutex that isn't locked");
+	m_locked = false;
+
+	if (!m_fiber_waiters.empty())
+	{
+		Fiber* fiber = m_fiber_waiters.front();
+		m_fiber_waiters.erase(m_fiber_waiters.begin());
+		lock.unlock();
+		ThreadPool::resumeFiber(fiber);
+	}
+	else if (m_num_thread_waiters > 0)
+	{
+		lock.unlock();
+		m_cond.notify_one();
+	}
+}
+
+/**
+ * ctor
+ *
+ * @param (optional) set: start out set
+ */
+FiberEvent::FiberEvent(bool set) :
+	m_set(set)
+{
+}
+
+/**
+ * sets the event, releasing everything waiting on it
+ */
+void FiberEvent::set()
+{
+	std::vector<Fiber*> fiber_waiters;
+	LockT lock(m_mut);
+	m_set = true;
+	fiber_waiters.swap(m_fiber_waiters);
+	lock.unlock();
+
+	m_cond.notify_all();
+	for (Fiber* fiber : fiber_waiters)
+		ThreadPool::resumeFiber(fiber);
+}
+
+void FiberEvent::reset()
+{
+	LockT lock(m_mut);
+	m_set = false;
+}
+
+/**
+ * returns once the event is set, suspending the calling
+ * fiber (or blocking the calling thread) until then
+ */
+void FiberEvent::wait()
+{
+	LockT lock(m_mut);
+	while (!m_set)
+	{
+		Fiber* fiber = ThreadPool::getCurrentFiber();
+		if (fiber)
+		{
+			m_fiber_waiters.push_back(fiber);
+			lock.unlock();
+			ThreadPool::suspendCurrentFiber();
+			lock.lock();
+		}
+		else
+		{
+			m_cond.wait(lock);
+		}
+	}
+}
+
+bool FiberEvent::isSet()
+{
+	LockT lock(m_mut);
+	return m_set;
+}
+
+} //namespace sentinel
+
+#endif //FIBERS_ENABLED
@@ -0,0 +1,77 @@
+#ifndef FIBER_SYNC_H
+#define FIBER_SYNC_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include "ThreadPool.h"
+
+#ifdef FIBERS_ENABLED
+
+namespace sentinel
+{
+
+/**
+ * A mutex that suspends a pool fiber instead of blocking its worker,
+ * so other jobs keep running while it waits. Plain threads can use it
+ * too, they just block as with a std::mutex. Meets Lockable, so it
+ * works with std::unique_lock and std::lock_guard.
+ *
+ * Not recursive, and not fair: a woken waiter may find it taken again.
+ */
+class FiberMutex
+{
+public:
+	FiberMutex();
+	FiberMutex(const FiberMutex& other)              = delete;
+	FiberMutex& operator = (const FiberMutex& other) = delete;
+
+	void lock();
+	bool try_lock();
+	void unlock();
+
+private:
+	typedef std::mutex MutexT;
+	typedef std::unique_lock<MutexT> LockT;
+
+	MutexT m_mut; //guards the state below, only ever held briefly
+	std::condition_variable m_cond;
+	bool m_locked;
+	std::vector<Fiber*> m_fiber_waiters;
+	std::size_t m_num_thread_waiters;
+};
+
+/**
+ * A manual reset event. wait() suspends a pool fiber (or blocks a
+ * plain thread) until set() is called, and returns at once while
+ * it stays set.
+ */
+class FiberEvent
+{
+public:
+	FiberEvent(bool set=false);
+	FiberEvent(const FiberEvent& other)              = delete;
+	FiberEvent& operator = (const FiberEvent& other) = delete;
+
+	void set();
+	void reset();
+	void wait();
+	bool isSet();
+
+private:
+	typedef std::mutex MutexT;
+	typedef std::unique_lock<MutexT> LockT;
+
+	MutexT m_mut;
+	std::condition_variable m_cond;
+	bool m_set;
+	std::vector<Fiber*> m_fiber_waiters;
+};
+
+} //namespace sentinel
+
+#endif //FIBERS_ENABLED
+
+#endif //FIBER_SYNC_H
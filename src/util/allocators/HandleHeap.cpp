@@ -0,0 +1,275 @@
+#include "HandleHeap.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace sentinel
+{
+
+const HeapHandle NULL_HEAP_HANDLE = NULL_POOL_HANDLE;
+
+/**
+ * ctor
+ *
+ * @param size_bytes: size of the heap
+ * @param (optional) max_handles: most blocks alive at once (default is 4096)
+ */
+HandleHeap::HandleHeap(std::size_t size_bytes, std::size_t max_handles) :
+	m_heap(static_cast<unsigned char*>(malloc(size_bytes))),
+	m_size(size_bytes),
+	m_top(0),
+	m_used_bytes(0),
+	m_handles(sizeof(BlockEntry), max_handles),
+	m_defrag_read(0),
+	m_defrag_write(0),
+	m_defrag_end(0)
+{
+	if (!m_heap)
+		throw std::bad_alloc();
+
+	m_blocks.reserve(max_handles);
+}
+
+HandleHeap::~HandleHeap()
+{
+	free(m_heap);
+}
+
+/**
+ * Allocates from the top of the heap. Holes left by freed blocks
+ * are only reused once defrag() has slid them up to the top.
+ *
+ * @param size_bytes: bytes to allocate
+ * @returns a handle to the block (NULL_HEAP_HANDLE if there isn't
+ *          room at the top, or no handles are left)
+ */
+HeapHandle HandleHeap::alloc(std::size_t size_bytes)
+{
+	std::size_t size = (size_bytes + BLOCK_ALIGNMENT - 1) & ~(BLOCK_ALIGNMENT - 1);
+	if (size == 0)
+		size = BLOCK_ALIGNMENT;
+
+	LockT lock(m_mut);
+
+	if (size > m_size - m_top)
+		return NULL_HEAP_HANDLE;
+
+	HeapHandle handle = m_handles.alloc();
+	if (handle == NULL_HEAP_HANDLE)
+		return NULL_HEAP_HANDLE;
+
+	BlockEntry* entry = static_cast<BlockEntry*>(m_handles.get(handle));
+	entry->m_offset = m_top;
+	entry->m_size = size;
+	entry->m_pin_count = 0;
+
+	m_top += size;
+	m_used_bytes += size;
+
+	//frees leave stale handles behind, don't let them pile up without defrag
+	if (m_blocks.size() >= m_blocks.capacity() && m_defrag_read == 0)
+		dropStaleBlocks();
+	m_blocks.push_back(handle); //highest address so far, order is kept
+
+	return handle;
+}
+
+/**
+ * frees a block. The hole stays until defrag() reclaims it.
+ *
+ * @param handle: the block to free (must not be pinned)
+ */
+void HandleHeap::freeHandle(HeapHandle handle)
+{
+	LockT lock(m_mut);
+
+	BlockEntry* entry = getEntry(handle);
+	S_ASSERT(entry != nullptr, "freeing a stale heap handle");
+	if (!entry)
+		return;
+	S_ASSERT(entry->m_pin_count == 0, "freeing a pinned block");
+
+	m_used_bytes -= entry->m_size;
+	m_handles.freeHandle(handle);
+}
+
+bool HandleHeap::isValid(HeapHandle handle)
+{
+	return m_handles.isValid(handle);
+}
+
+/**
+ * @param handle: the block
+ * @returns where the block is right now, only good until the next
+ *          defrag step (nullptr if the handle is stale)
+ */
+void* HandleHeap::get(HeapHandle handle)
+{
+	LockT lock(m_mut);
+
+	BlockEntry* entry = getEntry(handle);
+	return entry ? m_heap + entry->m_offset : nullptr;
+}
+
+std::size_t HandleHeap::getBlockSize(HeapHandle handle)
+{
+	LockT lock(m_mut);
+
+	BlockEntry* entry = getEntry(handle);
+	return entry ? entry->m_size : 0;
+}
+
+/**
+ * stops defrag from moving a block, pins nest
+ *
+ * @param handle: the block
+ * @returns the block's address, good until the matching unpin()
+ */
+void* HandleHeap::pin(HeapHandle handle)
+{
+	LockT lock(m_mut);
+
+	BlockEntry* entry = getEntry(handle);
+	if (!entry)
+		return nullptr;
+
+	entry->m_pin_count++;
+	return m_heap + entry->m_offset;
+}
+
+void HandleHeap::unpin(HeapHandle handle)
+{
+	LockT lock(m_mut);
+
+	BlockEntry* entry = getEntry(handle);
+	S_ASSERT(entry != nullptr && entry->m_pin_count > 0, "unpinning a block that isn't pinned");
+	if (entry && entry->m_pin_count > 0)
+		entry->m_pin_count--;
+}
+
+/**
+ * Runs the compaction pass for at most max_bytes of copying. Live
+ * blocks are slid down over holes in address order (pinned ones stay
+ * put), and when the pass reaches the last block the top drops to the
+ * end of the compacted blocks. The next call starts a new pass.
+ *
+ * @param max_bytes: copying budget for this call
+ * @returns bytes actually moved
+ */
+std::size_t HandleHeap::defrag(std::size_t max_bytes)
+{
+	LockT lock(m_mut);
+
+	std::size_t moved = 0;
+	while (m_defrag_read < m_blocks.size())
+	{
+		HeapHandle handle = m_blocks[m_defrag_read];
+		BlockEntry* entry = getEntry(handle);
+		if (!entry)
+		{
+			m_defrag_read++; //freed, its hole gets closed up
+			continue;
+		}
+
+		if (entry->m_pin_count > 0)
+		{
+			m_defrag_end = entry->m_offset + entry->m_size; //can't move, compact past it
+		}
+		else if (entry->m_offset > m_defrag_end)
+		{
+			if (moved + entry->m_size > max_bytes && moved > 0)
+				break; //over budget, resume here next time
+
+			std::memmove(m_heap + m_defrag_end, m_heap + entry->m_offset, entry->m_size);
+			entry->m_offset = m_defrag_end;
+			moved += entry->m_size;
+			m_defrag_end += entry->m_size;
+		}
+		else
+		{
+			m_defrag_end = entry->m_offset + entry->m_size; //already in place
+		}
+
+		m_blocks[m_defrag_write++] = handle;
+		m_defrag_read++;
+	}
+
+	if (m_defrag_read == m_blocks.size())
+	{
+		//pass done: everything above the last block is one free span
+		m_blocks.resize(m_defrag_write);
+		m_top = m_defrag_end;
+		m_defrag_read = 0;
+		m_defrag_write = 0;
+		m_defrag_end = 0;
+	}
+
+	return moved;
+}
+
+/**
+ * runs defrag(max_bytes) as a ThreadPool job. Any block used while
+ * the job may be running has to be pinned.
+ *
+ * @param thread_pool: the pool to run on
+ * @param max_bytes: copying budget for the job
+ * @returns the job's handle, to wait on
+ */
+AsyncJobHandle HandleHeap::defragAsync(ThreadPool& thread_pool, std::size_t max_bytes)
+{
+	return thread_pool.asyncDo([this, max_bytes]() { defrag(max_bytes); });
+}
+
+std::size_t HandleHeap::getSize()
+{
+	return m_size;
+}
+
+std::size_t HandleHeap::getUsedBytes()
+{
+	LockT lock(m_mut);
+	return m_used_bytes;
+}
+
+/**
+ * @returns all free bytes, holes included
+ */
+std::size_t HandleHeap::getFreeBytes()
+{
+	LockT lock(m_mut);
+	return m_size - m_used_bytes;
+}
+
+/**
+ * @returns free bytes above the top, the most alloc() can give right now
+ */
+std::size_t HandleHeap::getContiguousFreeBytes()
+{
+	LockT lock(m_mut);
+	return m_size - m_top;
+}
+
+/**
+ * caller holds m_mut
+ *
+ * @returns the handle's entry (nullptr if stale)
+ */
+HandleHeap::BlockEntry* HandleHeap::getEntry(HeapHandle handle)
+{
+	return static_cast<BlockEntry*>(m_handles.get(handle));
+}
+
+/**
+ * forgets freed blocks' handles without moving anything.
+ * Caller holds m_mut, and no defrag pass may be under way.
+ */
+void HandleHeap::dropStaleBlocks()
+{
+	m_blocks.erase(std::remove_if(m_blocks.begin(), m_blocks.end(),
+		[this](HeapHandle handle) { return !m_handles.isValid(handle); }),
+		m_blocks.end());
+}
+
+} //namespace sentinel
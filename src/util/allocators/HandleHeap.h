@@ -0,0 +1,92 @@
+#ifndef HANDLE_HEAP_H
+#define HANDLE_HEAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "HandlePool.h"
+#include "SentinelAssert.h"
+#include "ThreadPool.h"
+
+namespace sentinel
+{
+
+typedef PoolHandle HeapHandle; //a block's slot in the heap's handle table
+extern const HeapHandle NULL_HEAP_HANDLE;
+
+/**
+ * A relocatable heap: blocks are reached through generational handles,
+ * never kept pointers, so the heap is free to move them. Blocks are
+ * bump allocated from the top; freeing leaves holes, and defrag() slides
+ * live blocks down over the holes a bounded number of bytes at a time,
+ * so the free space ends up contiguous again without a stop-the-world
+ * compaction. Call it once a frame, or as a job with defragAsync().
+ *
+ * A pointer from get() is only good until the next defrag step. If
+ * defrag can run concurrently (defragAsync), or the pointer is held
+ * across frames, pin() the block instead: pinned blocks never move,
+ * compaction just carries on past them.
+ */
+class HandleHeap
+{
+public:
+	HandleHeap(std::size_t size_bytes, std::size_t max_handles=4096);
+	HandleHeap(const HandleHeap& other)              = delete;
+	HandleHeap& operator = (const HandleHeap& other) = delete;
+	~HandleHeap();
+
+	HeapHandle alloc(std::size_t size_bytes);
+	void freeHandle(HeapHandle handle);
+
+	bool isValid(HeapHandle handle);
+	void* get(HeapHandle handle);
+	std::size_t getBlockSize(HeapHandle handle);
+
+	void* pin(HeapHandle handle);
+	void unpin(HeapHandle handle);
+
+	std::size_t defrag(std::size_t max_bytes);
+	AsyncJobHandle defragAsync(ThreadPool& thread_pool, std::size_t max_bytes);
+
+	std::size_t getSize();
+	std::size_t getUsedBytes();
+	std::size_t getFreeBytes();
+	std::size_t getContiguousFreeBytes();
+
+	static constexpr std::size_t BLOCK_ALIGNMENT = 16;
+
+private:
+	struct BlockEntry
+	{
+		std::size_t m_offset;
+		std::size_t m_size;
+		std::uint32_t m_pin_count;
+	};
+
+	BlockEntry* getEntry(HeapHandle handle);
+	void dropStaleBlocks();
+
+	typedef std::mutex MutexT;
+	typedef std::unique_lock<MutexT> LockT;
+
+	unsigned char* m_heap;
+	std::size_t m_size;
+	std::size_t m_top; //everything above here is free
+	std::size_t m_used_bytes;
+
+	HandlePool m_handles; //a BlockEntry per handle
+	std::vector<HeapHandle> m_blocks; //in address order, may hold stale handles
+
+	//an incremental compaction pass, resumed by each defrag() call
+	std::size_t m_defrag_read;
+	std::size_t m_defrag_write;
+	std::size_t m_defrag_end;
+
+	MutexT m_mut;
+};
+
+} //namespace sentinel
+
+#endif //HANDLE_HEAP_H
@@ -0,0 +1,138 @@
+#include "HandlePool.h"
+
+namespace sentinel
+{
+
+const PoolHandle NULL_POOL_HANDLE = 0; //generation 0 is never handed out
+
+/**
+ * ctor
+ *
+ * @param item_size: size of each slot
+ * @param (optional) capacity: number of slots, or the first slab's
+ *        if growable (default is 1024)
+ * @param (optional) growable: if true, grows instead of returning
+ *        NULL_POOL_HANDLE when full (default is false)
+ */
+HandlePool::HandlePool(std::size_t item_size, std::size_t capacity, bool growable) :
+	m_item_size(item_size),
+	m_pool(SLOT_HEADER_SIZE + ((item_size + SLOT_HEADER_SIZE - 1) & ~(SLOT_HEADER_SIZE - 1)),
+		capacity, growable)
+{
+	static_assert(sizeof(std::atomic<std::uint32_t>) <= SLOT_HEADER_SIZE, "generation doesn't fit the header");
+}
+
+/**
+ * dtor
+ */
+HandlePool::~HandlePool()
+{
+}
+
+std::size_t HandlePool::getItemSize()
+{
+	return m_item_size;
+}
+
+std::size_t HandlePool::getCapacity()
+{
+	return m_pool.getCapacity();
+}
+
+bool HandlePool::isGrowable()
+{
+	return m_pool.isGrowable();
+}
+
+/**
+ * grabs a free slot
+ *
+ * @returns a handle to the slot (NULL_POOL_HANDLE if the pool is full)
+ */
+PoolHandle HandlePool::alloc()
+{
+	void* slot = m_pool.alloc();
+	if (!slot)
+		return NULL_POOL_HANDLE;
+
+	//slabs start zeroed, a slot's first use takes generation 1
+	std::uint32_t index = m_pool.getBlockIndex(slot);
+	std::atomic<std::uint32_t>& generation = getGenerationOf(index);
+	std::uint32_t cur = generation.load(std::memory_order_relaxed);
+	if (cur == 0)
+	{
+		cur = 1;
+		generation.store(cur, std::memory_order_release);
+	}
+	return makeHandle(index, cur);
+}
+
+/**
+ * frees the slot behind a handle. Bumping the generation makes
+ * this handle (and any copies of it) stale.
+ *
+ * @param handle: the handle to free
+ * @returns false if the handle was already stale (double free)
+ */
+bool HandlePool::freeHandle(PoolHandle handle)
+{
+	std::uint32_t index = getIndex(handle);
+	std::uint32_t generation = getGeneration(handle);
+	if (handle == NULL_POOL_HANDLE || index >= m_pool.getCapacity())
+		return false;
+
+	//skip 0 on wrap around so a live handle is never NULL_POOL_HANDLE
+	std::uint32_t next_generation = (generation + 1 == 0) ? 1 : generation + 1;
+	if (!getGenerationOf(index).compare_exchange_strong(generation, next_generation,
+		std::memory_order_acq_rel))
+	{
+		S_ASSERT(false, "freeing a stale pool handle");
+		return false;
+	}
+
+	m_pool.freeBlock(m_pool.getBlock(index));
+	return true;
+}
+
+/**
+ * @param handle: the handle to check
+ * @returns true if the handle's slot hasn't been freed since alloc()
+ */
+bool HandlePool::isValid(PoolHandle handle)
+{
+	std::uint32_t index = getIndex(handle);
+	if (handle == NULL_POOL_HANDLE || index >= m_pool.getCapacity())
+		return false;
+
+	return getGenerationOf(index).load(std::memory_order_acquire) == getGeneration(handle);
+}
+
+/**
+ * @param handle: the handle to resolve
+ * @returns the slot's memory, or nullptr if the handle is stale
+ */
+void* HandlePool::get(PoolHandle handle)
+{
+	if (!isValid(handle))
+		return nullptr;
+
+	return getUnchecked(handle);
+}
+
+/**
+ * @param handle: a handle this pool handed out, stale or not
+ * @returns the slot's memory whether or not the handle is still live.
+ *          Only for state the caller tags with the generation itself.
+ */
+void* HandlePool::getUnchecked(PoolHandle handle)
+{
+	S_ASSERT(handle != NULL_POOL_HANDLE);
+	return static_cast<unsigned char*>(m_pool.getBlock(getIndex(handle))) + SLOT_HEADER_SIZE;
+}
+
+std::atomic<std::uint32_t>& HandlePool::getGenerationOf(std::uint32_t index)
+{
+	return *reinterpret_cast<std::atomic<std::uint32_t>*>(m_pool.getBlock(index));
+}
+
+} //namespace sentinel
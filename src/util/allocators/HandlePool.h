@@ -0,0 +1,77 @@
+#ifndef HANDLE_POOL_H
+#define HANDLE_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "LockFreePool.h"
+#include "SentinelAssert.h"
+
+namespace sentinel
+{
+
+//a 32-bit slot index in the low half, the slot's generation in the high half
+typedef std::uint64_t PoolHandle;
+extern const PoolHandle NULL_POOL_HANDLE;
+
+/**
+ * A pool that hands out (index, generation) handles instead of pointers.
+ * Slots sit in a LockFreePool, so alloc and free are lock free and O(1),
+ * and 32-bit indices allow millions of slots. A growable pool chains on
+ * slabs as it fills, so alloc() only fails once the heap does.
+ *
+ * Every slot carries a generation that is bumped when the slot is freed,
+ * so a handle to a freed (or freed and reused) slot is detected as stale
+ * with one compare. Generations start at 1, so no live handle is ever
+ * NULL_POOL_HANDLE. The generation lives in a header in front of the slot,
+ * and slots are never unmapped while the pool lives, so it grows with it.
+ *
+ * NOTE: get() checks the handle at the time of the call; it is up to the
+ * caller to keep the slot from being freed while using the pointer.
+ */
+class HandlePool
+{
+public:
+	HandlePool(std::size_t item_size, std::size_t capacity=1024, bool growable=false);
+	HandlePool(const HandlePool& other)              = delete;
+	HandlePool& operator = (const HandlePool& other) = delete;
+	~HandlePool();
+
+	std::size_t getItemSize();
+	std::size_t getCapacity(); //grows with the pool
+	bool isGrowable();
+
+	PoolHandle alloc();
+	bool freeHandle(PoolHandle handle);
+
+	bool isValid(PoolHandle handle);
+	void* get(PoolHandle handle);
+	void* getUnchecked(PoolHandle handle); //the slot even if stale, for generation tagged state
+
+	static inline std::uint32_t getIndex(PoolHandle handle)
+	{
+		return static_cast<std::uint32_t>(handle & 0xFFFFFFFF);
+	}
+	static inline std::uint32_t getGeneration(PoolHandle handle)
+	{
+		return static_cast<std::uint32_t>(handle >> 32);
+	}
+
+private:
+	static const std::size_t SLOT_HEADER_SIZE = sizeof(std::uint64_t); //keeps slots 8 byte aligned
+
+	static inline PoolHandle makeHandle(std::uint32_t index, std::uint32_t generation)
+	{
+		return (static_cast<PoolHandle>(generation) << 32) | index;
+	}
+
+	std::atomic<std::uint32_t>& getGenerationOf(std::uint32_t index);
+
+	std::size_t m_item_size;
+	LockFreePool m_pool;
+};
+
+} //namespace sentinel
+
+#endif //HANDLE_POOL_H
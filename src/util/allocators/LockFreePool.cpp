@@ -0,0 +1,308 @@
+#include "LockFreePool.h"
+
+namespace sentinel
+{
+
+/**
+ * ctor
+ *
+ * @param item_size: size of each item
+ * @param (optional) capacity: number of items, or the first slab's
+ *        if growable (default is 128)
+ * @param (optional) growable: if true, chains on a slab twice the size
+ *        of the last whenever the pool runs dry instead of returning
+ *        nullptr (default is false)
+ */
+LockFreePool::LockFreePool(std::size_t item_size, std::size_t capacity, bool growable) :
+	m_item_size(item_size),
+	m_slab_capacity(capacity),
+	m_growable(growable),
+	m_capacity(capacity),
+	m_num_slabs(1),
+	m_head(packHead(capacity ? 0 : NULL_INDEX, 0))
+{
+	S_ASSERT(m_item_size > 0);
+	S_ASSERT(capacity < NULL_INDEX, "too many items for 32-bit indices");
+	S_ASSERT(!m_growable || capacity > 0);
+
+	for (std::size_t i = 0; i < MAX_SLABS; i++)
+		m_slabs[i].store(nullptr, std::memory_order_relaxed);
+	m_slabs[0].store(static_cast<unsigned char*>(calloc(1, getSlabSize(0))), std::memory_order_relaxed);
+	S_ASSERT(m_slabs[0].load(std::memory_order_relaxed) != nullptr);
+
+	//every block links to the next, the last one ends the stack
+	for (std::size_t i = 0; i < capacity; i++)
+	{
+		std::uint32_t next = (i + 1 < capacity) ?
+			static_cast<std::uint32_t>(i + 1) : NULL_INDEX;
+		getNext(static_cast<std::uint32_t>(i)).store(next, std::memory_order_relaxed);
+	}
+}
+
+/**
+ * dtor
+ */
+LockFreePool::~LockFreePool()
+{
+	for (std::size_t i = 0; i < MAX_SLABS; i++)
+		free(m_slabs[i].load(std::memory_order_relaxed));
+}
+
+std::size_t LockFreePool::getItemSize()
+{
+	return m_item_size;
+}
+
+std::size_t LockFreePool::getCapacity()
+{
+	return m_capacity.load(std::memory_order_acquire);
+}
+
+std::size_t LockFreePool::getNumSlabs()
+{
+	return m_num_slabs.load(std::memory_order_acquire);
+}
+
+bool LockFreePool::isGrowable()
+{
+	return m_growable;
+}
+
+/**
+ * Pops the first free block off the stack, growing
+ * the pool first if it's empty and growable.
+ *
+ * @returns void* to alloc'd item (nullptr if the pool is full)
+ */
+void* LockFreePool::alloc()
+{
+	std::uint64_t head = m_head.load(std::memory_order_acquire);
+	while (true)
+	{
+		std::uint32_t index = headIndex(head);
+		if (index == NULL_INDEX)
+		{
+			if (!m_growable || !grow())
+				return nullptr;
+			head = m_head.load(std::memory_order_acquire);
+			continue;
+		}
+
+		std::uint32_t next = getNext(index).load(std::memory_order_relaxed);
+		std::uint64_t new_head = packHead(next, headTag(head) + 1);
+
+		//a failed swap reloads head for us
+		if (m_head.compare_exchange_weak(head, new_head,
+			std::memory_order_acquire, std::memory_order_acquire))
+		{
+			return getBlock(index);
+		}
+	}
+}
+
+/**
+ * Allocates a block of memory aligned to a certain amount,
+ * same rules as MemoryPool::allocAligned
+ *
+ * @param size_bytes: size of the actual memory block being allocated
+ * @param alignment: the alignment in bytes of the memory you're allocating
+ */
+void* LockFreePool::allocAligned(std::size_t size_bytes, std::size_t alignment)
+{
+	S_ASSERT(alignment >= 1);
+	S_ASSERT(alignment <= 128);
+	S_ASSERT((size_bytes + alignment) == m_item_size);
+
+	uintptr_t raw_address = reinterpret_cast<uintptr_t>(alloc());
+	if (reinterpret_cast<void*>(raw_address) == nullptr)
+		return nullptr;
+
+	std::size_t mask = (alignment - 1);
+	uintptr_t misalignment = (raw_address & mask);
+	std::ptrdiff_t adjustment = alignment - misalignment;
+
+	S_ASSERT(adjustment < 256);
+	uintptr_t aligned_address = raw_address + adjustment;
+
+	//write the adjustment in the byte before the block
+	uint8_t* adjustment_ptr = reinterpret_cast<uint8_t*>(aligned_address - 1);
+	*adjustment_ptr = static_cast<uint8_t>(adjustment);
+
+	return reinterpret_cast<void*>(aligned_address);
+}
+
+/**
+ * Pushes a block back onto the free stack
+ *
+ * @param p: a pointer to the memory to be freed
+ */
+void LockFreePool::freeBlock(void* p)
+{
+	S_ASSERT(p != nullptr);
+	std::uint32_t index = getBlockIndex(p);
+	pushChain(index, index);
+}
+
+/**
+ * reads the adjustment byte before an aligned block
+ * and frees the whole block.
+ *
+ * @param p: a pointer to the aligned memory block to free
+ */
+void LockFreePool::freeBlockAligned(void* p)
+{
+	S_ASSERT(p != nullptr);
+
+	uintptr_t adjusted_address = reinterpret_cast<uintptr_t>(p);
+	uint8_t adjustment = *(reinterpret_cast<uint8_t*>(adjusted_address - 1));
+	freeBlock(reinterpret_cast<void*>(adjusted_address - adjustment));
+}
+
+/**
+ * @param p: the start of a block from this pool
+ * @returns the block's index
+ */
+std::uint32_t LockFreePool::getBlockIndex(void* p)
+{
+	uintptr_t raw_p = reinterpret_cast<uintptr_t>(p);
+	std::size_t num_slabs = m_num_slabs.load(std::memory_order_acquire);
+	for (std::size_t slab = 0; slab < num_slabs; slab++)
+	{
+		uintptr_t raw_slab = reinterpret_cast<uintptr_t>(m_slabs[slab].load(std::memory_order_acquire));
+		if (raw_p < raw_slab || raw_p >= raw_slab + (m_item_size * getSlabCapacity(slab)))
+			continue;
+
+		S_ASSERT(((raw_p - raw_slab) % m_item_size) == 0, "not the start of a block");
+		return static_cast<std::uint32_t>(getSlabStart(slab) + (raw_p - raw_slab) / m_item_size);
+	}
+
+	S_ASSERT(false, "block isn't from this pool");
+	return NULL_INDEX;
+}
+
+/**
+ * @param index: a block index (< capacity)
+ * @returns the start of that block
+ */
+void* LockFreePool::getBlock(std::uint32_t index)
+{
+	S_ASSERT(index < getCapacity());
+
+	std::size_t slab = getSlab(index);
+	unsigned char* raw_slab = m_slabs[slab].load(std::memory_order_acquire);
+	return raw_slab + ((index - getSlabStart(slab)) * m_item_size);
+}
+
+/**
+ * chains on the next slab and pushes all of its blocks onto the
+ * free stack. Serialized, but alloc/free carry on while it runs.
+ *
+ * @returns true if there may be free blocks now, false if the
+ *          pool can't grow any more (or the heap is out)
+ */
+bool LockFreePool::grow()
+{
+	std::lock_guard<std::mutex> lock(m_grow_mut);
+
+	//someone else grew (or freed) while we waited
+	if (headIndex(m_head.load(std::memory_order_acquire)) != NULL_INDEX)
+		return true;
+
+	std::size_t slab = m_num_slabs.load(std::memory_order_relaxed);
+	if (slab >= MAX_SLABS)
+		return false;
+	std::size_t first = getSlabStart(slab);
+	std::size_t count = getSlabCapacity(slab);
+	if (first + count >= NULL_INDEX)
+		return false;
+
+	unsigned char* raw_slab = static_cast<unsigned char*>(calloc(1, getSlabSize(slab)));
+	if (!raw_slab)
+		return false;
+
+	m_slabs[slab].store(raw_slab, std::memory_order_release);
+	m_num_slabs.store(slab + 1, std::memory_order_release);
+	m_capacity.store(first + count, std::memory_order_release);
+
+	for (std::size_t i = first; i + 1 < first + count; i++)
+		getNext(static_cast<std::uint32_t>(i)).store(static_cast<std::uint32_t>(i + 1), std::memory_order_relaxed);
+	pushChain(static_cast<std::uint32_t>(first), static_cast<std::uint32_t>(first + count - 1));
+	return true;
+}
+
+/**
+ * pushes an already linked run of blocks onto the free stack
+ *
+ * @param first: the block that becomes the new top
+ * @param last: the end of the run, linked to the old top
+ */
+void LockFreePool::pushChain(std::uint32_t first, std::uint32_t last)
+{
+	std::uint64_t head = m_head.load(std::memory_order_relaxed);
+	std::uint64_t new_head;
+	do
+	{
+		getNext(last).store(headIndex(head), std::memory_order_relaxed);
+		new_head = packHead(first, headTag(head) + 1);
+	} while (!m_head.compare_exchange_weak(head, new_head,
+		std::memory_order_release, std::memory_order_relaxed));
+}
+
+/**
+ * @param index: a block index (< capacity)
+ * @returns the slab it lives in
+ */
+std::size_t LockFreePool::getSlab(std::uint32_t index)
+{
+	if (index < m_slab_capacity)
+		return 0;
+
+	//slab k > 0 starts at capacity << (k - 1), so it's the bit width of index / capacity
+	std::size_t quotient = index / m_slab_capacity;
+	std::size_t slab = 0;
+	while (quotient)
+	{
+		quotient >>= 1;
+		slab++;
+	}
+	return slab;
+}
+
+std::size_t LockFreePool::getSlabStart(std::size_t slab)
+{
+	return slab ? (m_slab_capacity << (slab - 1)) : 0;
+}
+
+std::size_t LockFreePool::getSlabCapacity(std::size_t slab)
+{
+	return slab ? (m_slab_capacity << (slab - 1)) : m_slab_capacity;
+}
+
+/**
+ * @returns bytes for a slab: its blocks, then (aligned) their next links
+ */
+std::size_t LockFreePool::getSlabSize(std::size_t slab)
+{
+	return getLinksOffset(slab) + (getSlabCapacity(slab) * sizeof(std::atomic<std::uint32_t>));
+}
+
+std::size_t LockFreePool::getLinksOffset(std::size_t slab)
+{
+	const std::size_t align = alignof(std::atomic<std::uint32_t>);
+	return ((m_item_size * getSlabCapacity(slab)) + align - 1) & ~(align - 1);
+}
+
+/**
+ * @param index: a block index (< capacity)
+ * @returns the block's next link in the free stack
+ */
+std::atomic<std::uint32_t>& LockFreePool::getNext(std::uint32_t index)
+{
+	std::size_t slab = getSlab(index);
+	unsigned char* raw_slab = m_slabs[slab].load(std::memory_order_acquire);
+	std::atomic<std::uint32_t>* links = reinterpret_cast<std::atomic<std::uint32_t>*>(
+		raw_slab + getLinksOffset(slab));
+	return links[index - getSlabStart(slab)];
+}
+
+} //namespace sentinel
@@ -0,0 +1,95 @@
+#ifndef LOCK_FREE_POOL_H
+#define LOCK_FREE_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+
+#include "SentinelAssert.h"
+
+namespace sentinel
+{
+
+/**
+ * A fixed capacity pool like MemoryPool, but alloc() and freeBlock()
+ * never take a lock, so any thread may alloc or free concurrently.
+ *
+ * The free list is a Treiber stack of 32-bit block indices. The head packs
+ * the top index together with a 32-bit tag that is bumped on every push/pop,
+ * so a stale compare-and-swap (the ABA problem) fails instead of corrupting
+ * the list. Next links live in a side array rather than inside the free
+ * blocks, so no thread ever reads memory another thread has just allocated.
+ *
+ * A growable pool chains on another slab (twice the size of the last)
+ * whenever it runs dry, so it never returns nullptr short of the 32-bit
+ * index space or the heap running out. Only growing takes a lock. Slabs
+ * are never freed until the pool is, so block addresses and indices stay
+ * valid, and blocks start out zeroed.
+ */
+class LockFreePool
+{
+public:
+	LockFreePool(std::size_t item_size, std::size_t capacity=128, bool growable=false);
+	LockFreePool(const LockFreePool& other)              = delete;
+	LockFreePool& operator = (const LockFreePool& other) = delete;
+	~LockFreePool();
+
+	std::size_t getItemSize();
+	std::size_t getCapacity(); //grows with the pool
+	std::size_t getNumSlabs();
+	bool isGrowable();
+
+	void* alloc();
+	void* allocAligned(std::size_t size_bytes, std::size_t alignment);
+	void freeBlock(void* p);
+	void freeBlockAligned(void* p);
+
+	//blocks are numbered 0..capacity-1, getBlock is O(1), getBlockIndex O(slabs)
+	std::uint32_t getBlockIndex(void* p);
+	void* getBlock(std::uint32_t index);
+
+private:
+	static constexpr std::uint32_t NULL_INDEX = 0xFFFFFFFF;
+	static constexpr std::size_t MAX_SLABS = 33; //slab k > 0 holds capacity << (k - 1)
+
+	static inline std::uint64_t packHead(std::uint32_t index, std::uint32_t tag)
+	{
+		return (static_cast<std::uint64_t>(tag) << 32) | index;
+	}
+	static inline std::uint32_t headIndex(std::uint64_t head)
+	{
+		return static_cast<std::uint32_t>(head & 0xFFFFFFFF);
+	}
+	static inline std::uint32_t headTag(std::uint64_t head)
+	{
+		return static_cast<std::uint32_t>(head >> 32);
+	}
+
+	//a slab is its blocks followed by their next links
+	bool grow();
+	void pushChain(std::uint32_t first, std::uint32_t last);
+	std::size_t getSlab(std::uint32_t index);
+	std::size_t getSlabStart(std::size_t slab);
+	std::size_t getSlabCapacity(std::size_t slab);
+	std::size_t getSlabSize(std::size_t slab);
+	std::size_t getLinksOffset(std::size_t slab);
+	std::atomic<std::uint32_t>& getNext(std::uint32_t index);
+
+	std::size_t m_item_size;
+	std::size_t m_slab_capacity; //of the first slab
+	bool m_growable;
+	std::atomic<std::size_t> m_capacity;
+	std::atomic<std::size_t> m_num_slabs;
+	std::atomic<unsigned char*> m_slabs[MAX_SLABS];
+	std::mutex m_grow_mut;
+
+	//own cache line, this is the only contended word
+	alignas(64) std::atomic<std::uint64_t> m_head;
+};
+
+} //namespace sentinel
+
+#endif //LOCK_FREE_POOL_H
@@ -0,0 +1,287 @@
+#include "MagazinePool.h"
+
+#include <initializer_list>
+#include <utility>
+
+namespace sentinel
+{
+
+//full magazines the depot hangs on to before draining extras to the pool
+static const std::size_t MAX_DEPOT_FULL_MAGAZINES = 8;
+
+/**
+ * ctor
+ *
+ * @param item_size: size of each item (at least sizeof(uintptr_t))
+ * @param (optional) capacity: the pool's slab size in items (default is 128)
+ * @param (optional) magazine_size: blocks per magazine (default is 16)
+ */
+MagazinePool::MagazinePool(std::size_t item_size, std::size_t capacity,
+	std::size_t magazine_size) :
+	m_pool(item_size, capacity, true),
+	m_magazine_size(magazine_size),
+	m_full_magazines(nullptr),
+	m_empty_magazines(nullptr),
+	m_num_full_magazines(0),
+	m_id(ThreadLocalLookup<ThreadCache>::nextOwnerId())
+{
+	S_ASSERT(m_magazine_size > 0);
+}
+
+/**
+ * dtor. Any blocks still sitting in magazines go down with the pool.
+ */
+MagazinePool::~MagazinePool()
+{
+	LockT lock(m_depot_mut);
+
+	for (auto& entry : m_thread_caches)
+	{
+		deleteMagazine(entry.second->m_loaded);
+		deleteMagazine(entry.second->m_previous);
+		delete entry.second;
+	}
+
+	for (Magazine* list : { m_full_magazines, m_empty_magazines })
+	{
+		while (list)
+		{
+			Magazine* next = list->m_next;
+			deleteMagazine(list);
+			list = next;
+		}
+	}
+}
+
+std::size_t MagazinePool::getItemSize()
+{
+	return m_pool.getItemSize();
+}
+
+/**
+ * pops a block off the calling thread's magazine, only going
+ * to the depot or the pool when both of its magazines are empty.
+ *
+ * @returns void* to alloc'd item (nullptr only if the system is out of memory)
+ */
+void* MagazinePool::alloc()
+{
+	ThreadCache* cache = getThreadCache();
+
+	if (cache->m_loaded->m_count == 0)
+	{
+		if (cache->m_previous->m_count > 0)
+		{
+			std::swap(cache->m_loaded, cache->m_previous);
+		}
+		else
+		{
+			//trade our empty magazine for a full one from the depot
+			LockT lock(m_depot_mut);
+			if (m_full_magazines)
+			{
+				Magazine* full = m_full_magazines;
+				m_full_magazines = full->m_next;
+				m_num_full_magazines--;
+
+				cache->m_loaded->m_next = m_empty_magazines;
+				m_empty_magazines = cache->m_loaded;
+				cache->m_loaded = full;
+			}
+			lock.unlock();
+
+			//depot was dry too, fill straight from the pool
+			if (cache->m_loaded->m_count == 0)
+			{
+				cache->m_loaded->m_count = m_pool.allocBatch(
+					cache->m_loaded->m_rounds, m_magazine_size);
+				if (cache->m_loaded->m_count == 0)
+					return nullptr;
+			}
+		}
+	}
+
+	return cache->m_loaded->m_rounds[--cache->m_loaded->m_count];
+}
+
+/**
+ * Allocates a block of memory aligned to a certain amount,
+ * same rules as MemoryPool::allocAligned
+ *
+ * @param size_bytes: size of the actual memory block being allocated
+ * @param alignment: the alignment in bytes of the memory you're allocating
+ */
+void* MagazinePool::allocAligned(std::size_t size_bytes, std::size_t alignment)
+{
+	S_ASSERT(alignment >= 1);
+	S_ASSERT(alignment <= 128);
+	S_ASSERT((size_bytes + alignment) == m_pool.getItemSize());
+
+	uintptr_t raw_address = reinterpret_cast<uintptr_t>(alloc());
+	if (reinterpret_cast<void*>(raw_address) == nullptr)
+		return nullptr;
+
+	std::size_t mask = (alignment - 1);
+	uintptr_t misalignment = (raw_address & mask);
+	std::ptrdiff_t adjustment = alignment - misalignment;
+
+	S_ASSERT(adjustment < 256);
+	uintptr_t aligned_address = raw_address + adjustment;
+
+	//write the adjustment in the byte before the block
+	uint8_t* adjustment_ptr = reinterpret_cast<uint8_t*>(aligned_address - 1);
+	*adjustment_ptr = static_cast<uint8_t>(adjustment);
+
+	return reinterpret_cast<void*>(aligned_address);
+}
+
+/**
+ * pushes a block onto the calling thread's magazine, no matter
+ * which thread allocated it.
+ *
+ * @param p: a pointer to the memory to be freed
+ */
+void MagazinePool::freeBlock(void* p)
+{
+	S_ASSERT(p != nullptr);
+	ThreadCache* cache = getThreadCache();
+
+	if (cache->m_loaded->m_count == m_magazine_size)
+	{
+		if (cache->m_previous->m_count == 0)
+		{
+			std::swap(cache->m_loaded, cache->m_previous);
+		}
+		else
+		{
+			//hand our full magazine to the depot, take an empty one back
+			Magazine* full = cache->m_loaded;
+			Magazine* drain = nullptr;
+
+			LockT lock(m_depot_mut);
+			if (m_num_full_magazines < MAX_DEPOT_FULL_MAGAZINES)
+			{
+				full->m_next = m_full_magazines;
+				m_full_magazines = full;
+				m_num_full_magazines++;
+
+				if (m_empty_magazines)
+				{
+					cache->m_loaded = m_empty_magazines;
+					m_empty_magazines = m_empty_magazines->m_next;
+				}
+				else
+				{
+					cache->m_loaded = nullptr;
+				}
+			}
+			else
+			{
+				drain = full; //depot has plenty, give the blocks back instead
+			}
+			lock.unlock();
+
+			if (drain)
+			{
+				m_pool.freeBatch(drain->m_rounds, drain->m_count);
+				drain->m_count = 0;
+			}
+			else if (!cache->m_loaded)
+			{
+				cache->m_loaded = newMagazine();
+			}
+		}
+	}
+
+	cache->m_loaded->m_rounds[cache->m_loaded->m_count++] = p;
+}
+
+/**
+ * reads the adjustment byte before an aligned block
+ * and frees the whole block.
+ *
+ * @param p: a pointer to the aligned memory block to free
+ */
+void MagazinePool::freeBlockAligned(void* p)
+{
+	S_ASSERT(p != nullptr);
+
+	uintptr_t adjusted_address = reinterpret_cast<uintptr_t>(p);
+	uint8_t adjustment = *(reinterpret_cast<uint8_t*>(adjusted_address - 1));
+	freeBlock(reinterpret_cast<void*>(adjusted_address - adjustment));
+}
+
+/**
+ * gives all of the calling thread's cached blocks back to the
+ * pool and forgets about the thread. Call before a thread that used
+ * this pool exits.
+ */
+void MagazinePool::flushThreadCache()
+{
+	LockT lock(m_depot_mut);
+
+	auto iter = m_thread_caches.find(std::this_thread::get_id());
+	if (iter == m_thread_caches.end())
+		return;
+
+	ThreadCache* cache = iter->second;
+	m_thread_caches.erase(iter);
+	ThreadLocalLookup<ThreadCache>::store(m_id, nullptr);
+	lock.unlock();
+
+	for (Magazine* mag : { cache->m_loaded, cache->m_previous })
+	{
+		m_pool.freeBatch(mag->m_rounds, mag->m_count);
+		deleteMagazine(mag);
+	}
+	delete cache;
+}
+
+/**
+ * the fast path: a thread local cache hit, else registerThread()
+ */
+MagazinePool::ThreadCache* MagazinePool::getThreadCache()
+{
+	ThreadCache* cache = ThreadLocalLookup<ThreadCache>::find(m_id);
+	if (cache)
+		return cache;
+
+	return registerThread();
+}
+
+/**
+ * the slow path: finds (or makes) the calling thread's
+ * magazines and caches them in thread local storage.
+ */
+MagazinePool::ThreadCache* MagazinePool::registerThread()
+{
+	LockT lock(m_depot_mut);
+
+	ThreadCache*& cache = m_thread_caches[std::this_thread::get_id()];
+	if (!cache)
+	{
+		cache = new ThreadCache();
+		cache->m_loaded = newMagazine();
+		cache->m_previous = newMagazine();
+	}
+
+	ThreadLocalLookup<ThreadCache>::store(m_id, cache);
+	return cache;
+}
+
+MagazinePool::Magazine* MagazinePool::newMagazine()
+{
+	Magazine* mag = new Magazine();
+	mag->m_next = nullptr;
+	mag->m_count = 0;
+	mag->m_rounds = new void*[m_magazine_size];
+	return mag;
+}
+
+void MagazinePool::deleteMagazine(Magazine* mag)
+{
+	delete[] mag->m_rounds;
+	delete mag;
+}
+
+} //namespace sentinel
@@ -0,0 +1,87 @@
+#ifndef MAGAZINE_POOL_H
+#define MAGAZINE_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "MemoryPool.h"
+#include "SentinelAssert.h"
+#include "ThreadLocalLookup.h"
+
+namespace sentinel
+{
+
+/**
+ * A growable MemoryPool fronted by per-thread "magazines": small stacks
+ * of free blocks that only their thread touches. alloc() and freeBlock()
+ * pop/push the calling thread's loaded magazine without any lock. Only
+ * when both of a thread's magazines run empty (or full) does it trade a
+ * whole magazine with the shared depot, or fill/drain one from the pool
+ * in a single batch.
+ *
+ * Blocks may be freed by a different thread than the one that allocated
+ * them: they simply land in the freeing thread's magazine, and full
+ * magazines flow back to allocating threads through the depot.
+ *
+ * A thread's magazines stay with the pool until the pool is destroyed,
+ * so threads that exit before the pool should call flushThreadCache().
+ */
+class MagazinePool
+{
+public:
+	MagazinePool(std::size_t item_size, std::size_t capacity=128,
+		std::size_t magazine_size=16);
+	MagazinePool(const MagazinePool& other)              = delete;
+	MagazinePool& operator = (const MagazinePool& other) = delete;
+	~MagazinePool();
+
+	std::size_t getItemSize();
+
+	void* alloc();
+	void* allocAligned(std::size_t size_bytes, std::size_t alignment);
+	void freeBlock(void* p);
+	void freeBlockAligned(void* p);
+	void flushThreadCache();
+
+private:
+	struct Magazine
+	{
+		Magazine* m_next; //intrusive link for the depot lists
+		std::size_t m_count;
+		void** m_rounds;
+	};
+
+	struct ThreadCache
+	{
+		Magazine* m_loaded;
+		Magazine* m_previous;
+	};
+
+	ThreadCache* getThreadCache();
+	ThreadCache* registerThread();
+
+	Magazine* newMagazine();
+	void deleteMagazine(Magazine* mag);
+
+	typedef std::mutex MutexT;
+	typedef std::unique_lock<MutexT> LockT;
+
+	MemoryPool m_pool;
+	std::size_t m_magazine_size;
+
+	//the depot, all guarded by m_depot_mut
+	Magazine* m_full_magazines;
+	Magazine* m_empty_magazines;
+	std::size_t m_num_full_magazines;
+	std::map<std::thread::id, ThreadCache*> m_thread_caches;
+	MutexT m_depot_mut;
+
+	std::uint64_t m_id;
+};
+
+} //namespace sentinel
+
+#endif //MAGAZINE_POOL_H
@@ -1,5 +1,7 @@
 #include "MemoryPool.h"
 
+#include <algorithm>
+
 namespace sentinel
 {
 
@@ -11,16 +13,26 @@ namespace sentinel
  * @param item_size: size of each item
  * @param (optional) capacity: the starting capacity number of items
  *        (default is 128)
+ * @param (optional) growable: if true, chains on another slab of
+ *        capacity items whenever the pool runs dry instead of returning
+ *        nullptr. Needs item_size >= sizeof(uintptr_t). (default is false)
  */
-MemoryPool::MemoryPool(std::size_t item_size, std::size_t capacity) :
+MemoryPool::MemoryPool(std::size_t item_size, std::size_t capacity, bool growable) :
     m_item_size(item_size),
     m_total_size((capacity + 1) * m_item_size), //first item is head of linked list
-    m_pool(malloc(m_total_size))
+    m_pool(malloc(m_total_size)),
+	m_growable(growable),
+	m_slab_capacity(capacity),
+	m_extra_slabs(nullptr),
+	m_num_extra_slabs(0)
 {
     //alloc our poolm_n
 	S_ASSERT(m_pool != nullptr);
 	S_ASSERT((m_item_size > sizeof(uint16_t) || m_total_size < 16384), "Don't you DARE try to dynamically allocate one byte!");
 	//NOTE: The 16384 is 2^16 - 1: aka max bytes representible using our algorithm for small items
+	S_ASSERT(!m_growable || m_item_size >= sizeof(uintptr_t), "growable pools need items big enough for a ptr");
+	S_ASSERT(!m_growable || capacity > 0);
+	ALLOC_STATS(m_stats.setName("MemoryPool");)
 
     //linked list out of free memory blocks
     if(m_item_size >= sizeof(uintptr_t))
@@ -28,7 +40,7 @@ MemoryPool::MemoryPool(std::size_t item_size, std::size_t capacity) :
         uintptr_t cast_pool = reinterpret_cast<uintptr_t>(m_pool);
         uintptr_t this_node;
         uintptr_t next_free_node;
-        for(unsigned int i = 0; i < capacity; i++)
+        for(unsigned int i = 0; i <= capacity; i++) //head + capacity items
         {
             //modulo so tail points to head as sentinel
             next_free_node = cast_pool + 
@@ -44,7 +56,7 @@ MemoryPool::MemoryPool(std::size_t item_size, std::size_t capacity) :
         uintptr_t cast_pool = reinterpret_cast<uintptr_t>(m_pool);
         uint16_t* this_node;
         uint16_t next_offset;
-        for(unsigned int i = 0; i < capacity; i++)
+        for(unsigned int i = 0; i <= capacity; i++) //head + capacity items
         {
             //modulo so final offset points to head as sentinel
             next_offset = (((i+1) * m_item_size) % m_total_size);
@@ -63,10 +75,19 @@ MemoryPool::MemoryPool(MemoryPool&& other)
 	m_item_size = other.m_item_size;
 	m_total_size = other.m_total_size;
 	m_pool = other.m_pool;
+	m_growable = other.m_growable;
+	m_slab_capacity = other.m_slab_capacity;
+	m_extra_slabs = other.m_extra_slabs;
+	m_num_extra_slabs = other.m_num_extra_slabs;
+	ALLOC_STATS(m_stats = std::move(other.m_stats);)
 
 	other.m_item_size = std::size_t(0);
 	other.m_total_size = std::size_t(0);
 	other.m_pool = nullptr;
+	other.m_growable = false;
+	other.m_slab_capacity = std::size_t(0);
+	other.m_extra_slabs = nullptr;
+	other.m_num_extra_slabs = std::size_t(0);
 }
 
 MemoryPool& MemoryPool::operator = (MemoryPool&& other)
@@ -78,13 +99,32 @@ MemoryPool& MemoryPool::operator = (MemoryPool&& other)
 		LockT rhs_lock(other.m_mut, std::defer_lock);
 		std::lock(lhs_lock, rhs_lock);
 
+		//drop whatever we had before taking other's memory
+		while (m_extra_slabs)
+		{
+			SlabHeader* next = m_extra_slabs->m_next;
+			free(m_extra_slabs);
+			m_extra_slabs = next;
+		}
+		if (m_pool)
+			free(m_pool);
+
 		m_item_size = other.m_item_size;
 		m_total_size = other.m_total_size;
 		m_pool = other.m_pool;
+		m_growable = other.m_growable;
+		m_slab_capacity = other.m_slab_capacity;
+		m_extra_slabs = other.m_extra_slabs;
+		m_num_extra_slabs = other.m_num_extra_slabs;
+		ALLOC_STATS(m_stats = std::move(other.m_stats);)
 
 		other.m_item_size = std::size_t(0);
 		other.m_total_size = std::size_t(0);
 		other.m_pool = nullptr;
+		other.m_growable = false;
+		other.m_slab_capacity = std::size_t(0);
+		other.m_extra_slabs = nullptr;
+		other.m_num_extra_slabs = std::size_t(0);
 	}
 	return (*this);
 }
@@ -96,6 +136,13 @@ MemoryPool::~MemoryPool()
 {
 	LockT lock(m_mut);
 
+	while (m_extra_slabs)
+	{
+		SlabHeader* next = m_extra_slabs->m_next;
+		free(m_extra_slabs);
+		m_extra_slabs = next;
+	}
+
 	if(m_pool) //in case was moved
 		free(m_pool);
 }
@@ -105,17 +152,75 @@ std::size_t MemoryPool::getItemSize()
 	return m_item_size;
 }
 
+/**
+ * @returns how many slabs the pool currently owns (including the first)
+ */
+std::size_t MemoryPool::getNumSlabs()
+{
+	LockT lock(m_mut);
+	return (m_pool ? 1 : 0) + m_num_extra_slabs;
+}
+
+bool MemoryPool::isGrowable()
+{
+	return m_growable;
+}
+
 /**
  * Returns a pointer corresponding to the first free slot.
- * If none is available, returns nullptr.
+ * If none is available, a growable pool chains on a new slab,
+ * otherwise returns nullptr.
  *
- * @param n_bytes: the size in bytes
- * @returns void* to alloc'd item (never null)
+ * @returns void* to alloc'd item (nullptr if full)
  */
 void* MemoryPool::alloc()
 {
 	LockT lock(m_mut);
+	return allocUnlocked();
+}
+
+/**
+ * allocates up to count blocks while taking the lock only once
+ *
+ * @param out: array of at least count void* to fill
+ * @param count: how many blocks to try to allocate
+ * @returns how many blocks were actually allocated (< count if full)
+ */
+std::size_t MemoryPool::allocBatch(void** out, std::size_t count)
+{
+	LockT lock(m_mut);
+
+	std::size_t allocated = 0;
+	while (allocated < count)
+	{
+		void* p = allocUnlocked();
+		if (!p)
+			break;
+		out[allocated++] = p;
+	}
+	return allocated;
+}
 
+/**
+ * the body of alloc(), caller holds m_mut
+ */
+void* MemoryPool::allocUnlocked()
+{
+	void* p = popFreeUnlocked();
+	ALLOC_STATS(
+		if (p)
+			m_stats.recordAlloc(m_item_size);
+		else
+			m_stats.recordFailedAlloc(m_item_size);
+	)
+	return p;
+}
+
+/**
+ * pops the free list head, growing if allowed. Caller holds m_mut
+ */
+void* MemoryPool::popFreeUnlocked()
+{
     if(m_item_size >= sizeof(uintptr_t))
     {
         //pt head to the next of the next free
@@ -124,7 +229,10 @@ void* MemoryPool::alloc()
 
         if(next_free == next_free_head)
         {
-            return nullptr; //points to head->full
+            if(!m_growable || !grow())
+                return nullptr; //points to head->full
+
+            next_free = reinterpret_cast<uintptr_t*>( *next_free_head );
         }
         uintptr_t second_next_free = *next_free;
         *next_free_head = second_next_free;
@@ -190,12 +298,38 @@ void* MemoryPool::allocAligned(std::size_t size_bytes, std::size_t alignment)
  */
 void MemoryPool::freeBlock(void* p)
 {
-	//make sure that p actually allocated by this pool
+	//make sure that p actually allocated by this pool (can only cheaply check the first slab)
     S_ASSERT(p != nullptr);
-	S_ASSERT(reinterpret_cast<uintptr_t>(p) < (reinterpret_cast<uintptr_t>(m_pool) + m_total_size) );
-	S_ASSERT(reinterpret_cast<uintptr_t>(p) > reinterpret_cast<uintptr_t>(m_pool)); //m_pool points to ll head, strict compare only
+	S_ASSERT(m_growable || reinterpret_cast<uintptr_t>(p) < (reinterpret_cast<uintptr_t>(m_pool) + m_total_size) );
+	S_ASSERT(m_growable || reinterpret_cast<uintptr_t>(p) > reinterpret_cast<uintptr_t>(m_pool)); //m_pool points to ll head, strict compare only
 
 	LockT lock(m_mut);
+	freeBlockUnlocked(p);
+}
+
+/**
+ * frees count blocks while taking the lock only once
+ *
+ * @param blocks: the blocks to free
+ * @param count: number of blocks
+ */
+void MemoryPool::freeBatch(void** blocks, std::size_t count)
+{
+	LockT lock(m_mut);
+
+	for (std::size_t i = 0; i < count; i++)
+	{
+		S_ASSERT(blocks[i] != nullptr);
+		freeBlockUnlocked(blocks[i]);
+	}
+}
+
+/**
+ * the body of freeBlock(), caller holds m_mut
+ */
+void MemoryPool::freeBlockUnlocked(void* p)
+{
+	ALLOC_STATS(m_stats.recordFree(m_item_size);)
 
     if(m_item_size >= sizeof(uintptr_t))
     {
@@ -242,8 +376,8 @@ void MemoryPool::freeBlockAligned(void* p)
 {
 	//redundant double assert makes me cry :(
     S_ASSERT(p != nullptr);
-	S_ASSERT(reinterpret_cast<uintptr_t>(p) < reinterpret_cast<uintptr_t>(m_pool) + m_total_size);
-	S_ASSERT(reinterpret_cast<uintptr_t>(p) > reinterpret_cast<uintptr_t>(m_pool)); //m_pool points to ll head, strict compare only
+	S_ASSERT(m_growable || reinterpret_cast<uintptr_t>(p) < reinterpret_cast<uintptr_t>(m_pool) + m_total_size);
+	S_ASSERT(m_growable || reinterpret_cast<uintptr_t>(p) > reinterpret_cast<uintptr_t>(m_pool)); //m_pool points to ll head, strict compare only
 
     //adjust address back to raw form and free normally
     uintptr_t adjusted_address = reinterpret_cast<uintptr_t>(p);
@@ -252,4 +386,126 @@ void MemoryPool::freeBlockAligned(void* p)
     freeBlock(reinterpret_cast<void*>(raw_address));
 }
 
+/**
+ * Hands every extra slab with no live items back to the OS.
+ * The first slab is never released. This walks the whole free list,
+ * so call it at quiet points (e.g. after a level load), not per frame.
+ *
+ * @returns the number of slabs released
+ */
+std::size_t MemoryPool::releaseEmptySlabs()
+{
+	LockT lock(m_mut);
+
+	if (!m_growable || m_num_extra_slabs == 0)
+		return 0;
+
+	struct SlabRange
+	{
+		uintptr_t m_begin;
+		uintptr_t m_end;
+		SlabHeader* m_slab;
+		std::size_t m_free_count;
+	};
+
+	//sorted ranges so each free node maps to its slab by binary search
+	std::vector<SlabRange> ranges;
+	ranges.reserve(m_num_extra_slabs);
+	std::size_t slab_bytes = m_slab_capacity * m_item_size;
+	for (SlabHeader* slab = m_extra_slabs; slab; slab = slab->m_next)
+	{
+		uintptr_t begin = reinterpret_cast<uintptr_t>(slab) + sizeof(SlabHeader);
+		ranges.push_back({ begin, begin + slab_bytes, slab, 0 });
+	}
+	std::sort(ranges.begin(), ranges.end(),
+		[](const SlabRange& lhs, const SlabRange& rhs) { return lhs.m_begin < rhs.m_begin; });
+
+	auto findRange = [&ranges](uintptr_t node) -> SlabRange*
+	{
+		auto iter = std::upper_bound(ranges.begin(), ranges.end(), node,
+			[](uintptr_t n, const SlabRange& r) { return n < r.m_begin; });
+		if (iter == ranges.begin())
+			return nullptr;
+		--iter;
+		return (node < iter->m_end) ? &(*iter) : nullptr;
+	};
+
+	uintptr_t head = reinterpret_cast<uintptr_t>(m_pool);
+	for (uintptr_t node = *reinterpret_cast<uintptr_t*>(head); node != head;
+		node = *reinterpret_cast<uintptr_t*>(node))
+	{
+		SlabRange* range = findRange(node);
+		if (range)
+			range->m_free_count++;
+	}
+
+	//unlink nodes living in fully free slabs, then free those slabs
+	uintptr_t prev = head;
+	uintptr_t node = *reinterpret_cast<uintptr_t*>(head);
+	while (node != head)
+	{
+		uintptr_t next = *reinterpret_cast<uintptr_t*>(node);
+		SlabRange* range = findRange(node);
+		if (range && range->m_free_count == m_slab_capacity)
+			*reinterpret_cast<uintptr_t*>(prev) = next;
+		else
+			prev = node;
+		node = next;
+	}
+
+	std::size_t released = 0;
+	SlabHeader** link = &m_extra_slabs;
+	while (*link)
+	{
+		SlabHeader* slab = *link;
+		uintptr_t begin = reinterpret_cast<uintptr_t>(slab) + sizeof(SlabHeader);
+		if (findRange(begin)->m_free_count == m_slab_capacity)
+		{
+			*link = slab->m_next;
+			free(slab);
+			released++;
+		}
+		else
+		{
+			link = &slab->m_next;
+		}
+	}
+
+	m_num_extra_slabs -= released;
+	return released;
+}
+
+/**
+ * chains a fresh slab of m_slab_capacity items onto the pool
+ * and pushes all of them onto the free list. Caller holds m_mut.
+ *
+ * @returns false if the system is out of memory
+ */
+bool MemoryPool::grow()
+{
+	SlabHeader* slab = reinterpret_cast<SlabHeader*>(
+		malloc(sizeof(SlabHeader) + (m_slab_capacity * m_item_size)) );
+	if (!slab)
+		return false;
+
+	slab->m_next = m_extra_slabs;
+	m_extra_slabs = slab;
+	m_num_extra_slabs++;
+
+	//new items link to each other, last one links to the old free head
+	uintptr_t* next_free_head = reinterpret_cast<uintptr_t*>(m_pool);
+	uintptr_t first_item = reinterpret_cast<uintptr_t>(slab) + sizeof(SlabHeader);
+	for (std::size_t i = 0; i < m_slab_capacity; i++)
+	{
+		uintptr_t this_node = first_item + (i * m_item_size);
+		uintptr_t next_free_node = (i + 1 < m_slab_capacity) ?
+			(this_node + m_item_size) : *next_free_head;
+
+		*(reinterpret_cast<uintptr_t*>(this_node)) = next_free_node;
+	}
+
+	*next_free_head = first_item;
+	return true;
+}
+
 }//namespace s_util
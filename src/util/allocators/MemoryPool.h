@@ -9,6 +9,7 @@
 #include <thread>
 #include <vector>
 
+#include "AllocatorStats.h"
 #include "SentinelAssert.h"
 
 namespace sentinel
@@ -17,7 +18,7 @@ namespace sentinel
 class MemoryPool
 {
 public:
-    MemoryPool(std::size_t item_size, std::size_t capacity=128);
+    MemoryPool(std::size_t item_size, std::size_t capacity=128, bool growable=false);
 	MemoryPool(const MemoryPool& other)              = delete;
 	MemoryPool& operator = (const MemoryPool& other) = delete;
 	MemoryPool(MemoryPool&& other);
@@ -25,21 +26,48 @@ public:
     ~MemoryPool();
 
 	std::size_t getItemSize();
+	std::size_t getNumSlabs();
+	bool isGrowable();
 
     void* alloc();
     void* allocAligned(std::size_t size_bytes, std::size_t alignment);
     void freeBlock(void* p);
     void freeBlockAligned(void* p);
 
+    std::size_t allocBatch(void** out, std::size_t count);
+    void freeBatch(void** blocks, std::size_t count);
+
+    std::size_t releaseEmptySlabs();
+
+	ALLOC_STATS(AllocatorStats& getStats() { return m_stats; })
+
 private:
+	//extra slabs chained on by a growable pool
+	struct alignas(16) SlabHeader
+	{
+		SlabHeader* m_next;
+	};
+
+	void* allocUnlocked();
+	void* popFreeUnlocked();
+	void freeBlockUnlocked(void* p);
+	bool grow();
+
     std::size_t m_item_size;
     std::size_t m_total_size;
     void* m_pool;
 
+	bool m_growable;
+	std::size_t m_slab_capacity;
+	SlabHeader* m_extra_slabs;
+	std::size_t m_num_extra_slabs;
+
 	typedef std::unique_lock<std::mutex> LockT;
 	typedef std::mutex MutexT;
 
 	MutexT m_mut;
+
+	ALLOC_STATS(AllocatorStats m_stats;)
 };
 
 } //namespace s_util
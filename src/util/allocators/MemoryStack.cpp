@@ -7,12 +7,14 @@ MemoryStack::MemoryStack(std::size_t size_bytes) :
     m_total_size(size_bytes),
     m_stack_bottom( reinterpret_cast<uintptr_t>(malloc(size_bytes)) ),
     m_stack_top(m_stack_bottom + m_total_size),
-    m_stack_marker(m_stack_bottom)
+    m_stack_marker(m_stack_bottom),
+    m_high_water(0)
 {
     if( !reinterpret_cast<void*>(m_stack_bottom) )
     {
         throw new std::bad_alloc();
     }
+    ALLOC_STATS(m_stats.setName("MemoryStack");)
 }
 
 MemoryStack::MemoryStack(MemoryStack&& other)
@@ -23,6 +25,8 @@ MemoryStack::MemoryStack(MemoryStack&& other)
 	m_stack_bottom = other.m_stack_bottom;
 	m_stack_top = other.m_stack_top;
 	m_stack_marker = other.m_stack_marker;
+	m_high_water = other.m_high_water;
+	ALLOC_STATS(m_stats = std::move(other.m_stats);)
 	
 	uintptr_t nullptr_raw = reinterpret_cast<uintptr_t>(nullptr);
 	other.m_total_size = 0;
@@ -39,10 +43,15 @@ MemoryStack& MemoryStack::operator = (MemoryStack&& other)
 		LockT rhs_lock(other.m_mut, std::defer_lock);
 		std::lock(lhs_lock, rhs_lock);
 
+		if(reinterpret_cast<void*>(m_stack_bottom))
+			free(reinterpret_cast<void*>(m_stack_bottom));
+
 		m_total_size = other.m_total_size;
 		m_stack_bottom = other.m_stack_bottom;
 		m_stack_top = other.m_stack_top;
 		m_stack_marker = other.m_stack_marker;
+		m_high_water = other.m_high_water;
+		ALLOC_STATS(m_stats = std::move(other.m_stats);)
 
 		uintptr_t nullptr_raw = reinterpret_cast<uintptr_t>(nullptr);
 		other.m_total_size = 0;
@@ -62,6 +71,36 @@ MemoryStack::~MemoryStack()
 }
 
 
+std::size_t MemoryStack::getSize()
+{
+	return m_total_size;
+}
+
+/**
+ * @returns bytes between the bottom of the stack and the marker
+ */
+std::size_t MemoryStack::getUsedBytes()
+{
+	LockT lock(m_mut);
+	return m_stack_marker - m_stack_bottom;
+}
+
+/**
+ * @returns the most bytes that were in use at once since
+ * construction or the last resetHighWaterMark()
+ */
+std::size_t MemoryStack::getHighWaterMark()
+{
+	LockT lock(m_mut);
+	return m_high_water;
+}
+
+void MemoryStack::resetHighWaterMark()
+{
+	LockT lock(m_mut);
+	m_high_water = m_stack_marker - m_stack_bottom;
+}
+
 void* MemoryStack::getStackPtr()
 {
 	LockT lock(m_mut);
@@ -82,10 +121,16 @@ void* MemoryStack::alloc(std::size_t size_bytes)
 
     uintptr_t new_stack_marker = m_stack_marker + size_bytes;
     if(new_stack_marker > m_stack_top)
+    {
+        ALLOC_STATS(m_stats.recordFailedAlloc(size_bytes);)
         return nullptr;
+    }
+    ALLOC_STATS(m_stats.recordAlloc(size_bytes);)
 
     void* mark = reinterpret_cast<void*>(m_stack_marker);
     m_stack_marker = new_stack_marker;
+    if(m_stack_marker - m_stack_bottom > m_high_water)
+        m_high_water = m_stack_marker - m_stack_bottom;
     return mark;
 }
 
@@ -105,6 +150,8 @@ void* MemoryStack::allocAligned(std::size_t size_bytes, std::size_t alignment)
 
     //calculate adjusted address
     void* raw_ptr = alloc(expanded_size_bytes);
+    if(!raw_ptr)
+        return nullptr;
     uintptr_t raw_address = reinterpret_cast<uintptr_t>(raw_ptr);
 
     std::size_t mask = (alignment - 1);
@@ -132,6 +179,7 @@ void MemoryStack::freeTo(void* marker)
     S_ASSERT(reinterpret_cast<uintptr_t>(marker) >= m_stack_bottom);
 
 	LockT lock(m_mut);
+    ALLOC_STATS(m_stats.recordFree(m_stack_marker - reinterpret_cast<uintptr_t>(marker));)
     m_stack_marker = reinterpret_cast<uintptr_t>(marker);
 }
 
@@ -160,6 +208,7 @@ void MemoryStack::freeToAligned(void* marker)
 void MemoryStack::clear()
 {
 	LockT lock(m_mut);
+    ALLOC_STATS(m_stats.recordFree(m_stack_marker - m_stack_bottom);)
     m_stack_marker = m_stack_bottom;
 }
 
@@ -8,6 +8,7 @@
 #include <thread>
 #include <utility>
 
+#include "AllocatorStats.h"
 #include "SentinelAssert.h"
 
 namespace sentinel
@@ -24,6 +25,11 @@ public:
 	MemoryStack& operator = (MemoryStack&& other);
     ~MemoryStack();
 
+    std::size_t getSize();
+    std::size_t getUsedBytes();
+    std::size_t getHighWaterMark();
+    void resetHighWaterMark();
+
     void* getStackPtr();
     void* alloc(std::size_t size_bytes);
     void* allocAligned(std::size_t size_bytes, std::size_t alignment);
@@ -32,16 +38,21 @@ public:
     void freeToAligned(void* marker);
     void clear();
 
+    ALLOC_STATS(AllocatorStats& getStats() { return m_stats; })
+
 private:
     std::size_t m_total_size;
     uintptr_t m_stack_bottom;
     uintptr_t m_stack_top;
     uintptr_t m_stack_marker;
+    std::size_t m_high_water; //most bytes in use at once since the last reset
 
 	typedef std::mutex MutexT;
 	typedef std::unique_lock<MutexT> LockT;
 
 	MutexT m_mut;
+
+	ALLOC_STATS(AllocatorStats m_stats;)
 };
 
 } //namespace s_util
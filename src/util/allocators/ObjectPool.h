@@ -0,0 +1,226 @@
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <utility>
+
+#include "SentinelAssert.h"
+
+namespace sentinel
+{
+
+/**
+ * A fixed size pool of Capacity T's, laid out at compile time. Blocks are
+ * sizeof(T) apart in storage aligned to at least a cache line, so every
+ * object is aligned for T (over-aligned SIMD types included) without the
+ * adjustment byte MemoryPool::allocAligned needs.
+ *
+ * create() constructs in place with forwarded args and destroy() runs the
+ * destructor, so callers never see raw memory. Live objects are tracked
+ * in a bitmap for forEach() and destroyAll().
+ *
+ * The storage lives inside the pool, so big pools belong on the heap.
+ */
+template<typename T, std::size_t Capacity>
+class ObjectPool
+{
+public:
+	static constexpr std::size_t CACHE_LINE_SIZE = 64;
+	static constexpr std::size_t ALIGNMENT =
+		(alignof(T) > CACHE_LINE_SIZE) ? alignof(T) : CACHE_LINE_SIZE;
+
+	ObjectPool() :
+		m_free_head(0),
+		m_num_live(0)
+	{
+		static_assert(Capacity > 0, "ObjectPool needs a capacity");
+		static_assert(Capacity < NULL_INDEX, "too many items for 32-bit indices");
+
+		for (std::size_t i = 0; i < Capacity; i++)
+			m_next_free[i] = static_cast<std::uint32_t>(i + 1);
+		m_next_free[Capacity - 1] = NULL_INDEX;
+
+		for (std::size_t i = 0; i < NUM_LIVE_WORDS; i++)
+			m_live[i] = 0;
+	}
+
+	ObjectPool(const ObjectPool& other)              = delete;
+	ObjectPool& operator = (const ObjectPool& other) = delete;
+
+	/**
+	 * dtor. Destroys anything still alive.
+	 */
+	~ObjectPool()
+	{
+		destroyAll();
+	}
+
+	static constexpr std::size_t getCapacity()
+	{
+		return Capacity;
+	}
+
+	std::size_t getNumLive()
+	{
+		LockT lock(m_mut);
+		return m_num_live;
+	}
+
+	/**
+	 * constructs a T in a free block
+	 *
+	 * @param args: forwarded to T's ctor
+	 * @returns the new object (nullptr if the pool is full)
+	 */
+	template<typename... Args>
+	T* create(Args&&... args)
+	{
+		LockT lock(m_mut);
+		std::uint32_t index = m_free_head;
+		if (index == NULL_INDEX)
+			return nullptr;
+		m_free_head = m_next_free[index];
+		lock.unlock();
+
+		//construct unlocked so T's ctor may use the pool too
+		T* obj;
+		try
+		{
+			obj = new(getBlock(index)) T(std::forward<Args>(args)...);
+		}
+		catch (...)
+		{
+			lock.lock();
+			pushFree(index);
+			throw;
+		}
+
+		lock.lock();
+		m_live[index / 64] |= (std::uint64_t(1) << (index % 64));
+		m_num_live++;
+		return obj;
+	}
+
+	/**
+	 * destructs a live object and returns its block to the pool
+	 *
+	 * @param obj: an object made by this pool's create()
+	 */
+	void destroy(T* obj)
+	{
+		S_ASSERT(obj != nullptr);
+		std::uint32_t index = getIndex(obj);
+
+		LockT lock(m_mut);
+		S_ASSERT(isLive(index), "destroying an object that isn't alive");
+		m_live[index / 64] &= ~(std::uint64_t(1) << (index % 64));
+		m_num_live--;
+		lock.unlock();
+
+		obj->~T();
+
+		lock.lock();
+		pushFree(index);
+	}
+
+	/**
+	 * destructs every live object at once and resets the free list
+	 */
+	void destroyAll()
+	{
+		LockT lock(m_mut);
+
+		forEachLiveIndex([this](std::uint32_t index)
+		{
+			reinterpret_cast<T*>(getBlock(index))->~T();
+		});
+
+		for (std::size_t i = 0; i < NUM_LIVE_WORDS; i++)
+			m_live[i] = 0;
+		for (std::size_t i = 0; i < Capacity; i++)
+			m_next_free[i] = static_cast<std::uint32_t>(i + 1);
+		m_next_free[Capacity - 1] = NULL_INDEX;
+		m_free_head = 0;
+		m_num_live = 0;
+	}
+
+	/**
+	 * calls func(T&) on every live object, in block order. The pool is
+	 * locked throughout, so func must not create() or destroy().
+	 *
+	 * @param func: the callable to run on each object
+	 */
+	template<typename Func>
+	void forEach(Func func)
+	{
+		LockT lock(m_mut);
+
+		forEachLiveIndex([this, &func](std::uint32_t index)
+		{
+			func(*reinterpret_cast<T*>(getBlock(index)));
+		});
+	}
+
+private:
+	typedef std::mutex MutexT;
+	typedef std::unique_lock<MutexT> LockT;
+
+	static constexpr std::uint32_t NULL_INDEX = 0xFFFFFFFF;
+	static constexpr std::size_t NUM_LIVE_WORDS = (Capacity + 63) / 64;
+
+	inline void* getBlock(std::uint32_t index)
+	{
+		return m_storage + (index * sizeof(T));
+	}
+
+	inline std::uint32_t getIndex(T* obj)
+	{
+		uintptr_t raw_obj = reinterpret_cast<uintptr_t>(obj);
+		uintptr_t raw_storage = reinterpret_cast<uintptr_t>(m_storage);
+		S_ASSERT(raw_obj >= raw_storage && raw_obj < raw_storage + sizeof(m_storage),
+			"object isn't from this pool");
+		S_ASSERT(((raw_obj - raw_storage) % sizeof(T)) == 0, "not the start of a block");
+
+		return static_cast<std::uint32_t>((raw_obj - raw_storage) / sizeof(T));
+	}
+
+	inline bool isLive(std::uint32_t index)
+	{
+		return (m_live[index / 64] >> (index % 64)) & 1;
+	}
+
+	inline void pushFree(std::uint32_t index)
+	{
+		m_next_free[index] = m_free_head;
+		m_free_head = index;
+	}
+
+	//skips whole empty words, so sparse pools iterate quickly
+	template<typename Func>
+	void forEachLiveIndex(Func func)
+	{
+		for (std::size_t word = 0; word < NUM_LIVE_WORDS; word++)
+		{
+			std::uint64_t bits = m_live[word];
+			for (std::uint32_t bit = 0; bits != 0; bit++, bits >>= 1)
+			{
+				if (bits & 1)
+					func(static_cast<std::uint32_t>((word * 64) + bit));
+			}
+		}
+	}
+
+	alignas(ALIGNMENT) unsigned char m_storage[Capacity * sizeof(T)];
+	std::uint32_t m_next_free[Capacity];
+	std::uint64_t m_live[NUM_LIVE_WORDS];
+	std::uint32_t m_free_head;
+	std::size_t m_num_live;
+	MutexT m_mut;
+};
+
+} //namespace sentinel
+
+#endif //OBJECT_POOL_H
@@ -0,0 +1,118 @@
+#include "SmallObjectAllocator.h"
+
+namespace sentinel
+{
+
+const std::size_t SmallObjectAllocator::s_class_sizes[NUM_SIZE_CLASSES] = {
+	16, 32, 48, 64, 80, 96, 112, 128,
+	160, 192, 224, 256, 320, 384, 448, 512
+};
+
+/**
+ * ctor
+ *
+ * @param (optional) slab_capacity: items per slab in each size class pool
+ *        (default is 256)
+ */
+SmallObjectAllocator::SmallObjectAllocator(std::size_t slab_capacity) :
+	m_pools(reinterpret_cast<MemoryPool*>(m_pool_storage))
+{
+	for (std::size_t i = 0; i < NUM_SIZE_CLASSES; i++)
+		new(&m_pools[i]) MemoryPool(s_class_sizes[i], slab_capacity, true);
+}
+
+/**
+ * dtor
+ */
+SmallObjectAllocator::~SmallObjectAllocator()
+{
+	for (std::size_t i = 0; i < NUM_SIZE_CLASSES; i++)
+		m_pools[i].~MemoryPool();
+}
+
+/**
+ * allocates from the smallest size class that fits, or
+ * from the system heap for big requests.
+ *
+ * @param size_bytes: bytes to allocate
+ * @returns void* to the block (nullptr if out of memory)
+ */
+void* SmallObjectAllocator::alloc(std::size_t size_bytes)
+{
+	if (size_bytes > MAX_SMALL_SIZE)
+		return malloc(size_bytes);
+
+	return m_pools[getSizeToClassTable()[tableIndex(size_bytes)]].alloc();
+}
+
+/**
+ * frees a block from alloc()
+ *
+ * @param p: the block to free
+ * @param size_bytes: the size it was allocated with
+ */
+void SmallObjectAllocator::freeBlock(void* p, std::size_t size_bytes)
+{
+	if (!p)
+		return;
+
+	if (size_bytes > MAX_SMALL_SIZE)
+	{
+		free(p);
+		return;
+	}
+
+	m_pools[getSizeToClassTable()[tableIndex(size_bytes)]].freeBlock(p);
+}
+
+/**
+ * @returns how many bytes a request of size_bytes actually uses
+ *          (size_bytes itself for system heap sized requests)
+ */
+std::size_t SmallObjectAllocator::getSizeClassSize(std::size_t size_bytes)
+{
+	if (size_bytes > MAX_SMALL_SIZE)
+		return size_bytes;
+
+	return s_class_sizes[getSizeToClassTable()[tableIndex(size_bytes)]];
+}
+
+/**
+ * the process wide instance behind the global new hook. It is
+ * built in static storage and never destroyed, so static dtors
+ * running at exit can still free into it.
+ */
+SmallObjectAllocator& SmallObjectAllocator::getGlobal()
+{
+	alignas(SmallObjectAllocator) static unsigned char s_storage[sizeof(SmallObjectAllocator)];
+	static SmallObjectAllocator* s_global = new(s_storage) SmallObjectAllocator();
+	return *s_global;
+}
+
+/**
+ * maps (size_bytes + 15) / 16 to a size class index,
+ * built once on first use.
+ */
+const std::uint8_t* SmallObjectAllocator::getSizeToClassTable()
+{
+	struct SizeToClassTable
+	{
+		std::uint8_t m_classes[(MAX_SMALL_SIZE / CLASS_GRANULARITY) + 1];
+
+		SizeToClassTable()
+		{
+			std::size_t size_class = 0;
+			for (std::size_t i = 0; i <= MAX_SMALL_SIZE / CLASS_GRANULARITY; i++)
+			{
+				while (s_class_sizes[size_class] < i * CLASS_GRANULARITY)
+					size_class++;
+				m_classes[i] = static_cast<std::uint8_t>(size_class);
+			}
+		}
+	};
+
+	static const SizeToClassTable s_table;
+	return s_table.m_classes;
+}
+
+} //namespace sentinel
@@ -0,0 +1,64 @@
+#ifndef SMALL_OBJECT_ALLOCATOR_H
+#define SMALL_OBJECT_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include "MemoryPool.h"
+#include "SentinelAssert.h"
+#include "SentinelConfig.h"
+
+namespace sentinel
+{
+
+/**
+ * A segregated-fit allocator for variable sized small objects. Requests
+ * up to MAX_SMALL_SIZE bytes are rounded up to one of a handful of size
+ * classes, each backed by its own growable MemoryPool; the class is found
+ * with a single lookup in a precomputed size-to-class table. Anything
+ * bigger goes to the system heap.
+ *
+ * Every size class is a multiple of 16 bytes, so every block is aligned
+ * for any fundamental type. Frees are sized: pass the same size you
+ * allocated with.
+ *
+ * Building with SMALL_OBJECT_NEW_ENABLED also routes the global
+ * operator new/delete through getGlobal().
+ */
+class SmallObjectAllocator
+{
+public:
+	static constexpr std::size_t MAX_SMALL_SIZE = 512;
+	static constexpr std::size_t NUM_SIZE_CLASSES = 16;
+
+	SmallObjectAllocator(std::size_t slab_capacity=256);
+	SmallObjectAllocator(const SmallObjectAllocator& other)              = delete;
+	SmallObjectAllocator& operator = (const SmallObjectAllocator& other) = delete;
+	~SmallObjectAllocator();
+
+	void* alloc(std::size_t size_bytes);
+	void freeBlock(void* p, std::size_t size_bytes);
+
+	static std::size_t getSizeClassSize(std::size_t size_bytes);
+	static SmallObjectAllocator& getGlobal();
+
+private:
+	static constexpr std::size_t CLASS_GRANULARITY = 16;
+
+	static inline std::size_t tableIndex(std::size_t size_bytes)
+	{
+		return (size_bytes + CLASS_GRANULARITY - 1) / CLASS_GRANULARITY;
+	}
+
+	//pools are constructed in place so building this never calls new
+	alignas(MemoryPool) unsigned char m_pool_storage[NUM_SIZE_CLASSES * sizeof(MemoryPool)];
+	MemoryPool* m_pools;
+
+	static const std::size_t s_class_sizes[NUM_SIZE_CLASSES];
+	static const std::uint8_t* getSizeToClassTable();
+};
+
+} //namespace sentinel
+
+#endif //SMALL_OBJECT_ALLOCATOR_H
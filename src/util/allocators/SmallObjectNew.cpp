@@ -0,0 +1,98 @@
+#include "SmallObjectAllocator.h"
+
+#ifdef SMALL_OBJECT_NEW_ENABLED
+
+/**
+ * Opt-in replacement of the global operator new/delete with the
+ * SmallObjectAllocator. Unsized delete has to find the size class, so
+ * every block carries a 16-byte header holding its size (16 bytes
+ * keeps the returned memory aligned like the default operator new).
+ *
+ * Over-aligned new/delete (std::align_val_t) are left to the default.
+ */
+
+namespace
+{
+
+const std::size_t HEADER_SIZE = 16;
+
+void* smallObjectNew(std::size_t size_bytes)
+{
+	std::size_t total_size = size_bytes + HEADER_SIZE;
+	void* raw = sentinel::SmallObjectAllocator::getGlobal().alloc(total_size);
+	if (!raw)
+		return nullptr;
+
+	*reinterpret_cast<std::size_t*>(raw) = total_size;
+	return reinterpret_cast<unsigned char*>(raw) + HEADER_SIZE;
+}
+
+void smallObjectDelete(void* p)
+{
+	if (!p)
+		return;
+
+	void* raw = reinterpret_cast<unsigned char*>(p) - HEADER_SIZE;
+	std::size_t total_size = *reinterpret_cast<std::size_t*>(raw);
+	sentinel::SmallObjectAllocator::getGlobal().freeBlock(raw, total_size);
+}
+
+} //namespace
+
+void* operator new(std::size_t size_bytes)
+{
+	void* p = smallObjectNew(size_bytes);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](std::size_t size_bytes)
+{
+	void* p = smallObjectNew(size_bytes);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(std::size_t size_bytes, const std::nothrow_t&) noexcept
+{
+	return smallObjectNew(size_bytes);
+}
+
+void* operator new[](std::size_t size_bytes, const std::nothrow_t&) noexcept
+{
+	return smallObjectNew(size_bytes);
+}
+
+void operator delete(void* p) noexcept
+{
+	smallObjectDelete(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	smallObjectDelete(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+	smallObjectDelete(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+	smallObjectDelete(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+	smallObjectDelete(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+	smallObjectDelete(p);
+}
+
+#endif //SMALL_OBJECT_NEW_ENABLED
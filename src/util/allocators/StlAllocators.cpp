@@ -0,0 +1,86 @@
+#include "StlAllocators.h"
+
+namespace sentinel
+{
+
+//blocks at the start of a pool (or slab) are at least this aligned
+static const std::size_t POOL_BASE_ALIGNMENT = 16;
+
+/**
+ * @param pool: the pool
+ * @param size_bytes: size of the block wanted
+ * @param alignment: alignment of the block wanted
+ * @returns true if every block in the pool satisfies both
+ */
+bool poolFits(MemoryPool& pool, std::size_t size_bytes, std::size_t alignment)
+{
+	std::size_t item_size = pool.getItemSize();
+	return size_bytes <= item_size &&
+		alignment <= POOL_BASE_ALIGNMENT &&
+		(item_size % alignment) == 0;
+}
+
+void* StackMemoryResource::do_allocate(std::size_t size_bytes, std::size_t alignment)
+{
+	void* p = m_stack.allocAligned(size_bytes, alignment);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+//memory comes back with the stack's freeTo() or clear()
+void StackMemoryResource::do_deallocate(void* /*p*/, std::size_t /*size_bytes*/,
+	std::size_t /*alignment*/)
+{
+}
+
+bool StackMemoryResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+	return this == &other;
+}
+
+void* FrameMemoryResource::do_allocate(std::size_t size_bytes, std::size_t alignment)
+{
+	void* p = m_frame.allocAligned(size_bytes, alignment);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+//memory comes back with the frame allocator's clearCurrentBuffer()
+void FrameMemoryResource::do_deallocate(void* /*p*/, std::size_t /*size_bytes*/,
+	std::size_t /*alignment*/)
+{
+}
+
+bool FrameMemoryResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+	return this == &other;
+}
+
+void* PoolMemoryResource::do_allocate(std::size_t size_bytes, std::size_t alignment)
+{
+	if (!poolFits(m_pool, size_bytes, alignment))
+		return m_upstream->allocate(size_bytes, alignment);
+
+	void* p = m_pool.alloc();
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void PoolMemoryResource::do_deallocate(void* p, std::size_t size_bytes,
+	std::size_t alignment)
+{
+	if (!poolFits(m_pool, size_bytes, alignment))
+		m_upstream->deallocate(p, size_bytes, alignment);
+	else
+		m_pool.freeBlock(p);
+}
+
+bool PoolMemoryResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+	return this == &other;
+}
+
+} //namespace sentinel
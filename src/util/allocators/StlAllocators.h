@@ -0,0 +1,199 @@
+#ifndef STL_ALLOCATORS_H
+#define STL_ALLOCATORS_H
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+
+#include "DbFrameAllocator.h"
+#include "MemoryPool.h"
+#include "MemoryStack.h"
+#include "SentinelAssert.h"
+
+namespace sentinel
+{
+
+/*
+ * Standard allocators (and std::pmr::memory_resources) over the engine
+ * allocators, so containers can live in engine memory:
+ *
+ * StackAllocator: bumps a MemoryStack, deallocate is a no-op. Memory comes
+ * back with the stack's freeTo() or clear().
+ * FrameAllocator: bumps the current DbFrameAllocator buffer, deallocate is
+ * a no-op. Memory comes back wholesale with clearCurrentBuffer(), so the
+ * container must not outlive its frame.
+ * PoolAllocator: single objects (container nodes) that fit the pool's
+ * item size come from a MemoryPool, everything else from operator new.
+ *
+ * A full stack or pool throws std::bad_alloc like any other allocator.
+ */
+
+//true if the pool can hold a block of size_bytes aligned to alignment
+bool poolFits(MemoryPool& pool, std::size_t size_bytes, std::size_t alignment);
+
+template<typename T>
+class StackAllocator
+{
+public:
+	typedef T value_type;
+
+	StackAllocator(MemoryStack& stack) noexcept : m_stack(&stack) {}
+	template<typename U>
+	StackAllocator(const StackAllocator<U>& other) noexcept : m_stack(other.m_stack) {}
+
+	T* allocate(std::size_t n)
+	{
+		void* p = m_stack->allocAligned(n * sizeof(T), alignof(T));
+		if (!p)
+			throw std::bad_alloc();
+		return static_cast<T*>(p);
+	}
+
+	void deallocate(T* /*p*/, std::size_t /*n*/) noexcept {}
+
+	template<typename U>
+	bool operator == (const StackAllocator<U>& other) const noexcept
+	{
+		return m_stack == other.m_stack;
+	}
+	template<typename U>
+	bool operator != (const StackAllocator<U>& other) const noexcept
+	{
+		return m_stack != other.m_stack;
+	}
+
+private:
+	template<typename U> friend class StackAllocator;
+
+	MemoryStack* m_stack;
+};
+
+template<typename T>
+class FrameAllocator
+{
+public:
+	typedef T value_type;
+
+	FrameAllocator(DbFrameAllocator& frame) noexcept : m_frame(&frame) {}
+	template<typename U>
+	FrameAllocator(const FrameAllocator<U>& other) noexcept : m_frame(other.m_frame) {}
+
+	T* allocate(std::size_t n)
+	{
+		void* p = m_frame->allocAligned(n * sizeof(T), alignof(T));
+		if (!p)
+			throw std::bad_alloc();
+		return static_cast<T*>(p);
+	}
+
+	void deallocate(T* /*p*/, std::size_t /*n*/) noexcept {}
+
+	template<typename U>
+	bool operator == (const FrameAllocator<U>& other) const noexcept
+	{
+		return m_frame == other.m_frame;
+	}
+	template<typename U>
+	bool operator != (const FrameAllocator<U>& other) const noexcept
+	{
+		return m_frame != other.m_frame;
+	}
+
+private:
+	template<typename U> friend class FrameAllocator;
+
+	DbFrameAllocator* m_frame;
+};
+
+template<typename T>
+class PoolAllocator
+{
+public:
+	typedef T value_type;
+
+	PoolAllocator(MemoryPool& pool) noexcept : m_pool(&pool) {}
+	template<typename U>
+	PoolAllocator(const PoolAllocator<U>& other) noexcept : m_pool(other.m_pool) {}
+
+	T* allocate(std::size_t n)
+	{
+		if (n != 1 || !poolFits(*m_pool, sizeof(T), alignof(T)))
+			return static_cast<T*>(::operator new(n * sizeof(T)));
+
+		void* p = m_pool->alloc();
+		if (!p)
+			throw std::bad_alloc();
+		return static_cast<T*>(p);
+	}
+
+	void deallocate(T* p, std::size_t n) noexcept
+	{
+		//same test as allocate, so blocks always go back where they came from
+		if (n != 1 || !poolFits(*m_pool, sizeof(T), alignof(T)))
+			::operator delete(p);
+		else
+			m_pool->freeBlock(p);
+	}
+
+	template<typename U>
+	bool operator == (const PoolAllocator<U>& other) const noexcept
+	{
+		return m_pool == other.m_pool;
+	}
+	template<typename U>
+	bool operator != (const PoolAllocator<U>& other) const noexcept
+	{
+		return m_pool != other.m_pool;
+	}
+
+private:
+	template<typename U> friend class PoolAllocator;
+
+	MemoryPool* m_pool;
+};
+
+class StackMemoryResource : public std::pmr::memory_resource
+{
+public:
+	StackMemoryResource(MemoryStack& stack) : m_stack(stack) {}
+
+private:
+	void* do_allocate(std::size_t size_bytes, std::size_t alignment) override;
+	void do_deallocate(void* p, std::size_t size_bytes, std::size_t alignment) override;
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+	MemoryStack& m_stack;
+};
+
+class FrameMemoryResource : public std::pmr::memory_resource
+{
+public:
+	FrameMemoryResource(DbFrameAllocator& frame) : m_frame(frame) {}
+
+private:
+	void* do_allocate(std::size_t size_bytes, std::size_t alignment) override;
+	void do_deallocate(void* p, std::size_t size_bytes, std::size_t alignment) override;
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+	DbFrameAllocator& m_frame;
+};
+
+class PoolMemoryResource : public std::pmr::memory_resource
+{
+public:
+	PoolMemoryResource(MemoryPool& pool,
+		std::pmr::memory_resource* upstream=std::pmr::new_delete_resource()) :
+		m_pool(pool), m_upstream(upstream) {}
+
+private:
+	void* do_allocate(std::size_t size_bytes, std::size_t alignment) override;
+	void do_deallocate(void* p, std::size_t size_bytes, std::size_t alignment) override;
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+	MemoryPool& m_pool;
+	std::pmr::memory_resource* m_upstream; //for blocks that don't fit the pool
+};
+
+} //namespace sentinel
+
+#endif //STL_ALLOCATORS_H
@@ -1,50 +1,520 @@
 #include "StringId.h"
 
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "VirtualStack.h"
+
 namespace sentinel
 {
 
+static const std::size_t NUM_SHARDS = 16; //pwr of 2
+static const std::size_t SHARD_SHIFT = 60; //top 4 bits of a sid pick the shard
+static const std::size_t INITIAL_TABLE_CAPACITY = 256; //pwr of 2
+static const std::size_t ARENA_RESERVE_SIZE = 256 * 1024 * 1024; //address space only, committed as it fills
+
+/*
+ * string table image layout, native (little) endian:
+ *   ImageHeader
+ *   ImageSlot[m_capacity]  open addressing table, same probing as InternTable
+ *   char[m_chars_size]     the strings, each null terminated
+ * a slot's location is (offset into the chars << 32 | length)
+ */
+static const char IMAGE_MAGIC[4] = { 'S', 'S', 'T', 'R' };
+static const std::uint32_t IMAGE_VERSION = 1;
+
+struct ImageHeader
+{
+	char m_magic[4];
+	std::uint32_t m_version;
+	std::uint64_t m_count;
+	std::uint64_t m_capacity; //pwr of 2
+	std::uint64_t m_chars_size;
+};
+
+struct ImageSlot
+{
+	std::uint64_t m_key;
+	std::uint64_t m_location;
+};
+
+/*
+ * an open addressing table, linear probing, 0 is an empty key. A slot's
+ * location is (arena offset << 32 | length), stored before its key is
+ * published, so a reader that sees the key always sees the location.
+ */
+struct StringId::InternTable
+{
+	struct Slot
+	{
+		std::atomic<StrId> m_key;
+		std::atomic<std::uint64_t> m_location;
+	};
+
+	explicit InternTable(std::size_t capacity) :
+		m_mask(capacity - 1),
+		m_slots(new Slot[capacity]()),
+		m_retired(nullptr)
+	{
+	}
+
+	std::size_t m_mask;
+	Slot* m_slots;
+	InternTable* m_retired; //the table this one replaced
+};
+
+/*
+ * readers only ever load m_table, inserts take m_mut. Growing publishes
+ * a new table and keeps the old one alive, readers may still be probing
+ * it. Nothing is freed, interned strings live as long as the program.
+ */
+struct StringId::InternShard
+{
+	std::atomic<InternTable*> m_table;
+	std::size_t m_count;
+	std::mutex m_mut;
+};
+
+//a mapped image, read only and never unmapped
+struct StringId::StringImage
+{
+	const ImageSlot* m_slots;
+	std::uint64_t m_mask;
+	const char* m_chars;
+};
+
+struct StringId::InternState
+{
+	InternState() :
+		m_arena(ARENA_RESERVE_SIZE),
+		m_arena_base(static_cast<const char*>(m_arena.getStackPtr()))
+	{
+		for (std::size_t i = 0; i < NUM_SHARDS; i++)
+		{
+			m_shards[i].m_table.store(new InternTable(INITIAL_TABLE_CAPACITY), std::memory_order_relaxed);
+			m_shards[i].m_count = 0;
+		}
+		m_image.store(nullptr, std::memory_order_relaxed);
+	}
+
+	InternShard m_shards[NUM_SHARDS];
+	std::atomic<const StringImage*> m_image;
+	VirtualStack m_arena; //append only, so offsets into it never move
+	const char* m_arena_base;
+};
+
 /**
  * interns a string into the global table.
  * does nothing but if the string is already interned
- * 
+ *
  * @param str: the string to intern
  * @return StrId of the string
  */
 StrId StringId::internStr(const std::string& str)
 {
-	static std::hash<std::string> s_hash;
+	return insert(xxHash64Fast(str.data(), str.size()), str.data(), str.size());
+}
+
+StrId StringId::internStr(std::string_view str)
+{
+	return insert(xxHash64Fast(str.data(), str.size()), str.data(), str.size());
+}
+
+/**
+ * interns a c string, only copying it the first time
+ *
+ * @param str: the null terminated string to intern
+ * @return StrId of the string
+ */
+StrId StringId::internStr(const char* str)
+{
+	std::size_t len = std::char_traits<char>::length(str);
+	return insert(xxHash64Fast(str, len), str, len);
+}
 
-	//insert if not already interned
-	StrId str_id = s_hash(str);
-	if (getSidMap().count(str_id) == 0)
-		getSidMap().emplace(str_id, std::string(str));
+/**
+ * registers a literal already hashed at compile time,
+ * used by INTERN_LITERAL
+ *
+ * @param sid: SID(str)
+ * @param str: the literal
+ * @return sid
+ */
+StrId StringId::internLiteral(StrId sid, const char* str)
+{
+	std::size_t len = std::char_traits<char>::length(str);
+	S_ASSERT(sid == xxHash64Fast(str, len), "sid isn't the hash of the literal");
 
-	return str_id;
+	return insert(sid, str, len);
 }
 
 /**
  * returns the string value that was interned
- * by a string id.
+ * by a string id. Lock free, safe alongside inserts.
  *
  * @param sid: the sid to use as the key
- * @returns a const std::string& to the original std::string
+ * @returns a view of the interned chars, null terminated
  */
-const std::string& StringId::getStr(StrId sid)
+std::string_view StringId::getStr(StrId sid)
 {
-	S_ASSERT(getSidMap().count(sid) > 0,
-		"you need to intern strings before retrieving them");
+	std::string_view str;
+	bool found = tryGetStr(sid, str);
+	S_ASSERT(found, "you need to intern strings before retrieving them");
+	(void)found; //only checked with assertions on
 
-	return getSidMap()[sid];
+	return str;
 }
 
 /**
- * avoid static initialization issues, returns
- * a function static map& to use for static inits
- * or otherwise.
+ * getStr() for ids that may not be interned
+ *
+ * @param sid: the sid to look up
+ * @param str: set to the interned string if found
+ * @returns if sid is interned
  */
-std::map<StrId, std::string>& StringId::getSidMap() {
-	static std::map<StrId, std::string> s_sid_map;
-	return s_sid_map;
+bool StringId::tryGetStr(StrId sid, std::string_view& str)
+{
+	if (findInImage(sid, str))
+		return true;
+
+	std::uint64_t location;
+	if (!find(getShard(sid).m_table.load(std::memory_order_acquire), sid, location))
+		return false;
+
+	str = getArenaStr(location);
+	return true;
+}
+
+/**
+ * Writes a string table image for loadImage(). Duplicate
+ * strings are only stored once.
+ *
+ * @param path: the file to write
+ * @param strings: the strings to put in the image
+ * @returns if the image was written
+ */
+bool StringId::writeImage(const std::string& path, const std::vector<std::string_view>& strings)
+{
+	std::size_t capacity = 16;
+	while (capacity < strings.size() * 2) //same 1/2 max load factor as the runtime tables
+		capacity *= 2;
+
+	std::vector<ImageSlot> slots(capacity, ImageSlot{ 0, 0 });
+	std::vector<char> chars;
+	std::uint64_t count = 0;
+	std::uint64_t mask = capacity - 1;
+
+	for (std::string_view str : strings)
+	{
+		StrId sid = xxHash64Fast(str.data(), str.size());
+		S_ASSERT(sid != 0, "string hashes to the empty key");
+
+		std::size_t i = sid & mask;
+		while (slots[i].m_key != 0 && slots[i].m_key != sid)
+			i = (i + 1) & mask;
+
+		if (slots[i].m_key == sid)
+		{
+			S_ASSERT(std::string_view(chars.data() + (slots[i].m_location >> 32),
+				slots[i].m_location & 0xFFFFFFFF) == str, "StrId collision, two strings have the same hash");
+			continue;
+		}
+
+		S_ASSERT(chars.size() + str.size() < 0xFFFFFFFF, "image strings must fit in 4GB");
+		slots[i].m_key = sid;
+		slots[i].m_location = (static_cast<std::uint64_t>(chars.size()) << 32) | str.size();
+		chars.insert(chars.end(), str.begin(), str.end());
+		chars.push_back('\0');
+		count++;
+	}
+
+	ImageHeader header;
+	std::memcpy(header.m_magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+	header.m_version = IMAGE_VERSION;
+	header.m_count = count;
+	header.m_capacity = capacity;
+	header.m_chars_size = chars.size();
+
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(slots.data(), sizeof(ImageSlot), slots.size(), file) == slots.size() &&
+		fwrite(chars.data(), 1, chars.size(), file) == chars.size();
+
+	return (fclose(file) == 0) && written;
+}
+
+/**
+ * Maps a string table image read only and serves its strings from then
+ * on. Only one image can be loaded, do it at boot.
+ *
+ * @param path: an image from writeImage()
+ * @returns if the image was valid and loaded
+ */
+bool StringId::loadImage(const std::string& path)
+{
+	InternState& state = getState();
+	S_ASSERT(state.m_image.load(std::memory_order_acquire) == nullptr, "a string table image is already loaded");
+	if (state.m_image.load(std::memory_order_acquire))
+		return false;
+
+	const char* data = nullptr;
+	std::size_t size = 0;
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER file_size;
+	HANDLE mapping = NULL;
+	if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file); //the mapping keeps the file open
+	if (!mapping)
+		return false;
+
+	data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	CloseHandle(mapping);
+	size = static_cast<std::size_t>(file_size.QuadPart);
+	if (!data)
+		return false;
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat file_stat;
+	void* mapped = MAP_FAILED;
+	if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0)
+	{
+		size = static_cast<std::size_t>(file_stat.st_size);
+		mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd); //the mapping keeps the file open
+	if (mapped == MAP_FAILED)
+		return false;
+
+	data = static_cast<const char*>(mapped);
+#endif
+
+	//validate before trusting any offsets in it
+	const ImageHeader* header = reinterpret_cast<const ImageHeader*>(data);
+	bool valid = size >= sizeof(ImageHeader) &&
+		std::memcmp(header->m_magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) == 0 &&
+		header->m_version == IMAGE_VERSION &&
+		header->m_capacity >= 1 && (header->m_capacity & (header->m_capacity - 1)) == 0 &&
+		header->m_count < header->m_capacity &&
+		header->m_capacity <= (size - sizeof(ImageHeader)) / sizeof(ImageSlot) &&
+		header->m_chars_size == size - sizeof(ImageHeader) - header->m_capacity * sizeof(ImageSlot);
+
+	//every string has to lie in the chars, and probes need an empty slot to stop at
+	if (valid)
+	{
+		const ImageSlot* slots = reinterpret_cast<const ImageSlot*>(data + sizeof(ImageHeader));
+		std::uint64_t num_empty = 0;
+		for (std::uint64_t i = 0; i < header->m_capacity && valid; i++)
+		{
+			if (slots[i].m_key == 0)
+			{
+				num_empty++;
+				continue;
+			}
+			std::uint64_t offset = slots[i].m_location >> 32;
+			std::uint64_t length = slots[i].m_location & 0xFFFFFFFF;
+			valid = offset <= header->m_chars_size && length <= header->m_chars_size - offset;
+		}
+		valid = valid && num_empty > 0;
+	}
+
+	if (!valid)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+#else
+		munmap(const_cast<char*>(data), size);
+#endif
+		return false;
+	}
+
+	StringImage* image = new StringImage();
+	image->m_slots = reinterpret_cast<const ImageSlot*>(data + sizeof(ImageHeader));
+	image->m_mask = header->m_capacity - 1;
+	image->m_chars = data + sizeof(ImageHeader) + header->m_capacity * sizeof(ImageSlot);
+
+	state.m_image.store(image, std::memory_order_release);
+	return true;
+}
+
+/**
+ * @param location: set to the string's location if found
+ * @returns if sid is in the table
+ */
+bool StringId::find(const InternTable* table, StrId sid, std::uint64_t& location)
+{
+	for (std::size_t i = sid & table->m_mask; ; i = (i + 1) & table->m_mask)
+	{
+		StrId key = table->m_slots[i].m_key.load(std::memory_order_acquire);
+		if (key == sid)
+		{
+			location = table->m_slots[i].m_location.load(std::memory_order_relaxed);
+			return true;
+		}
+		if (key == 0)
+			return false;
+	}
+}
+
+/**
+ * @param str: set to the string if found
+ * @returns if sid is in the loaded image (false if there's no image)
+ */
+bool StringId::findInImage(StrId sid, std::string_view& str)
+{
+	const StringImage* image = getState().m_image.load(std::memory_order_acquire);
+	if (!image)
+		return false;
+
+	for (std::uint64_t i = sid & image->m_mask; ; i = (i + 1) & image->m_mask)
+	{
+		const ImageSlot& slot = image->m_slots[i];
+		if (slot.m_key == sid)
+		{
+			str = std::string_view(image->m_chars + (slot.m_location >> 32),
+				static_cast<std::size_t>(slot.m_location & 0xFFFFFFFF));
+			return true;
+		}
+		if (slot.m_key == 0)
+			return false;
+	}
+}
+
+std::string_view StringId::getArenaStr(std::uint64_t location)
+{
+	return std::string_view(getState().m_arena_base + (location >> 32),
+		static_cast<std::size_t>(location & 0xFFFFFFFF));
+}
+
+/**
+ * puts a location in the first empty slot on sid's probe path,
+ * caller holds the shard's lock
+ */
+void StringId::place(InternTable* table, StrId sid, std::uint64_t location)
+{
+	std::size_t i = sid & table->m_mask;
+	while (table->m_slots[i].m_key.load(std::memory_order_relaxed) != 0)
+		i = (i + 1) & table->m_mask;
+
+	table->m_slots[i].m_location.store(location, std::memory_order_relaxed);
+	table->m_slots[i].m_key.store(sid, std::memory_order_release);
+}
+
+/**
+ * interns str under sid if it isn't already. The lookup is lock free,
+ * only a string seen for the first time takes its shard's lock.
+ *
+ * @returns sid
+ */
+StrId StringId::insert(StrId sid, const char* str, std::size_t len)
+{
+	S_ASSERT(sid != 0, "string hashes to the empty key");
+
+	std::string_view interned;
+	if (findInImage(sid, interned))
+	{
+		checkCollision(interned, str, len);
+		return sid;
+	}
+
+	InternShard& shard = getShard(sid);
+	std::uint64_t location;
+	if (find(shard.m_table.load(std::memory_order_acquire), sid, location))
+	{
+		checkCollision(getArenaStr(location), str, len);
+		return sid;
+	}
+
+	std::lock_guard<std::mutex> lock(shard.m_mut);
+
+	InternTable* table = shard.m_table.load(std::memory_order_relaxed);
+	if (find(table, sid, location))
+	{
+		checkCollision(getArenaStr(location), str, len); //lost the race to another thread
+		return sid;
+	}
+
+	InternState& state = getState();
+	char* chars = static_cast<char*>(state.m_arena.alloc(len + 1));
+	S_ASSERT(chars != nullptr, "string arena is full");
+	if (!chars)
+		return sid;
+
+	std::memcpy(chars, str, len);
+	chars[len] = '\0';
+	location = (static_cast<std::uint64_t>(chars - state.m_arena_base) << 32) | len;
+
+	//keep the load factor under 1/2 so probes stay short
+	if ((shard.m_count + 1) * 2 > table->m_mask + 1)
+	{
+		InternTable* grown = new InternTable((table->m_mask + 1) * 2);
+		for (std::size_t i = 0; i <= table->m_mask; i++)
+		{
+			StrId key = table->m_slots[i].m_key.load(std::memory_order_relaxed);
+			if (key != 0)
+				place(grown, key, table->m_slots[i].m_location.load(std::memory_order_relaxed));
+		}
+		grown->m_retired = table;
+		shard.m_table.store(grown, std::memory_order_release);
+		table = grown;
+	}
+
+	place(table, sid, location);
+	shard.m_count++;
+
+	return sid;
+}
+
+/**
+ * asserts the string already interned under str's StrId is str, two
+ * strings with the same StrId would otherwise silently share one entry.
+ * Compiled out without assertions.
+ */
+#ifdef ASSERTIONS_ENABLED
+void StringId::checkCollision(std::string_view interned, const char* str, std::size_t len)
+{
+	S_ASSERT(interned == std::string_view(str, len), "StrId collision, two strings have the same hash");
+}
+#else
+void StringId::checkCollision(std::string_view /*interned*/, const char* /*str*/, std::size_t /*len*/)
+{
+}
+#endif
+
+/**
+ * avoid static initialization issues, the state is made
+ * on first use and never destroyed so it outlives other statics.
+ */
+StringId::InternState& StringId::getState() {
+	static InternState* s_state = new InternState();
+	return *s_state;
+}
+
+StringId::InternShard& StringId::getShard(StrId sid)
+{
+	return getState().m_shards[sid >> SHARD_SHIFT];
 }
 
 } //namespace sentinel
@@ -1,25 +1,89 @@
 #ifndef STRING_ID_H
 #define STRING_ID_H
 
-#include <functional>
 #include <string>
+#include <string_view>
 #include <cstddef>
-#include <map>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
 
 #include "SentinelAssert.h"
+#include "XxHash.h"
 
 namespace sentinel
 {
-	typedef std::size_t StrId;
+	typedef std::uint64_t StrId;
 
+/**
+ * XXH64 with seed 0, constexpr so literals can be hashed at compile time.
+ * The hash is fixed by the xxHash spec, so a StrId is the same in every
+ * build and run and can be stored in files in place of its string.
+ *
+ * @param str: the chars to hash
+ * @param len: number of chars
+ * @returns the StrId of the string
+ */
+constexpr StrId hashStr(const char* str, std::size_t len)
+{
+	return xxHash64(str, len);
+}
+
+constexpr StrId hashStr(const char* str)
+{
+	std::size_t len = 0;
+	while (str[len] != '\0')
+		len++;
+	return hashStr(str, len);
+}
+
+/**
+ * The global string intern table, safe to use from any thread. It is
+ * split into shards by the top bits of the StrId, each an open addressing
+ * table; STR() and repeat interns never lock, only the first intern of
+ * a string takes its shard's lock.
+ *
+ * The characters of every interned string are appended to one arena,
+ * null terminated, and the tables just map a StrId to an (offset, length)
+ * in it. Views from STR() stay valid for the life of the program.
+ *
+ * With assertions enabled, interning a string whose StrId is already
+ * taken by a different string asserts instead of silently aliasing them.
+ *
+ * A string table image, made ahead of time with writeImage() (see the
+ * StringTableBuilder tool), can be mapped read only at boot with
+ * loadImage(). Its strings are served straight from the mapping without
+ * being hashed or copied, and strings it doesn't have are interned at
+ * runtime as usual.
+ */
 class StringId
 {
 public:
 	static StrId internStr(const std::string& str);
-	static const std::string& getStr(StrId sid);
+	static StrId internStr(std::string_view str);
+	static StrId internStr(const char* str);
+	static StrId internLiteral(StrId sid, const char* str);
+	static std::string_view getStr(StrId sid);
+	static bool tryGetStr(StrId sid, std::string_view& str);
+
+	static bool writeImage(const std::string& path, const std::vector<std::string_view>& strings);
+	static bool loadImage(const std::string& path);
 private:
+	struct InternTable;
+	struct InternShard;
+	struct InternState;
+	struct StringImage;
+
+	static bool find(const InternTable* table, StrId sid, std::uint64_t& location);
+	static bool findInImage(StrId sid, std::string_view& str);
+	static std::string_view getArenaStr(std::uint64_t location);
+	static void place(InternTable* table, StrId sid, std::uint64_t location);
+	static StrId insert(StrId sid, const char* str, std::size_t len);
+	static void checkCollision(std::string_view interned, const char* str, std::size_t len);
+
 	/*function to avoid static initialization issues*/
-	static std::map<StrId, std::string>& getSidMap();
+	static InternState& getState();
+	static InternShard& getShard(StrId sid);
 };
 
 }
@@ -27,4 +91,16 @@ private:
 #define INTERN_STR(str) sentinel::StringId::internStr(str)
 #define STR(sid) sentinel::StringId::getStr(sid)
 
+//the StrId of a string literal as a compile time constant, so it works
+//in switch cases and template args. Nothing is interned, STR() can't find it.
+#define SID(str) (std::integral_constant<sentinel::StrId, sentinel::hashStr(str)>::value)
+
+//SID() that also registers the literal for STR() when assertions are on,
+//release builds pay nothing for it
+#ifdef ASSERTIONS_ENABLED
+#define INTERN_LITERAL(str) sentinel::StringId::internLiteral(SID(str), str)
+#else
+#define INTERN_LITERAL(str) SID(str)
+#endif
+
 #endif // STRING_ID_H
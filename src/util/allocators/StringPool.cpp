@@ -0,0 +1,171 @@
+#include "StringPool.h"
+
+#include <cstring>
+
+namespace sentinel
+{
+
+/**
+ * ctor
+ *
+ * @param (optional) name: shows up in allocator stats
+ * @param (optional) chunk_size: bytes of string storage allocated at a
+ *        time, longer strings get a chunk of their own
+ */
+StringPool::StringPool(const char* name, std::size_t chunk_size) :
+	m_name(name),
+	m_chunk_size(chunk_size),
+	m_chunk_used(0),
+	m_last_chunk_size(0),
+	m_used_bytes(0),
+	m_reserved_bytes(0)
+{
+	ALLOC_STATS(m_stats.setName(name);)
+}
+
+StringPool::~StringPool()
+{
+	clear();
+}
+
+/**
+ * interns a string into the pool, unless it is already
+ * interned globally
+ *
+ * @param str: the string to intern
+ * @returns StrId of the string, the same one INTERN_STR() would give
+ */
+StrId StringPool::intern(std::string_view str)
+{
+	StrId sid = xxHash64Fast(str.data(), str.size());
+
+	std::string_view interned;
+	if (StringId::tryGetStr(sid, interned))
+	{
+		S_ASSERT(interned == str, "StrId collision, two strings have the same hash");
+		return sid;
+	}
+
+	{
+		SharedLockT lock(m_mut);
+		auto it = m_strings.find(sid);
+		if (it != m_strings.end())
+		{
+			S_ASSERT(it->second == str, "StrId collision, two strings have the same hash");
+			return sid;
+		}
+	}
+
+	LockT lock(m_mut);
+	if (m_strings.count(sid) > 0)
+		return sid; //lost the race to another thread
+
+	char* chars = allocChars(str.size() + 1);
+	std::memcpy(chars, str.data(), str.size());
+	chars[str.size()] = '\0';
+
+	m_strings.emplace(sid, std::string_view(chars, str.size()));
+	m_used_bytes += str.size() + 1;
+
+	return sid;
+}
+
+/**
+ * @param sid: a StrId from intern() or INTERN_STR()
+ * @returns a view of the string, null terminated, valid until clear()
+ *          (an empty view if the pool doesn't have it)
+ */
+std::string_view StringPool::getStr(StrId sid)
+{
+	std::string_view str;
+	if (StringId::tryGetStr(sid, str))
+		return str;
+
+	SharedLockT lock(m_mut);
+	auto it = m_strings.find(sid);
+	S_ASSERT(it != m_strings.end(), "you need to intern strings before retrieving them");
+
+	return it != m_strings.end() ? it->second : std::string_view();
+}
+
+/**
+ * @returns if the pool itself holds sid (globally interned ids aren't counted)
+ */
+bool StringPool::contains(StrId sid)
+{
+	SharedLockT lock(m_mut);
+	return m_strings.count(sid) > 0;
+}
+
+/**
+ * releases every string in the pool at once, any views
+ * or ids from it are dangling after this
+ */
+void StringPool::clear()
+{
+	LockT lock(m_mut);
+
+	ALLOC_STATS(
+		if (m_reserved_bytes > 0)
+			m_stats.recordFree(m_reserved_bytes);
+	)
+
+	m_strings.clear();
+	m_chunks.clear();
+	m_chunk_used = 0;
+	m_last_chunk_size = 0;
+	m_used_bytes = 0;
+	m_reserved_bytes = 0;
+}
+
+std::size_t StringPool::getNumStrings()
+{
+	SharedLockT lock(m_mut);
+	return m_strings.size();
+}
+
+/**
+ * @returns bytes of strings held, terminators included
+ */
+std::size_t StringPool::getUsedBytes()
+{
+	SharedLockT lock(m_mut);
+	return m_used_bytes;
+}
+
+/**
+ * @returns bytes of chunks allocated for strings
+ */
+std::size_t StringPool::getReservedBytes()
+{
+	SharedLockT lock(m_mut);
+	return m_reserved_bytes;
+}
+
+const char* StringPool::getName()
+{
+	return m_name;
+}
+
+/**
+ * bumps size_bytes from the last chunk, starting a new
+ * one if it doesn't fit. Caller holds m_mut exclusively.
+ */
+char* StringPool::allocChars(std::size_t size_bytes)
+{
+	if (m_chunks.empty() || m_chunk_used + size_bytes > m_last_chunk_size)
+	{
+		std::size_t chunk_size = (size_bytes > m_chunk_size) ? size_bytes : m_chunk_size;
+		m_chunks.emplace_back(new char[chunk_size]);
+		m_last_chunk_size = chunk_size;
+		m_chunk_used = 0;
+		m_reserved_bytes += chunk_size;
+		ALLOC_STATS(m_stats.recordAlloc(chunk_size);)
+	}
+
+	char* chars = m_chunks.back().get() + m_chunk_used;
+	m_chunk_used += size_bytes;
+	return chars;
+}
+
+} //namespace sentinel
@@ -0,0 +1,77 @@
+#ifndef STRING_POOL_H
+#define STRING_POOL_H
+
+#include <cstddef>
+#include <memory>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "AllocatorStats.h"
+#include "SentinelAssert.h"
+#include "StringId.h"
+
+namespace sentinel
+{
+
+/**
+ * A scoped intern pool for dynamic strings (player names, asset paths,
+ * anything per level) that shouldn't live in the global StringId table
+ * forever. Strings are copied into the pool's own chunks and released
+ * together by clear() or the destructor, so memory is bounded by the
+ * pool's scope.
+ *
+ * Ids are the same StrIds the global table uses. A string that is already
+ * interned globally (literals, image strings) isn't copied, its id is just
+ * returned, so permanent ids cost a pool nothing. getStr() finds both.
+ *
+ * Lookups take a shared lock, only new strings and clear() take it
+ * exclusively.
+ */
+class StringPool
+{
+public:
+	StringPool(const char* name="StringPool", std::size_t chunk_size=(16 * 1024));
+	StringPool(const StringPool& other)              = delete;
+	StringPool& operator = (const StringPool& other) = delete;
+	~StringPool();
+
+	StrId intern(std::string_view str);
+	std::string_view getStr(StrId sid);
+	bool contains(StrId sid);
+
+	void clear();
+
+	std::size_t getNumStrings();
+	std::size_t getUsedBytes();
+	std::size_t getReservedBytes();
+
+	const char* getName();
+	ALLOC_STATS(AllocatorStats& getStats() { return m_stats; })
+
+private:
+	char* allocChars(std::size_t size_bytes);
+
+	const char* m_name;
+	std::size_t m_chunk_size;
+
+	std::unordered_map<StrId, std::string_view> m_strings;
+	std::vector<std::unique_ptr<char[]>> m_chunks;
+	std::size_t m_chunk_used; //bytes used in the last chunk
+	std::size_t m_last_chunk_size;
+	std::size_t m_used_bytes;
+	std::size_t m_reserved_bytes;
+
+	typedef std::shared_mutex MutexT;
+	typedef std::shared_lock<MutexT> SharedLockT;
+	typedef std::unique_lock<MutexT> LockT;
+
+	MutexT m_mut;
+
+	ALLOC_STATS(AllocatorStats m_stats;)
+};
+
+} //namespace sentinel
+
+#endif //STRING_POOL_H
@@ -0,0 +1,342 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include "SentinelConfig.h"
+
+#ifdef COROUTINES_ENABLED
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "SentinelAssert.h"
+#include "SmallObjectAllocator.h"
+
+namespace sentinel
+{
+
+template <typename T>
+class Task;
+
+/**
+ * Coroutine frames come from the global SmallObjectAllocator (which
+ * hands anything too big for it to the system heap), so short lived
+ * async steps don't each cost a trip to malloc.
+ */
+struct TaskFrameAllocation
+{
+	static void* operator new(std::size_t size_bytes)
+	{
+		void* frame = SmallObjectAllocator::getGlobal().alloc(size_bytes);
+		if (!frame)
+			throw std::bad_alloc();
+		return frame;
+	}
+
+	static void operator delete(void* frame, std::size_t size_bytes)
+	{
+		SmallObjectAllocator::getGlobal().freeBlock(frame, size_bytes);
+	}
+};
+
+/**
+ * What every Task's promise shares: tasks start suspended, and on
+ * finishing transfer straight to whoever co_awaited them.
+ */
+class TaskPromiseBase : public TaskFrameAllocation
+{
+public:
+	struct FinalAwaiter
+	{
+		bool await_ready() noexcept { return false; }
+
+		template <typename PromiseT>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<PromiseT> handle) noexcept
+		{
+			std::coroutine_handle<> continuation = handle.promise().m_continuation;
+			return continuation ? continuation : std::noop_coroutine();
+		}
+
+		void await_resume() noexcept {}
+	};
+
+	std::suspend_always initial_suspend() noexcept { return {}; }
+	FinalAwaiter final_suspend() noexcept { return {}; }
+	void unhandled_exception() { m_exception = std::current_exception(); }
+
+	std::coroutine_handle<> m_continuation;
+	std::exception_ptr m_exception;
+};
+
+template <typename T>
+class TaskPromise : public TaskPromiseBase
+{
+public:
+	Task<T> get_return_object();
+
+	template <typename U>
+	void return_value(U&& value) { m_value.emplace(std::forward<U>(value)); }
+
+	std::optional<T> m_value;
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase
+{
+public:
+	Task<void> get_return_object();
+	void return_void() {}
+};
+
+/**
+ * A lazily started coroutine producing a T (or nothing, for void).
+ * Nothing runs until the task is co_awaited (or handed to syncWait()
+ * or whenAll()), the awaiting coroutine then carries on with the
+ * result as soon as the task finishes, on whatever thread finished it.
+ * An exception thrown in the task is rethrown from the co_await.
+ *
+ * To get off the calling thread, a task co_awaits ThreadPool::schedule()
+ * (or IoManager::read()/write()) and carries on on a pool worker.
+ *
+ * Owns its coroutine frame, so it must outlive the work it stands for.
+ */
+template <typename T>
+class Task
+{
+public:
+	typedef TaskPromise<T> promise_type;
+	typedef std::coroutine_handle<promise_type> HandleT;
+
+	//starts the task, and resumes the awaiting coroutine once it's done
+	class Awaiter
+	{
+	public:
+		explicit Awaiter(HandleT handle) : m_handle(handle) {}
+
+		bool await_ready() noexcept { return !m_handle || m_handle.done(); }
+
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+		{
+			m_handle.promise().m_continuation = awaiting;
+			return m_handle;
+		}
+
+	protected:
+		HandleT m_handle;
+	};
+
+	class ResultAwaiter : public Awaiter
+	{
+	public:
+		using Awaiter::Awaiter;
+		T await_resume() { return getResult(this->m_handle); }
+	};
+
+	class ReadyAwaiter : public Awaiter
+	{
+	public:
+		using Awaiter::Awaiter;
+		void await_resume() noexcept {}
+	};
+
+	explicit Task(HandleT handle) : m_handle(handle) {}
+	Task(const Task& other)              = delete;
+	Task& operator = (const Task& other) = delete;
+
+	Task(Task&& other) noexcept :
+		m_handle(std::exchange(other.m_handle, nullptr))
+	{
+	}
+
+	Task& operator = (Task&& other) noexcept
+	{
+		if (this != &other)
+		{
+			if (m_handle)
+				m_handle.destroy();
+			m_handle = std::exchange(other.m_handle, nullptr);
+		}
+		return *this;
+	}
+
+	~Task()
+	{
+		if (m_handle)
+			m_handle.destroy();
+	}
+
+	ResultAwaiter operator co_await() noexcept { return ResultAwaiter(m_handle); }
+
+	//co_await for the task to finish without taking its result
+	ReadyAwaiter whenReady() noexcept { return ReadyAwaiter(m_handle); }
+
+	bool isDone() { return m_handle && m_handle.done(); }
+
+	/**
+	 * @returns the finished task's result (moved out), or
+	 *          rethrows what it threw
+	 */
+	T getResult() { return getResult(m_handle); }
+
+private:
+	static T getResult(HandleT handle)
+	{
+		S_ASSERT(handle && handle.done(), "task isn't done yet");
+		if (handle.promise().m_exception)
+			std::rethrow_exception(handle.promise().m_exception);
+		if constexpr (!std::is_void<T>::value)
+			return std::move(*handle.promise().m_value);
+	}
+
+	HandleT m_handle;
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object()
+{
+	return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object()
+{
+	return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+/**
+ * A coroutine nobody awaits: it starts straight away and frees its own
+ * frame when it finishes. Only for starting tasks from plain code.
+ */
+class DetachedTask
+{
+public:
+	struct promise_type : public TaskFrameAllocation
+	{
+		DetachedTask get_return_object() noexcept { return DetachedTask(); }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept { std::terminate(); }
+	};
+};
+
+/**
+ * starts a task and calls on_done once it's finished
+ *
+ * @param task: the task to start, must outlive it
+ * @param on_done: called (on whatever thread finished the task) with no args
+ */
+template <typename T, typename FuncT>
+DetachedTask startTask(Task<T>& task, FuncT on_done)
+{
+	co_await task.whenReady();
+	on_done();
+}
+
+/**
+ * runs a task to completion, blocking the calling thread
+ * until it's done. For plain code at the edge of async code.
+ *
+ * @param task: the task to run
+ * @returns the task's result
+ */
+template <typename T>
+T syncWait(Task<T>&& task)
+{
+	std::mutex mut;
+	std::condition_variable cond;
+	bool done = false;
+
+	startTask(task, [&mut, &cond, &done]()
+	{
+		//notify under the lock, we're gone the moment it's released
+		std::unique_lock<std::mutex> lock(mut);
+		done = true;
+		cond.notify_all();
+	});
+
+	std::unique_lock<std::mutex> lock(mut);
+	cond.wait(lock, [&done]() { return done; });
+	lock.unlock();
+
+	return task.getResult();
+}
+
+/**
+ * what whenAll() suspends on, resumes it when the last task finishes
+ */
+class WhenAllCounter
+{
+public:
+	explicit WhenAllCounter(std::size_t num_tasks) :
+		m_count(num_tasks + 1) //+1 for the awaiting coroutine itself
+	{
+	}
+
+	void taskDone()
+	{
+		if (m_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			m_awaiting.resume();
+	}
+
+	bool await_ready() noexcept { return false; }
+
+	bool await_suspend(std::coroutine_handle<> awaiting) noexcept
+	{
+		m_awaiting = awaiting;
+		return m_count.fetch_sub(1, std::memory_order_acq_rel) > 1; //all done already, don't suspend
+	}
+
+	void await_resume() noexcept {}
+
+private:
+	std::atomic<std::size_t> m_count;
+	std::coroutine_handle<> m_awaiting;
+};
+
+/**
+ * starts every task at once and finishes when they all have. Tasks
+ * that co_await ThreadPool::schedule() first run in parallel.
+ *
+ * @param tasks: the tasks to run
+ * @returns their results in the same order (T only has to be
+ *          movable), rethrows the first exception in that order
+ */
+template <typename T>
+Task<std::vector<T>> whenAll(std::vector<Task<T>> tasks)
+{
+	WhenAllCounter counter(tasks.size());
+	for (Task<T>& task : tasks)
+		startTask(task, [&counter]() { counter.taskDone(); });
+	co_await counter;
+
+	std::vector<T> results;
+	results.reserve(tasks.size());
+	for (Task<T>& task : tasks)
+		results.push_back(task.getResult());
+	co_return results;
+}
+
+inline Task<void> whenAll(std::vector<Task<void>> tasks)
+{
+	WhenAllCounter counter(tasks.size());
+	for (Task<void>& task : tasks)
+		startTask(task, [&counter]() { counter.taskDone(); });
+	co_await counter;
+
+	for (Task<void>& task : tasks)
+		task.getResult();
+}
+
+} //namespace sentinel
+
+#endif //COROUTINES_ENABLED
+
+#endif //TASK_H
@@ -0,0 +1,59 @@
+#ifndef THREAD_LOCAL_LOOKUP_H
+#define THREAD_LOCAL_LOOKUP_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace sentinel
+{
+
+/**
+ * A tiny direct-mapped cache, one per thread, mapping an allocator's
+ * owner id to that allocator's per-thread state (a T*). Looking
+ * something up only touches thread local memory, so there are no locks
+ * or atomics on the fast path. A miss just means the owner has to go
+ * look the state up the slow way and store() it again.
+ *
+ * Owner ids come from nextOwnerId() and are never reused, so entries
+ * left over from a destroyed owner can never match a live one.
+ */
+template<typename T, std::size_t N = 8>
+class ThreadLocalLookup
+{
+public:
+	static inline T* find(std::uint64_t owner_id)
+	{
+		Entry& entry = s_entries[owner_id % N];
+		return (entry.owner_id == owner_id) ? entry.value : nullptr;
+	}
+
+	static inline void store(std::uint64_t owner_id, T* value)
+	{
+		Entry& entry = s_entries[owner_id % N];
+		entry.owner_id = owner_id;
+		entry.value = value;
+	}
+
+	static inline std::uint64_t nextOwnerId()
+	{
+		static std::atomic<std::uint64_t> s_next_owner_id(1); //0 is "no owner"
+		return s_next_owner_id.fetch_add(1, std::memory_order_relaxed);
+	}
+
+private:
+	struct Entry
+	{
+		std::uint64_t owner_id;
+		T* value;
+	};
+
+	static thread_local Entry s_entries[N];
+};
+
+template<typename T, std::size_t N>
+thread_local typename ThreadLocalLookup<T, N>::Entry ThreadLocalLookup<T, N>::s_entries[N];
+
+} //namespace sentinel
+
+#endif //THREAD_LOCAL_LOOKUP_H
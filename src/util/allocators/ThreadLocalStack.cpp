@@ -0,0 +1,302 @@
+#include "ThreadLocalStack.h"
+
+namespace sentinel
+{
+
+//slices are kept to whole cache lines
+static const std::size_t SLICE_ALIGNMENT = 64;
+
+static std::size_t roundUpSliceSize(std::size_t size_bytes)
+{
+	return (size_bytes + SLICE_ALIGNMENT - 1) & ~(SLICE_ALIGNMENT - 1);
+}
+
+/**
+ * ctor
+ *
+ * @param slice_size_bytes: bytes each thread gets (rounded up to a cache line)
+ * @param max_threads: how many live threads at once get a slice,
+ *        others get nullptr
+ */
+ThreadLocalStack::ThreadLocalStack(std::size_t slice_size_bytes, std::size_t max_threads) :
+	m_backing((roundUpSliceSize(slice_size_bytes) * max_threads) + SLICE_ALIGNMENT),
+	m_slice_size(roundUpSliceSize(slice_size_bytes)),
+	m_slices(max_threads),
+	m_id(ThreadLocalLookup<Slice>::nextOwnerId())
+{
+	uintptr_t base = reinterpret_cast<uintptr_t>(
+		m_backing.allocAligned(m_slice_size * max_threads, SLICE_ALIGNMENT));
+	S_ASSERT(base != 0);
+
+	for (std::size_t i = 0; i < m_slices.size(); i++)
+	{
+		m_slices[i].m_bottom = base + (i * m_slice_size);
+		m_slices[i].m_top = m_slices[i].m_bottom + m_slice_size;
+		m_slices[i].m_marker = m_slices[i].m_bottom;
+	}
+}
+
+ThreadLocalStack::ThreadLocalStack(ThreadLocalStack&& other) :
+	m_backing(std::move(other.m_backing))
+{
+	LockT arg_lock(other.m_mut);
+
+	//slices live on the heap, so per-thread caches stay valid under m_id
+	m_slice_size = other.m_slice_size;
+	m_slices = std::move(other.m_slices);
+	m_thread_slices = std::move(other.m_thread_slices);
+	m_id = other.m_id;
+
+	other.m_slice_size = 0;
+	other.m_slices.clear();
+	other.m_thread_slices.clear();
+	other.m_id = ThreadLocalLookup<Slice>::nextOwnerId();
+}
+
+ThreadLocalStack& ThreadLocalStack::operator = (ThreadLocalStack&& other)
+{
+	if (this != &other)
+	{
+		LockT lhs_lock(m_mut, std::defer_lock);
+		LockT rhs_lock(other.m_mut, std::defer_lock);
+		std::lock(lhs_lock, rhs_lock);
+
+		m_backing = std::move(other.m_backing);
+		m_slice_size = other.m_slice_size;
+		m_slices = std::move(other.m_slices);
+		m_thread_slices = std::move(other.m_thread_slices);
+		m_id = other.m_id;
+
+		other.m_slice_size = 0;
+		other.m_slices.clear();
+		other.m_thread_slices.clear();
+		other.m_id = ThreadLocalLookup<Slice>::nextOwnerId();
+	}
+
+	return *(this);
+}
+
+ThreadLocalStack::~ThreadLocalStack()
+{
+	//do nothing! m_backing owns the memory
+}
+
+std::size_t ThreadLocalStack::getSliceSize()
+{
+	return m_slice_size;
+}
+
+std::size_t ThreadLocalStack::getMaxThreads()
+{
+	return m_slices.size();
+}
+
+/**
+ * @returns bytes in use across every thread's slice. Like
+ * clearAll(), only exact when no thread is allocating.
+ */
+std::size_t ThreadLocalStack::getUsedBytes()
+{
+	std::size_t used = 0;
+	for (Slice& slice : m_slices)
+		used += slice.m_marker - slice.m_bottom;
+	return used;
+}
+
+/**
+ * gets a marker to the top of the calling thread's slice
+ * (nullptr if this thread couldn't get a slice)
+ */
+void* ThreadLocalStack::getStackPtr()
+{
+	Slice* slice = getSlice();
+	if (!slice)
+		return nullptr;
+
+	return reinterpret_cast<void*>(slice->m_marker);
+}
+
+/**
+ * Reserves space in the calling thread's slice. Lock free,
+ * but returns nullptr if the slice is full.
+ *
+ * @param size_bytes: bytes to reserve
+ * @return a pointer to the reserved data (or nullptr on full slice)
+ */
+void* ThreadLocalStack::alloc(std::size_t size_bytes)
+{
+	Slice* slice = getSlice();
+	if (!slice)
+		return nullptr;
+
+	uintptr_t new_marker = slice->m_marker + size_bytes;
+	if (new_marker > slice->m_top)
+		return nullptr;
+
+	void* mark = reinterpret_cast<void*>(slice->m_marker);
+	slice->m_marker = new_marker;
+	return mark;
+}
+
+/**
+ * Allocates an aligned block in the calling thread's slice.
+ * Same adjustment byte trick as MemoryStack::allocAligned.
+ *
+ * @param size_bytes: size of allocated block in bytes
+ * @param alignment: alignment in bytes
+ */
+void* ThreadLocalStack::allocAligned(std::size_t size_bytes, std::size_t alignment)
+{
+	S_ASSERT(alignment >= 1);
+	S_ASSERT(alignment <= 128);
+	S_ASSERT((alignment & (alignment - 1)) == 0); //pwr of 2
+
+	void* raw_ptr = alloc(size_bytes + alignment);
+	if (!raw_ptr)
+		return nullptr;
+
+	uintptr_t raw_address = reinterpret_cast<uintptr_t>(raw_ptr);
+	std::size_t mask = (alignment - 1);
+	uintptr_t misalignment = (raw_address & mask);
+	std::ptrdiff_t adjustment = alignment - misalignment;
+
+	uintptr_t aligned_address = raw_address + adjustment;
+
+	//write the adjustment to the preceding byte
+	S_ASSERT(adjustment < 256);
+	uint8_t* adjustment_ptr = reinterpret_cast<uint8_t*>(aligned_address - 1);
+	*adjustment_ptr = static_cast<uint8_t>(adjustment);
+
+	return reinterpret_cast<void*>(aligned_address);
+}
+
+/**
+ * Rolls the calling thread's marker back
+ *
+ * @param marker: a marker gotten from this thread's getStackPtr()
+ */
+void ThreadLocalStack::freeTo(void* marker)
+{
+	Slice* slice = getSlice();
+	if (!slice)
+	{
+		S_ASSERT(marker == nullptr, "marker isn't from this thread's slice");
+		return; //no slice, so all this thread ever got was nullptr
+	}
+	S_ASSERT(reinterpret_cast<uintptr_t>(marker) <= slice->m_marker);
+	S_ASSERT(reinterpret_cast<uintptr_t>(marker) >= slice->m_bottom);
+
+	slice->m_marker = reinterpret_cast<uintptr_t>(marker);
+}
+
+/**
+ * Rolls the calling thread's marker back to
+ * just before an aligned allocation
+ *
+ * @param marker: a ptr returned by this thread's allocAligned()
+ */
+void ThreadLocalStack::freeToAligned(void* marker)
+{
+	uintptr_t raw_marker = reinterpret_cast<uintptr_t>(marker);
+	uint8_t adjustment = *(reinterpret_cast<uint8_t*>(raw_marker - 1));
+
+	freeTo(reinterpret_cast<void*>(raw_marker - adjustment));
+}
+
+/**
+ * Rolls the calling thread's marker back to the bottom of its slice
+ */
+void ThreadLocalStack::clear()
+{
+	Slice* slice = getSlice();
+	if (slice)
+		slice->m_marker = slice->m_bottom;
+}
+
+/**
+ * Rolls back every thread's slice at once. This is NOT synchronized
+ * with alloc(), so only call it when no other thread is allocating
+ * (e.g. at a frame boundary).
+ */
+void ThreadLocalStack::clearAll()
+{
+	for (Slice& slice : m_slices)
+		slice.m_marker = slice.m_bottom;
+}
+
+/**
+ * the fast path: a thread local cache hit, else registerThread()
+ */
+ThreadLocalStack::Slice* ThreadLocalStack::getSlice()
+{
+	Slice* slice = ThreadLocalLookup<Slice>::find(m_id);
+	if (slice)
+		return slice;
+
+	return registerThread();
+}
+
+/**
+ * the slow path: looks up (or hands out) the calling thread's
+ * slice, then caches it in thread local storage. Once every
+ * slice is taken, a new thread gets one whose thread has exited.
+ * Its marker is left alone, so whatever the old thread allocated
+ * this frame stays intact until the next clear.
+ *
+ * @returns the thread's Slice* (nullptr if every slice
+ *          belongs to a live thread)
+ */
+ThreadLocalStack::Slice* ThreadLocalStack::registerThread()
+{
+	LockT lock(m_mut);
+
+	std::thread::id this_id = std::this_thread::get_id();
+	auto iter = m_thread_slices.find(this_id);
+
+	std::size_t index;
+	if (iter != m_thread_slices.end())
+	{
+		//evicted from the cache, or an exited thread's id reused
+		index = iter->second.m_index;
+		iter->second.m_alive = getThreadToken();
+	}
+	else
+	{
+		index = m_slices.size();
+		if (m_thread_slices.size() < m_slices.size())
+		{
+			index = m_thread_slices.size();
+		}
+		else
+		{
+			for (iter = m_thread_slices.begin(); iter != m_thread_slices.end(); ++iter)
+			{
+				if (iter->second.m_alive.expired())
+				{
+					index = iter->second.m_index;
+					m_thread_slices.erase(iter);
+					break;
+				}
+			}
+		}
+
+		if (index == m_slices.size())
+			return nullptr;
+		m_thread_slices.emplace(this_id, ThreadSlice{index, getThreadToken()});
+	}
+
+	Slice* slice = &m_slices[index];
+	ThreadLocalLookup<Slice>::store(m_id, slice);
+	return slice;
+}
+
+/**
+ * @returns a token that expires when the calling thread exits
+ */
+std::weak_ptr<char> ThreadLocalStack::getThreadToken()
+{
+	static thread_local std::shared_ptr<char> s_token = std::make_shared<char>(0);
+	return s_token;
+}
+
+} //namespace sentinel
@@ -0,0 +1,92 @@
+#ifndef THREAD_LOCAL_STACK_H
+#define THREAD_LOCAL_STACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "MemoryStack.h"
+#include "SentinelAssert.h"
+#include "ThreadLocalLookup.h"
+
+namespace sentinel
+{
+
+/**
+ * A per-thread linear arena. One backing block is grabbed from a
+ * MemoryStack up front and cut into max_threads equal slices. The first
+ * time a thread allocates it is handed a slice, and from then on it just
+ * bumps its own marker: no locks and no atomics on the fast path.
+ *
+ * Every stack-like operation (alloc, getStackPtr, freeTo, clear) works
+ * on the calling thread's slice only. clearAll() resets every slice at
+ * once and is meant for frame boundaries, when no thread is allocating.
+ *
+ * A thread that shows up once every slice is taken gets nullptr from
+ * alloc(), so callers can fall back to something else. Slices of threads
+ * that have exited are handed to new threads, marker and all, so pools
+ * that come and go don't use slices up.
+ */
+class ThreadLocalStack
+{
+public:
+	ThreadLocalStack(std::size_t slice_size_bytes=65536, std::size_t max_threads=8);
+	ThreadLocalStack(const ThreadLocalStack& other)              = delete;
+	ThreadLocalStack& operator = (const ThreadLocalStack& other) = delete;
+	ThreadLocalStack(ThreadLocalStack&& other);
+	ThreadLocalStack& operator = (ThreadLocalStack&& other);
+	~ThreadLocalStack();
+
+	std::size_t getSliceSize();
+	std::size_t getMaxThreads();
+	std::size_t getUsedBytes();
+
+	void* getStackPtr();
+	void* alloc(std::size_t size_bytes);
+	void* allocAligned(std::size_t size_bytes, std::size_t alignment);
+
+	void freeTo(void* marker);
+	void freeToAligned(void* marker);
+	void clear();
+	void clearAll();
+
+private:
+	//own cache line so neighbouring threads don't false share markers
+	struct alignas(64) Slice
+	{
+		uintptr_t m_bottom;
+		uintptr_t m_top;
+		uintptr_t m_marker;
+	};
+
+	//a thread's slice, and whether that thread is still alive
+	struct ThreadSlice
+	{
+		std::size_t m_index;
+		std::weak_ptr<char> m_alive;
+	};
+
+	Slice* getSlice();
+	Slice* registerThread();
+	static std::weak_ptr<char> getThreadToken();
+
+	typedef std::mutex MutexT;
+	typedef std::unique_lock<MutexT> LockT;
+
+	MemoryStack m_backing;
+	std::size_t m_slice_size;
+	std::vector<Slice> m_slices;
+
+	//only touched on the slow path, when a thread first shows up
+	std::map<std::thread::id, ThreadSlice> m_thread_slices;
+	std::uint64_t m_id;
+	MutexT m_mut;
+};
+
+} //namespace sentinel
+
+#endif //THREAD_LOCAL_STACK_H
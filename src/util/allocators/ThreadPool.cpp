@@ -1,65 +1,91 @@
 #include "ThreadPool.h"
 
+#include <new>
+
 namespace sentinel
 {
 
-AsyncJobHandle NULL_JOB_HANDLE = 0; //no jobs have this id
+AsyncJobHandle NULL_JOB_HANDLE = NULL_POOL_HANDLE; //no jobs have this handle
+
+static const std::size_t INITIAL_LIVE_ASYNC_JOBS = 4096; //the handle pool grows past this
+static const std::size_t WORKER_DEQUE_CAPACITY = 256; //grows if a job spawns more
+static const std::size_t IDLE_SPIN_ROUNDS = 64; //find-work attempts before parking
+
+//a job's state word is (generation << 32 | flags | status)
+static const std::uint64_t STATE_STATUS_MASK = 0xFFFF;
+static const std::uint64_t STATE_HAS_DEPENDENTS = 1ull << 16;
+static const std::uint64_t STATE_HELD_BACK = 1ull << 17; //waiting on deps, not queued yet
+static const std::uint64_t STATE_FLAGS = STATE_HAS_DEPENDENTS | STATE_HELD_BACK;
+
+static const std::size_t NO_WORKER = static_cast<std::size_t>(-1); //findJob() from outside the pool
+
+//lets asyncDo() tell a job spawning a job apart from an outside thread
+static thread_local ThreadPool* s_worker_pool = nullptr;
+static thread_local std::size_t s_worker_index = 0;
 
-std::size_t ThreadPool::AsyncJob::s_next_id = 1;
+//the job running on this thread, the parent for asyncChild()
+static thread_local ThreadPool* s_current_job_pool = nullptr;
+static thread_local void* s_current_job = nullptr;
+
+#ifdef FIBERS_ENABLED
+//the pool fiber running on this thread (always a JobFiber)
+static thread_local Fiber* s_current_fiber = nullptr;
+#endif
+
+/**
+ * moves a job's status from one value to another, keeping its flags
+ *
+ * @param state: the job's state word
+ * @param from: packed state expected, without flags
+ * @param to: packed state to set, without flags
+ * @param (optional) blocking_flags: fail if any of these are set
+ * @returns true if the status was from and is now to
+ */
+static bool casStatus(std::atomic<std::uint64_t>& state, std::uint64_t from, std::uint64_t to,
+	std::uint64_t blocking_flags=0)
+{
+	std::uint64_t cur = state.load(std::memory_order_acquire);
+	while ((cur & ~STATE_FLAGS) == from && !(cur & blocking_flags))
+	{
+		if (state.compare_exchange_weak(cur, to | (cur & STATE_FLAGS), std::memory_order_acq_rel))
+			return true;
+	}
+	return false;
+}
 
 /**
  *ctor
  * on construction, spins up N
- * threads and creates a job queue
- * in the thread pool.
+ * workers, each with its own job deque.
  *
  * @param num_threads: threads to spin up
+ * @param (optional) use_fibers: run jobs on fibers, so waiting suspends
+ *        them instead of tying up a worker (needs FIBERS_ENABLED)
+ * @param (optional) fiber_stack_size: stack size for each fiber
  */
-ThreadPool::ThreadPool(std::size_t num_threads) :
-	m_async_workers(num_threads),
+ThreadPool::ThreadPool(std::size_t num_threads, bool use_fibers, std::size_t fiber_stack_size) :
+	m_injector_size(0),
 	m_handling_async(false),
-	m_async_job_pool(sizeof(AsyncJob))
+	m_num_queued(0),
+	m_num_parked(0),
+	m_live_async_jobs(sizeof(JobSlot), INITIAL_LIVE_ASYNC_JOBS, true),
+	m_num_waiters(0),
+	m_async_job_pool(sizeof(AsyncJob)), //grows under job bursts
+	m_use_fibers(use_fibers),
+	m_fiber_stack_size(fiber_stack_size)
 {
-	m_handling_async = true;
-
-	//each thread waits runs tasks for the queue
-	for (int i = 0; i < m_async_workers.size(); i++)
-	{
-		m_async_workers[i] = std::thread(
-			[this]() {
-
-			LockT q_lock(m_async_job_q_mut, std::defer_lock);
-			LockT live_jobs_lock(m_live_async_jobs_mut, std::defer_lock);
+#ifndef FIBERS_ENABLED
+	S_ASSERT(!use_fibers, "fibers aren't compiled in, turn on FIBERS_ENABLED");
+	m_use_fibers = false;
+#endif
 
-			while (m_handling_async)
-			{
-				//wait for a job to be available on the q
-				q_lock.lock();
-				m_async_job_q_cond.wait(q_lock, [this]() {
-					return (m_handling_async == false
-						|| m_async_job_q.empty() == false); });
+	//every deque exists before any worker starts stealing
+	for (std::size_t i = 0; i < num_threads; i++)
+		m_workers.emplace_back(new Worker(WORKER_DEQUE_CAPACITY));
 
-				if (!m_handling_async && m_async_job_q.empty())
-					return;
-
-				AsyncJob* job = m_async_job_q.front();
-				m_async_job_q.pop_front();
-				q_lock.unlock();
-
-				//handle the job and notify any wait calls on it
-				handleAsyncJob(*job);
-
-				live_jobs_lock.lock();
-				m_live_async_jobs.erase(job->m_id);
-				live_jobs_lock.unlock();
-				m_live_async_jobs_cond.notify_all();
-
-				job->~AsyncJob();
-				m_async_job_pool.freeBlock(job);
-			}
-
-		});
-	}
+	m_handling_async = true;
+	for (std::size_t i = 0; i < num_threads; i++)
+		m_workers[i]->m_thread = std::thread([this, i]() { workerLoop(i); });
 }
 
 /**
@@ -69,14 +95,17 @@ ThreadPool::ThreadPool(std::size_t num_threads) :
  */
 ThreadPool::~ThreadPool()
 {
-	m_handling_async = false; //signal threads to return
-	m_async_job_q_cond.notify_all();
+	m_handling_async = false; //signal threads to return once out of work
+
+	LockT park_lock(m_park_mut);
+	m_park_cond.notify_all();
+	park_lock.unlock();
 
 	//join all outstanding async workers
-	for (int i = 0; i < m_async_workers.size(); i++)
+	for (std::size_t i = 0; i < m_workers.size(); i++)
 	{
-		if (m_async_workers[i].joinable())
-			m_async_workers[i].join();
+		if (m_workers[i]->m_thread.joinable())
+			m_workers[i]->m_thread.join();
 	}
 }
 
@@ -85,34 +114,89 @@ ThreadPool::~ThreadPool()
  * of type std::function<void(void)>. This
  * works incredibly well with lambdas.
  *
+ * Called from inside a job, the new job goes on this worker's own
+ * deque, which is LIFO, so it runs next unless stolen. From any
+ * other thread it goes through the injector queue, to the front
+ * if immediate.
+ *
  * @param func: the function to enqueue
+ * @param (optional) immediate: jump the injector queue
  */
 AsyncJobHandle ThreadPool::asyncDo(std::function<void(void)> func, bool immediate)
 {
-	LockT q_lock(m_async_job_q_mut, std::defer_lock);
-	LockT live_jobs_lock(m_live_async_jobs_mut, std::defer_lock);
-	std::lock(q_lock, live_jobs_lock);
+	AsyncJob* async_job = createJob(std::move(func), nullptr);
+	AsyncJobHandle handle = async_job->m_handle; //the job may be gone once pushed
 
-	void* mem_ptr = m_async_job_pool.alloc();
-	AsyncJob* async_job;
+	pushJob(async_job, immediate);
+	return handle;
+}
 
-	async_job = new(mem_ptr) AsyncJob(func);
+/**
+ * queues up an async operation that only starts once every
+ * job in deps is done (run, cancelled or already stale), so
+ * a graph of jobs can be submitted up front without any
+ * thread blocking on the stages in between.
+ *
+ * @param deps: handles of the jobs to run after
+ * @param func: the function to enqueue
+ * @returns the new job's handle, usable as a dependency itself
+ */
+AsyncJobHandle ThreadPool::asyncAfter(const std::vector<AsyncJobHandle>& deps, std::function<void(void)> func)
+{
+	AsyncJob* async_job = createJob(std::move(func), nullptr);
+	AsyncJobHandle handle = async_job->m_handle;
+
+	//hold a count of our own, so deps finishing while we're
+	//still registering can't queue the job early. Held back,
+	//wait() can't run it inline either
+	getJobState(handle).fetch_or(STATE_HELD_BACK, std::memory_order_relaxed);
+	async_job->m_num_deps.store(1, std::memory_order_relaxed);
+	for (AsyncJobHandle dep : deps)
+	{
+		async_job->m_num_deps.fetch_add(1, std::memory_order_relaxed);
+		if (!addDependent(dep, async_job))
+			async_job->m_num_deps.fetch_sub(1, std::memory_order_relaxed); //already done
+	}
 
-	//immediate jobs expedited to front
-	if(!immediate)
-		m_async_job_q.push_back(async_job);
-	else
-		m_async_job_q.push_front(async_job);
+	if (async_job->m_num_deps.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		releaseHeldJob(async_job);
+	return handle;
+}
 
+/**
+ * queues up a continuation, run once a job is done
+ *
+ * @param handle: the job to continue from
+ * @param func: the function to enqueue
+ */
+AsyncJobHandle ThreadPool::then(AsyncJobHandle handle, std::function<void(void)> func)
+{
+	return asyncAfter({ handle }, std::move(func));
+}
 
-	m_live_async_jobs.emplace(async_job->m_id, async_job);
+/**
+ * queues up a child of the job calling this. The parent
+ * isn't done until its children are, so wait(), then()
+ * and asyncAfter() on the parent cover the children too.
+ * Called from outside a job, this is just asyncDo().
+ *
+ * @param func: the function to enqueue
+ */
+AsyncJobHandle ThreadPool::asyncChild(std::function<void(void)> func)
+{
+	AsyncJob* parent = nullptr;
+	if (s_current_job_pool == this)
+	{
+		//the parent is running on this thread, so it's still alive
+		parent = static_cast<AsyncJob*>(s_current_job);
+		parent->m_unfinished.fetch_add(1, std::memory_order_relaxed);
+	}
 
-	live_jobs_lock.unlock();
-	q_lock.unlock();
+	AsyncJob* async_job = createJob(std::move(func), parent);
+	AsyncJobHandle handle = async_job->m_handle;
 
-	//let the waiting threads know_job is available
-	m_async_job_q_cond.notify_one();
-	return (async_job->m_id);
+	pushJob(async_job, false);
+	return handle;
 }
 
 /**
@@ -127,59 +211,675 @@ AsyncJobHandle ThreadPool::asyncDo(std::function<void(void)> func, bool immediat
  */
 bool ThreadPool::cancelAsyncJob(AsyncJobHandle handle)
 {
-	//check if it's even alive
-	LockT live_jobs_lock(m_live_async_jobs_mut);
-	if (!m_live_async_jobs.count(handle))
+	if (!m_live_async_jobs.isValid(handle))
 		return false;
 
-	//set status to aborted
-	AsyncJob* job = m_live_async_jobs.at(handle);
-	LockT job_lock(job->m_mut);
-
-	bool success = true;
-
-	if (job->m_status == pending)
-		job->m_status = aborted;
-	else
-		success = false;
-
-	job_lock.unlock();
-	live_jobs_lock.unlock();
-
-	return success;
+	//the generation in the state means a slot reused by a newer job won't match
+	return casStatus(getJobState(handle),
+		packState(handle, pending), packState(handle, aborted));
 }
 
 /**
 * blocks until an async job specified finishes.
+* The caller helps rather than sleeps: if nobody has
+* started the job yet it runs it right here, otherwise
+* it runs other queued jobs (its own deque first, which
+* is where a job's children and deps usually are, then
+* the injector, then stealing) until the job is done.
+* So a job waiting on its children never ties up a
+* worker, and nested waits can't starve the pool.
+* Only once there's nothing to help with does it sleep,
+* until some job finishes. Any queued job may run on
+* the waiting thread, so don't wait while holding
+* something another job needs.
 *
 * @param handle: the async job handle
 */
 void ThreadPool::wait(AsyncJobHandle handle)
 {
-	LockT live_jobs_lock(m_live_async_jobs_mut);
-
-	if (!m_live_async_jobs.count(handle))
+	if (!m_live_async_jobs.isValid(handle))
 		return; //nothing to do here :)
 
-				//wait for the job
-	m_live_async_jobs_cond.wait(live_jobs_lock,
-		[this, &handle]() {return(m_live_async_jobs.count(handle) == 0); });
+#ifdef FIBERS_ENABLED
+	JobFiber* fiber = static_cast<JobFiber*>(s_current_fiber);
+	if (fiber && fiber->m_pool == this)
+	{
+		//on a fiber, suspend instead of helping, the worker
+		//gets on with other jobs until this one is done
+		while (m_live_async_jobs.isValid(handle))
+		{
+			if (tryRunInline(handle))
+				continue;
+
+			asyncAfter({ handle }, [fiber]() { resumeFiber(fiber); });
+			suspendCurrentFiber();
+		}
+		return;
+	}
+#endif
+
+	std::size_t index = (s_worker_pool == this) ? s_worker_index : NO_WORKER;
+	std::uint32_t rng_state = static_cast<std::uint32_t>(HandlePool::getIndex(handle)) * 0x9E3779B9u + 1;
+	std::size_t idle_rounds = 0;
+
+	while (m_live_async_jobs.isValid(handle))
+	{
+		if (tryRunInline(handle))
+			continue;
+
+		AsyncJob* job = findJob(index, rng_state);
+		if (job)
+		{
+			runJob(job);
+			idle_rounds = 0;
+			continue;
+		}
+
+		if (idle_rounds++ < IDLE_SPIN_ROUNDS)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		//nothing to help with, the job and anything it waits on are running
+		//elsewhere. Sleep until some job finishes, then look again.
+		//finishing jobs only take the mutex to notify if someone is waiting,
+		//the fence pairs with the one in finishJob() so one side always sees the other
+		m_num_waiters.fetch_add(1, std::memory_order_seq_cst);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		LockT live_jobs_lock(m_live_async_jobs_mut);
+		if (m_live_async_jobs.isValid(handle))
+			m_live_async_jobs_cond.wait(live_jobs_lock);
+		live_jobs_lock.unlock();
+
+		m_num_waiters.fetch_sub(1, std::memory_order_relaxed);
+		idle_rounds = 0;
+	}
+}
+
+std::size_t ThreadPool::getNumThreads()
+{
+	return m_workers.size();
+}
+
+/**
+ * A worker runs jobs until the pool is destroyed and no work is left.
+ * Out of work, it spins a little (new work usually arrives soon),
+ * then parks until a push wakes it.
+ *
+ * @param index: the worker's index in m_workers
+ */
+void ThreadPool::workerLoop(std::size_t index)
+{
+	s_worker_pool = this;
+	s_worker_index = index;
+	std::uint32_t rng_state = static_cast<std::uint32_t>(index) * 0x9E3779B9u + 1;
+	std::size_t idle_rounds = 0;
+
+	Worker& worker = *m_workers[index];
+
+	while (true)
+	{
+#ifdef FIBERS_ENABLED
+		//suspended fibers that can carry on go before new jobs
+		JobFiber* fiber = m_use_fibers ? takeReadyFiber(worker) : nullptr;
+		if (fiber)
+		{
+			worker.m_num_suspended--;
+			switchToFiber(worker, fiber);
+			idle_rounds = 0;
+			continue;
+		}
+#endif
+
+		AsyncJob* job = findJob(index, rng_state);
+		if (job)
+		{
+#ifdef FIBERS_ENABLED
+			if (m_use_fibers)
+				runOnFiber(index, job);
+			else
+#endif
+			runJob(job);
+			idle_rounds = 0;
+			continue;
+		}
+
+		//suspended fibers have to finish before the worker can
+		if (!m_handling_async && !hasFiberWork(worker))
+			break;
+
+		if (idle_rounds++ < IDLE_SPIN_ROUNDS)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		//park, pushes check m_num_parked after queueing so no wakeup is lost
+		LockT park_lock(m_park_mut);
+		m_num_parked.fetch_add(1, std::memory_order_seq_cst);
+		m_park_cond.wait(park_lock, [this, &worker]() {
+			return m_num_queued.load(std::memory_order_seq_cst) > 0
+				|| hasReadyFiber(worker)
+				|| (!m_handling_async && !hasFiberWork(worker)); });
+		m_num_parked.fetch_sub(1, std::memory_order_relaxed);
+		idle_rounds = 0;
+	}
+
+	//give back any job blocks cached by this worker
+	m_async_job_pool.flushThreadCache();
+	s_worker_pool = nullptr;
+}
+
+/**
+ * looks for work: own deque, then the injector, then a random victim
+ *
+ * @param index: the worker looking, NO_WORKER for threads outside the pool
+ * @param rng_state: the caller's victim picking state
+ * @returns a job to run (nullptr if none was found)
+ */
+ThreadPool::AsyncJob* ThreadPool::findJob(std::size_t index, std::uint32_t& rng_state)
+{
+	AsyncJob* job = nullptr;
+	if (index != NO_WORKER)
+		job = m_workers[index]->m_deque.pop();
+
+	if (!job && m_injector_size.load(std::memory_order_acquire) > 0)
+	{
+		LockT injector_lock(m_injector_mut);
+		if (!m_injector.empty())
+		{
+			job = m_injector.front();
+			m_injector.pop_front();
+			m_injector_size.store(m_injector.size(), std::memory_order_relaxed);
+		}
+	}
+
+	if (!job && !m_workers.empty() && (m_workers.size() > 1 || index == NO_WORKER))
+	{
+		//xorshift, just to spread thieves over victims
+		rng_state ^= rng_state << 13;
+		rng_state ^= rng_state >> 17;
+		rng_state ^= rng_state << 5;
+
+		std::size_t start = rng_state % m_workers.size();
+		for (std::size_t i = 0; i < m_workers.size() && !job; i++)
+		{
+			std::size_t victim = (start + i) % m_workers.size();
+			if (victim != index)
+				job = m_workers[victim]->m_deque.steal();
+		}
+	}
+
+	if (job)
+		m_num_queued.fetch_sub(1, std::memory_order_relaxed);
+	return job;
+}
+
+/**
+ * queues a job and wakes a parked worker if there is one
+ */
+void ThreadPool::pushJob(AsyncJob* job, bool immediate)
+{
+	if (s_worker_pool == this)
+	{
+		m_workers[s_worker_index]->m_deque.push(job);
+	}
+	else
+	{
+		//immediate jobs expedited to front
+		LockT injector_lock(m_injector_mut);
+		if (!immediate)
+			m_injector.push_back(job);
+		else
+			m_injector.push_front(job);
+		m_injector_size.store(m_injector.size(), std::memory_order_release);
+	}
+
+	m_num_queued.fetch_add(1, std::memory_order_seq_cst);
+	if (m_num_parked.load(std::memory_order_seq_cst) > 0)
+	{
+		LockT park_lock(m_park_mut);
+		m_park_cond.notify_one();
+	}
 }
 
 /**
- * A private callback to process jobs from the queue.
+ * runs a job taken off a queue, unless it was cancelled (it's
+ * then just finished) or a wait() already claimed it and runs
+ * it inline. Then drops the queue's reference to it.
  *
  * @param job: the AsyncJob to process
  */
-void ThreadPool::handleAsyncJob(AsyncJob& job)
+void ThreadPool::runJob(AsyncJob* job)
 {
-	//grab mutex to avoid race on job & use func
-	LockT job_lock(job.m_mut);
+	AsyncJobHandle handle = job->m_handle;
+	std::atomic<std::uint64_t>& state = getJobState(handle);
 
-	if (job.m_status == aborted)
+	//claim the job, fails if it was cancelled or claimed by a wait() first
+	if (casStatus(state, packState(handle, pending), packState(handle, running)))
+	{
+		executeJob(job);
+	}
+	else if ((state.load(std::memory_order_acquire) & ~STATE_FLAGS) == packState(handle, aborted))
+	{
+		finishJob(job); //cancelled, nobody else will finish it
+	}
+
+	releaseJob(job);
+}
+
+/**
+ * runs a claimed job's function as the current job, so it can
+ * spawn children, then finishes it
+ *
+ * @param job: the AsyncJob to run, already in the running state
+ */
+void ThreadPool::executeJob(AsyncJob* job)
+{
+	ThreadPool* prev_pool = s_current_job_pool;
+	void* prev_job = s_current_job;
+	s_current_job_pool = this;
+	s_current_job = job;
+
+	job->m_func();
+
+	s_current_job_pool = prev_pool;
+	s_current_job = prev_job;
+
+	finishJob(job);
+}
+
+/**
+ * claims a job nobody has started yet and runs it on this thread.
+ * Its copy in a queue stays there, and runJob() skips it once taken.
+ *
+ * @param handle: the job to run
+ * @returns true if it was run here
+ */
+bool ThreadPool::tryRunInline(AsyncJobHandle handle)
+{
+	//held back jobs still have deps to run first
+	if (!casStatus(getJobState(handle),
+		packState(handle, pending), packState(handle, running), STATE_HELD_BACK))
+	{
+		return false;
+	}
+
+	//claimed, so the slot is still this job's and it holds a reference until finished
+	AsyncJob* job = reinterpret_cast<JobSlot*>(m_live_async_jobs.get(handle))->m_job;
+	executeJob(job);
+	return true;
+}
+
+/**
+ * clears a job's held back flag once its deps are done, and queues it
+ *
+ * @param job: the AsyncJob with no deps left
+ */
+void ThreadPool::releaseHeldJob(AsyncJob* job)
+{
+	getJobState(job->m_handle).fetch_and(~STATE_HELD_BACK, std::memory_order_acq_rel);
+	pushJob(job, false);
+}
+
+/**
+ * drops a reference to a job, destroying it with the last one
+ *
+ * @param job: the AsyncJob to release
+ */
+void ThreadPool::releaseJob(AsyncJob* job)
+{
+	if (job->m_refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
 		return;
 
-	job.m_func();
+	job->~AsyncJob();
+	m_async_job_pool.freeBlock(job);
+}
+
+/**
+ * drops one unit of a job's unfinished work. The last one (the job
+ * itself or its last child) retires it: queues any dependents whose
+ * deps are now all done, notifies any wait calls on it, then passes
+ * the finish on to its parent.
+ *
+ * @param job: the AsyncJob to finish
+ */
+void ThreadPool::finishJob(AsyncJob* job)
+{
+	if (job->m_unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		return; //children still running, the last of them retires the job
+
+	AsyncJobHandle handle = job->m_handle;
+	AsyncJob* parent = job->m_parent;
+
+	//once done, addDependent() can't attach anything new. If something
+	//already did, the lock waits out any append still in progress
+	std::uint64_t old_state = getJobState(handle).exchange(
+		packState(handle, success), std::memory_order_acq_rel);
+	if (old_state & STATE_HAS_DEPENDENTS)
+	{
+		std::vector<AsyncJob*> dependents;
+		LockT dependents_lock(m_dependents_mut);
+		dependents.swap(job->m_dependents);
+		dependents_lock.unlock();
+
+		for (AsyncJob* dependent : dependents)
+		{
+			if (dependent->m_num_deps.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				releaseHeldJob(dependent);
+		}
+	}
+
+	m_live_async_jobs.freeHandle(handle);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_num_waiters.load(std::memory_order_relaxed) > 0)
+	{
+		LockT live_jobs_lock(m_live_async_jobs_mut);
+		m_live_async_jobs_cond.notify_all();
+	}
+
+	releaseJob(job); //the reference held for running it, the queue holds the other
+	if (parent)
+		finishJob(parent);
 }
 
-}//namespace sentinel
\ No newline at end of file
+/**
+ * allocates a job and its handle, in the pending state but not queued
+ *
+ * @param func: the job's function
+ * @param parent: the job whose unfinished work this counts towards (or nullptr)
+ */
+ThreadPool::AsyncJob* ThreadPool::createJob(std::function<void(void)> func, AsyncJob* parent)
+{
+	//handles are lock free, nobody can look this one up until we return it.
+	//The pool grows, so it only runs out when the heap does
+	AsyncJobHandle handle = m_live_async_jobs.alloc();
+	S_ASSERT(handle != NULL_JOB_HANDLE, "too many live async jobs");
+	if (handle == NULL_JOB_HANDLE)
+		throw std::bad_alloc();
+
+	void* mem_ptr = m_async_job_pool.alloc();
+	S_ASSERT(mem_ptr != nullptr, "out of memory for async jobs");
+	if (!mem_ptr)
+	{
+		m_live_async_jobs.freeHandle(handle);
+		throw std::bad_alloc();
+	}
+
+	AsyncJob* async_job = new(mem_ptr) AsyncJob(handle, std::move(func), parent);
+	reinterpret_cast<JobSlot*>(m_live_async_jobs.get(handle))->m_job = async_job;
+	getJobState(handle).store(packState(handle, pending), std::memory_order_release);
+	return async_job;
+}
+
+/**
+ * registers a job to be released when another finishes. Jobs only
+ * take m_dependents_mut when flagged as having dependents, so the
+ * flag is set under the lock, and a job done first can't be flagged.
+ *
+ * @param handle: the job to depend on
+ * @param dependent: the job waiting on it
+ * @returns true if registered, false if handle's job is already done
+ */
+bool ThreadPool::addDependent(AsyncJobHandle handle, AsyncJob* dependent)
+{
+	if (!m_live_async_jobs.isValid(handle))
+		return false;
+
+	LockT dependents_lock(m_dependents_mut);
+	std::atomic<std::uint64_t>& state = getJobState(handle);
+	std::uint64_t cur = state.load(std::memory_order_acquire);
+	do
+	{
+		if ((cur >> 32) != HandlePool::getGeneration(handle) ||
+			(cur & STATE_STATUS_MASK) == (packState(handle, success) & STATE_STATUS_MASK))
+		{
+			return false; //done, or the slot is already someone else's
+		}
+	} while (!state.compare_exchange_weak(cur, cur | STATE_HAS_DEPENDENTS, std::memory_order_acq_rel));
+
+	//flagged and not done, so finishJob() will block on the lock before retiring it
+	AsyncJob* job = reinterpret_cast<JobSlot*>(m_live_async_jobs.get(handle))->m_job;
+	job->m_dependents.push_back(dependent);
+	return true;
+}
+
+/**
+ * @returns true if the worker has a fiber waiting to
+ *          be resumed, or one already ready to be
+ */
+#ifdef FIBERS_ENABLED
+bool ThreadPool::hasFiberWork(Worker& worker)
+{
+	return m_use_fibers && (worker.m_num_suspended > 0 || hasReadyFiber(worker));
+}
+
+bool ThreadPool::hasReadyFiber(Worker& worker)
+{
+	return m_use_fibers && worker.m_num_ready.load(std::memory_order_seq_cst) > 0;
+}
+#else
+bool ThreadPool::hasFiberWork(Worker& /*worker*/)
+{
+	return false;
+}
+
+bool ThreadPool::hasReadyFiber(Worker& /*worker*/)
+{
+	return false;
+}
+#endif
+
+/**
+ * @returns a job's state word. Its slot outlives the handle,
+ *          so this is safe to call with a stale one
+ */
+std::atomic<std::uint64_t>& ThreadPool::getJobState(AsyncJobHandle handle)
+{
+	return reinterpret_cast<JobSlot*>(m_live_async_jobs.getUnchecked(handle))->m_state;
+}
+
+/**
+ * @returns a job's state word, tagged with its handle's
+ *          generation so it can't be confused with a reused slot
+ */
+std::uint64_t ThreadPool::packState(AsyncJobHandle handle, AsyncStatus status)
+{
+	return (static_cast<std::uint64_t>(HandlePool::getGeneration(handle)) << 32) |
+		(static_cast<std::uint64_t>(static_cast<std::uint16_t>(static_cast<int>(status))) & STATE_STATUS_MASK);
+}
+
+#ifdef FIBERS_ENABLED
+
+bool ThreadPool::isUsingFibers()
+{
+	return m_use_fibers;
+}
+
+/**
+ * @returns stack usage and activity for every fiber the pool
+ *          has made. Stack use is a high water mark, it may be
+ *          a little behind for fibers running right now
+ */
+std::vector<ThreadPool::FiberStats> ThreadPool::getFiberStats()
+{
+	std::vector<FiberStats> stats;
+	LockT fibers_lock(m_fibers_mut);
+	for (std::size_t i = 0; i < m_workers.size(); i++)
+	{
+		for (std::unique_ptr<JobFiber>& fiber : m_workers[i]->m_fibers)
+		{
+			FiberStats fiber_stats;
+			fiber_stats.m_worker = i;
+			fiber_stats.m_stack_size = fiber->getStackSize();
+			fiber_stats.m_stack_used = fiber->getStackUsed();
+			fiber_stats.m_jobs_run = fiber->m_jobs_run.load(std::memory_order_relaxed);
+			fiber_stats.m_switches = fiber->m_switches.load(std::memory_order_relaxed);
+			stats.push_back(fiber_stats);
+		}
+	}
+	return stats;
+}
+
+Fiber* ThreadPool::getCurrentFiber()
+{
+	return s_current_fiber;
+}
+
+/**
+ * switches the running fiber out, back to its worker, which
+ * gets on with other work. Whoever the fiber waits on must
+ * call resumeFiber() on it once (and may already have).
+ */
+void ThreadPool::suspendCurrentFiber()
+{
+	JobFiber* fiber = static_cast<JobFiber*>(s_current_fiber);
+	S_ASSERT(fiber != nullptr, "suspendCurrentFiber() called off a fiber");
+	if (!fiber)
+		return;
+
+	Worker& worker = *fiber->m_pool->m_workers[fiber->m_worker];
+
+	//these are the worker's, other fibers will change them while we're out
+	ThreadPool* job_pool = s_current_job_pool;
+	void* job = s_current_job;
+
+	worker.m_num_suspended++;
+	Fiber::switchTo(*fiber, worker.m_thread_fiber);
+
+	s_current_job_pool = job_pool;
+	s_current_job = job;
+}
+
+/**
+ * hands a suspended fiber back to its worker to carry on.
+ * It only runs once it has switched out, so this can race
+ * the suspend.
+ *
+ * @param fiber: the fiber to resume (from getCurrentFiber())
+ */
+void ThreadPool::resumeFiber(Fiber* fiber)
+{
+	JobFiber* job_fiber = static_cast<JobFiber*>(fiber);
+	ThreadPool* pool = job_fiber->m_pool;
+	Worker& worker = *pool->m_workers[job_fiber->m_worker];
+
+	LockT ready_lock(worker.m_ready_mut);
+	worker.m_ready.push_back(job_fiber);
+	worker.m_num_ready.fetch_add(1, std::memory_order_seq_cst);
+	ready_lock.unlock();
+
+	//fibers are tied to a worker, so wake everyone to be sure it's woken
+	if (pool->m_num_parked.load(std::memory_order_seq_cst) > 0)
+	{
+		LockT park_lock(pool->m_park_mut);
+		pool->m_park_cond.notify_all();
+	}
+}
+
+/**
+ * a fiber's entry: runs whatever job it's given, then switches
+ * back to its worker to be given the next one
+ */
+void ThreadPool::fiberLoop(void* arg)
+{
+	JobFiber* fiber = static_cast<JobFiber*>(arg);
+	ThreadPool* pool = fiber->m_pool;
+	Worker& worker = *pool->m_workers[fiber->m_worker];
+
+	while (true)
+	{
+		pool->runJob(fiber->m_job);
+		fiber->m_job = nullptr;
+		fiber->m_jobs_run.fetch_add(1, std::memory_order_relaxed);
+		Fiber::switchTo(*fiber, worker.m_thread_fiber);
+	}
+}
+
+/**
+ * runs a job on a free fiber, making one if there are none
+ *
+ * @param index: the worker running it
+ * @param job: the job to run
+ */
+void ThreadPool::runOnFiber(std::size_t index, AsyncJob* job)
+{
+	Worker& worker = *m_workers[index];
+	JobFiber* fiber = nullptr;
+
+	if (!worker.m_free_fibers.empty())
+	{
+		fiber = worker.m_free_fibers.back();
+		worker.m_free_fibers.pop_back();
+	}
+	else
+	{
+		LockT fibers_lock(m_fibers_mut);
+		worker.m_fibers.emplace_back(new JobFiber(this, index, m_fiber_stack_size));
+		fiber = worker.m_fibers.back().get();
+	}
+
+	fiber->m_job = job;
+	switchToFiber(worker, fiber);
+}
+
+/**
+ * runs a fiber until it finishes its job or suspends
+ */
+void ThreadPool::switchToFiber(Worker& worker, JobFiber* fiber)
+{
+	fiber->m_switches.fetch_add(1, std::memory_order_relaxed);
+	s_current_fiber = fiber;
+	Fiber::switchTo(worker.m_thread_fiber, *fiber);
+	s_current_fiber = nullptr;
+
+	//whatever the fiber left set was its own
+	s_current_job_pool = nullptr;
+	s_current_job = nullptr;
+
+	if (!fiber->m_job)
+		worker.m_free_fibers.push_back(fiber);
+	//else it suspended, whatever it waits on resumes it
+}
+
+/**
+ * @returns a suspended fiber that's ready to carry on (nullptr if none)
+ */
+ThreadPool::JobFiber* ThreadPool::takeReadyFiber(Worker& worker)
+{
+	if (worker.m_num_ready.load(std::memory_order_acquire) == 0)
+		return nullptr;
+
+	LockT ready_lock(worker.m_ready_mut);
+	if (worker.m_ready.empty())
+		return nullptr;
+
+	JobFiber* fiber = worker.m_ready.front();
+	worker.m_ready.erase(worker.m_ready.begin());
+	worker.m_num_ready.fetch_sub(1, std::memory_order_relaxed);
+	return fiber;
+}
+
+#endif //FIBERS_ENABLED
+
+#ifdef COROUTINES_ENABLED
+
+/**
+ * @returns an awaitable that suspends the calling coroutine
+ *          and resumes it as a job on one of the workers
+ */
+ThreadPool::ScheduleAwaitable ThreadPool::schedule()
+{
+	return ScheduleAwaitable{this};
+}
+
+void ThreadPool::ScheduleAwaitable::await_suspend(std::coroutine_handle<> handle)
+{
+	m_pool->asyncDo([handle]() { handle.resume(); });
+}
+
+#endif //COROUTINES_ENABLED
+
+}//namespace sentinel
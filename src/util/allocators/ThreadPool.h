@@ -1,21 +1,31 @@
 #ifndef THREAD_POOL_H
 #define THREAD_POOL_H
 
+#include <atomic>
 #include <condition_variable>
 #include <cstddef>
+#include <cstdint>
 #include <functional>
-#include <map>
+#include <memory>
 #include <mutex>
 #include <deque>
 #include <thread>
 #include <vector>
 
-#include "MemoryPool.h"
+#include "Fiber.h"
+#include "HandlePool.h"
+#include "MagazinePool.h"
+#include "SentinelAssert.h"
+#include "WorkStealingDeque.h"
+
+#ifdef COROUTINES_ENABLED
+#include <coroutine>
+#endif
 
 namespace sentinel
 {
 
-typedef std::size_t AsyncJobHandle; //an AsyncJob's id field
+typedef PoolHandle AsyncJobHandle; //an AsyncJob's slot in the live jobs pool
 extern AsyncJobHandle NULL_JOB_HANDLE;
 
 enum AsyncStatus : int
@@ -24,18 +34,86 @@ enum AsyncStatus : int
 	failed = -1,
 	pending = 0,
 	success = 1,
+	running = 2,
 };
 
+/**
+ * A work stealing job scheduler. Every worker owns a Chase-Lev deque:
+ * jobs spawned from inside a job go on the spawning worker's deque and
+ * are popped LIFO, so they run hot in cache with no locking. Jobs from
+ * other threads go through a shared injector queue. A worker out of
+ * work takes from the injector, then steals (FIFO) from a random
+ * victim, spins briefly, and finally parks until new work arrives.
+ *
+ * Jobs can be chained into graphs without blocking a thread: asyncAfter()
+ * holds a job back until every job it depends on is done, then() is the
+ * single dependency case, and asyncChild() spawns a job its parent
+ * counts as unfinished work, so waiting on (or depending on) the parent
+ * covers all of its children too.
+ *
+ * wait() never just blocks while there's work: it runs the awaited job
+ * itself if nobody has started it, or helps with other queued jobs
+ * until it's done, so jobs can wait on jobs without deadlocking the pool.
+ *
+ * With FIBERS_ENABLED, a pool can also run every job on a fiber. A job
+ * that calls wait() (or blocks on a FiberMutex or FiberEvent) is then
+ * suspended where it is, and its worker picks up other work until it can
+ * resume. Fibers stay on the worker that started them, so thread locals
+ * stay valid across a suspend.
+ *
+ * With COROUTINES_ENABLED, a Task coroutine can co_await schedule() to
+ * carry on as a job on one of the pool's workers.
+ */
 class ThreadPool
 {
 public:
-	ThreadPool(std::size_t num_threads);
+	static const std::size_t DEFAULT_FIBER_STACK_SIZE = 64 * 1024;
+
+	ThreadPool(std::size_t num_threads, bool use_fibers=false,
+		std::size_t fiber_stack_size=DEFAULT_FIBER_STACK_SIZE);
 	~ThreadPool();
 
 	AsyncJobHandle asyncDo(std::function<void (void)> func, bool immediate=false);
+	AsyncJobHandle asyncAfter(const std::vector<AsyncJobHandle>& deps, std::function<void (void)> func);
+	AsyncJobHandle then(AsyncJobHandle handle, std::function<void (void)> func);
+	AsyncJobHandle asyncChild(std::function<void (void)> func);
 	bool cancelAsyncJob(AsyncJobHandle handle); //can still fail
 	void wait(AsyncJobHandle handle);
 
+	std::size_t getNumThreads();
+
+#ifdef FIBERS_ENABLED
+	struct FiberStats
+	{
+		std::size_t m_worker;
+		std::size_t m_stack_size;
+		std::size_t m_stack_used; //high water mark
+		std::size_t m_jobs_run;
+		std::size_t m_switches; //times a worker switched into it
+	};
+
+	bool isUsingFibers();
+	std::vector<FiberStats> getFiberStats(); //scans every stack, not for hot paths
+
+	//for blocking primitives, see FiberMutex and FiberEvent
+	static Fiber* getCurrentFiber(); //nullptr if not running on a pool's fiber
+	static void suspendCurrentFiber(); //returns once resumeFiber() is called on it
+	static void resumeFiber(Fiber* fiber); //exactly once per suspend, from any thread
+#endif
+
+#ifdef COROUTINES_ENABLED
+	struct ScheduleAwaitable
+	{
+		ThreadPool* m_pool;
+
+		bool await_ready() noexcept { return false; }
+		void await_suspend(std::coroutine_handle<> handle);
+		void await_resume() noexcept {}
+	};
+
+	ScheduleAwaitable schedule(); //co_await to resume on a worker
+#endif
+
 private:
 
 	typedef std::thread ThreadT;
@@ -44,39 +122,135 @@ private:
 	typedef std::unique_lock<MutexT> LockT;
 
 	struct AsyncJob{
-		static std::size_t s_next_id;
-		std::size_t m_id;
-		AsyncStatus m_status;
+		AsyncJobHandle m_handle;
 		std::function<void (void)> m_func;
-		MutexT m_mut;
+		AsyncJob* m_parent;
+		std::atomic<std::int32_t> m_num_deps; //jobs still to finish before this one can queue
+		std::atomic<std::int32_t> m_unfinished; //this job plus its live children
+		std::atomic<std::int32_t> m_refs; //one for its queue entry, one until it's finished
+		std::vector<AsyncJob*> m_dependents; //guarded by m_dependents_mut
 
-		AsyncJob(std::function<void(void)> func) :
-			m_id(s_next_id++),
-			m_status(pending),
-			m_func(std::move(func))
+		AsyncJob(AsyncJobHandle handle, std::function<void(void)> func, AsyncJob* parent) :
+			m_handle(handle),
+			m_func(std::move(func)),
+			m_parent(parent),
+			m_num_deps(0),
+			m_unfinished(1),
+			m_refs(2)
 		{}
 	};
 
+	//a live job's handle slot. The state word is tagged with the
+	//generation, and outlives the job so stale handles can check it
+	struct JobSlot
+	{
+		AsyncJob* m_job;
+		std::atomic<std::uint64_t> m_state; //(generation << 32 | status)
+	};
 
-	void handleAsyncJob(AsyncJob& job);
+#ifdef FIBERS_ENABLED
+	struct JobFiber : public Fiber
+	{
+		JobFiber(ThreadPool* pool, std::size_t worker, std::size_t stack_size) :
+			Fiber(&ThreadPool::fiberLoop, this, stack_size),
+			m_pool(pool),
+			m_worker(worker),
+			m_job(nullptr),
+			m_jobs_run(0),
+			m_switches(0)
+		{}
 
-	//q to store async jobs
-	std::deque<AsyncJob*> m_async_job_q;
-	MutexT m_async_job_q_mut;
-	ConditionT m_async_job_q_cond;
+		ThreadPool* m_pool;
+		std::size_t m_worker; //the only worker that runs it
+		AsyncJob* m_job; //nullptr once done with it
+		std::atomic<std::size_t> m_jobs_run;
+		std::atomic<std::size_t> m_switches;
+	};
+#endif
 
-	//async workers
-	std::vector<ThreadT> m_async_workers;
-	bool m_handling_async;
+	struct Worker
+	{
+		explicit Worker(std::size_t deque_capacity) :
+			m_deque(deque_capacity)
+#ifdef FIBERS_ENABLED
+			, m_num_ready(0),
+			m_num_suspended(0)
+#endif
+		{}
+
+		WorkStealingDeque<AsyncJob*> m_deque;
+		ThreadT m_thread;
+
+#ifdef FIBERS_ENABLED
+		Fiber m_thread_fiber; //the worker loop's own stack, fibers switch back to it
+		std::vector<std::unique_ptr<JobFiber>> m_fibers; //all of them, guarded by m_fibers_mut
+		std::vector<JobFiber*> m_free_fibers; //owner only
+
+		//suspended fibers ready to carry on, pushed from any thread
+		std::vector<JobFiber*> m_ready;
+		std::atomic<std::size_t> m_num_ready;
+		MutexT m_ready_mut;
+
+		std::size_t m_num_suspended; //owner only
+#endif
+	};
+
+	void workerLoop(std::size_t index);
+	AsyncJob* findJob(std::size_t index, std::uint32_t& rng_state);
+	void pushJob(AsyncJob* job, bool immediate);
+	void runJob(AsyncJob* job);
+	void executeJob(AsyncJob* job);
+	bool tryRunInline(AsyncJobHandle handle);
+	void finishJob(AsyncJob* job);
+	void releaseHeldJob(AsyncJob* job);
+	void releaseJob(AsyncJob* job);
+	AsyncJob* createJob(std::function<void(void)> func, AsyncJob* parent);
+	bool addDependent(AsyncJobHandle handle, AsyncJob* dependent);
 
-	//wait on job without regard for job lifespan
-	std::map<AsyncJobHandle, AsyncJob*> m_live_async_jobs;
+	std::atomic<std::uint64_t>& getJobState(AsyncJobHandle handle);
+	static std::uint64_t packState(AsyncJobHandle handle, AsyncStatus status);
+
+#ifdef FIBERS_ENABLED
+	static void fiberLoop(void* arg);
+	void runOnFiber(std::size_t index, AsyncJob* job);
+	void switchToFiber(Worker& worker, JobFiber* fiber);
+	JobFiber* takeReadyFiber(Worker& worker);
+#endif
+	bool hasFiberWork(Worker& worker);
+	bool hasReadyFiber(Worker& worker);
+
+	//one deque per worker, plus the injector for jobs from outside the pool
+	std::vector<std::unique_ptr<Worker>> m_workers;
+	std::deque<AsyncJob*> m_injector;
+	std::atomic<std::size_t> m_injector_size; //so idle workers can skip the lock
+	MutexT m_injector_mut;
+	std::atomic<bool> m_handling_async;
+
+	//queued jobs not yet taken, workers only park when it's 0
+	std::atomic<std::int64_t> m_num_queued;
+	std::atomic<std::size_t> m_num_parked;
+	MutexT m_park_mut;
+	ConditionT m_park_cond;
+
+	//wait on job without regard for job lifespan, a job's
+	//handle goes stale once it's done
+	HandlePool m_live_async_jobs; //holds a JobSlot per live job
+	std::atomic<std::size_t> m_num_waiters;
 	MutexT m_live_async_jobs_mut;
 	ConditionT m_live_async_jobs_cond;
 
-	MemoryPool m_async_job_pool;
+	//only taken for jobs that have dependents, see addDependent()
+	MutexT m_dependents_mut;
+
+	MagazinePool m_async_job_pool;
+
+	bool m_use_fibers;
+	std::size_t m_fiber_stack_size;
+#ifdef FIBERS_ENABLED
+	MutexT m_fibers_mut;
+#endif
 };
 
 }//namespace sentinel
 
-#endif
\ No newline at end of file
+#endif
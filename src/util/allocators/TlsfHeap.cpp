@@ -0,0 +1,600 @@
+#include "TlsfHeap.h"
+
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace sentinel
+{
+
+static const std::size_t BLOCK_FREE_BIT = 1;
+static const std::size_t PREV_FREE_BIT = 2;
+static const std::size_t BLOCK_FLAG_BITS = BLOCK_FREE_BIT | PREV_FREE_BIT;
+
+//index of the highest set bit (x > 0)
+static inline std::size_t highestBit(std::size_t x)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, x);
+	return index;
+#else
+	return (sizeof(unsigned long long) * 8 - 1) - __builtin_clzll(x);
+#endif
+}
+
+//index of the lowest set bit (x > 0)
+static inline std::size_t lowestBit(std::uint32_t x)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, x);
+	return index;
+#else
+	return __builtin_ctz(x);
+#endif
+}
+
+static inline uintptr_t alignUp(uintptr_t x, std::size_t alignment)
+{
+	return (x + (alignment - 1)) & ~(uintptr_t(alignment) - 1);
+}
+
+/*
+ * block helpers, all O(1)
+ */
+template<typename BlockT>
+static inline std::size_t blockSize(BlockT* block)
+{
+	return block->m_size & ~BLOCK_FLAG_BITS;
+}
+
+template<typename BlockT>
+static inline void setBlockSize(BlockT* block, std::size_t size)
+{
+	block->m_size = size | (block->m_size & BLOCK_FLAG_BITS);
+}
+
+template<typename BlockT>
+static inline bool isFree(BlockT* block)
+{
+	return (block->m_size & BLOCK_FREE_BIT) != 0;
+}
+
+template<typename BlockT>
+static inline bool isPrevFree(BlockT* block)
+{
+	return (block->m_size & PREV_FREE_BIT) != 0;
+}
+
+template<typename BlockT>
+static inline void setFlag(BlockT* block, std::size_t flag, bool value)
+{
+	block->m_size = value ? (block->m_size | flag) : (block->m_size & ~flag);
+}
+
+template<typename BlockT>
+static inline void* toPtr(BlockT* block, std::size_t start_offset)
+{
+	return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(block) + start_offset);
+}
+
+template<typename BlockT>
+static inline BlockT* offsetToBlock(const void* p, std::ptrdiff_t offset)
+{
+	return reinterpret_cast<BlockT*>(reinterpret_cast<intptr_t>(p) + offset);
+}
+
+/**
+ * ctor. Lays the region out as one big free block followed by a
+ * zero sized, used sentinel block.
+ *
+ * @param region: memory for the heap, owned by the caller
+ * @param size_bytes: size of the region (under 4GB)
+ */
+TlsfHeap::TlsfHeap(void* region, std::size_t size_bytes) :
+	m_total_size(size_bytes),
+	m_used_bytes(0),
+	m_free_bytes(0),
+	m_num_free_blocks(0),
+	m_fl_bitmap(0)
+{
+	for (std::size_t fl = 0; fl < FL_INDEX_COUNT; fl++)
+	{
+		m_sl_bitmap[fl] = 0;
+		for (std::size_t sl = 0; sl < SL_INDEX_COUNT; sl++)
+			m_blocks[fl][sl] = nullptr;
+	}
+
+	uintptr_t start = alignUp(reinterpret_cast<uintptr_t>(region), ALIGN_SIZE);
+	uintptr_t end = reinterpret_cast<uintptr_t>(region) + size_bytes;
+	S_ASSERT(region != nullptr);
+	S_ASSERT(end > start + BLOCK_START_OFFSET + BLOCK_SIZE_MIN + BLOCK_START_OFFSET,
+		"region too small for a TlsfHeap");
+
+	//first block's header at start, the sentinel's size word at the very end
+	std::size_t block_size = (end - start - BLOCK_START_OFFSET - BLOCK_HEADER_OVERHEAD)
+		& ~(ALIGN_SIZE - 1);
+	S_ASSERT(block_size < BLOCK_SIZE_MAX, "region too big for a TlsfHeap");
+
+	BlockHeader* block = reinterpret_cast<BlockHeader*>(start);
+	block->m_size = block_size | BLOCK_FREE_BIT; //nothing before it, so prev isn't free
+
+	BlockHeader* sentinel = offsetToBlock<BlockHeader>(toPtr(block, BLOCK_START_OFFSET),
+		block_size - BLOCK_HEADER_OVERHEAD);
+	sentinel->m_prev_phys = block;
+	sentinel->m_size = 0 | PREV_FREE_BIT;
+
+	insertFree(block);
+}
+
+/**
+ * dtor. The region belongs to the caller.
+ */
+TlsfHeap::~TlsfHeap()
+{
+}
+
+/**
+ * Allocates a block in O(1)
+ *
+ * @param size_bytes: bytes to allocate
+ * @returns an 8 byte aligned block (nullptr if there is no
+ *          free block big enough)
+ */
+void* TlsfHeap::alloc(std::size_t size_bytes)
+{
+	LockT lock(m_mut);
+	return allocUnlocked(size_bytes);
+}
+
+/**
+ * Allocates a block at any power of 2 alignment. The gap in front of
+ * the aligned block goes back on the free lists, so nothing is wasted
+ * and freeBlock() needs no adjustment info.
+ *
+ * @param size_bytes: bytes to allocate
+ * @param alignment: the alignment in bytes (a power of 2)
+ */
+void* TlsfHeap::allocAligned(std::size_t size_bytes, std::size_t alignment)
+{
+	S_ASSERT((alignment & (alignment - 1)) == 0); //pwr of 2
+	if (alignment <= ALIGN_SIZE)
+		return alloc(size_bytes);
+
+	LockT lock(m_mut);
+
+	std::size_t adjusted = adjustRequest(size_bytes);
+	if (!adjusted)
+		return nullptr;
+
+	//room for the alignment plus a whole free block in front of it
+	const std::size_t gap_minimum = sizeof(BlockHeader);
+	std::size_t size_with_gap = adjustRequest(adjusted + alignment + gap_minimum);
+	if (!size_with_gap)
+		return nullptr;
+
+	BlockHeader* block = locateFree(size_with_gap);
+	if (!block)
+		return nullptr;
+
+	uintptr_t block_ptr = reinterpret_cast<uintptr_t>(toPtr(block, BLOCK_START_OFFSET));
+	uintptr_t aligned = alignUp(block_ptr, alignment);
+	std::size_t gap = aligned - block_ptr;
+
+	//a gap too small to be a free block of its own, so push past it
+	if (gap && gap < gap_minimum)
+	{
+		std::size_t gap_remain = gap_minimum - gap;
+		std::size_t offset = (gap_remain > alignment) ? gap_remain : alignment;
+		aligned = alignUp(aligned + offset, alignment);
+		gap = aligned - block_ptr;
+	}
+
+	if (gap)
+		block = trimFreeLeading(block, gap);
+
+	return prepareUsed(block, adjusted);
+}
+
+/**
+ * Resizes a block, in place when it can: shrinking always works, and
+ * growing works if the next block is free and big enough. Otherwise
+ * allocates, copies and frees (keeping only 8 byte alignment).
+ *
+ * @param p: a block from this heap (nullptr acts like alloc)
+ * @param size_bytes: the new size (0 acts like freeBlock)
+ * @returns the block's new address (nullptr on failure, p is untouched)
+ */
+void* TlsfHeap::realloc(void* p, std::size_t size_bytes)
+{
+	LockT lock(m_mut);
+
+	if (!p)
+		return allocUnlocked(size_bytes);
+	if (size_bytes == 0)
+	{
+		freeBlockUnlocked(p);
+		return nullptr;
+	}
+
+	BlockHeader* block = offsetToBlock<BlockHeader>(p, -std::ptrdiff_t(BLOCK_START_OFFSET));
+	S_ASSERT(!isFree(block), "realloc of a freed block");
+
+	BlockHeader* next = offsetToBlock<BlockHeader>(p, blockSize(block) - BLOCK_HEADER_OVERHEAD);
+	std::size_t current_size = blockSize(block);
+	std::size_t combined_size = current_size + blockSize(next) + BLOCK_HEADER_OVERHEAD;
+	std::size_t adjusted = adjustRequest(size_bytes);
+	if (!adjusted)
+		return nullptr;
+
+	if (adjusted > current_size && (!isFree(next) || adjusted > combined_size))
+	{
+		void* new_p = allocUnlocked(size_bytes);
+		if (new_p)
+		{
+			std::memcpy(new_p, p, (current_size < size_bytes) ? current_size : size_bytes);
+			freeBlockUnlocked(p);
+		}
+		return new_p;
+	}
+
+	m_used_bytes -= current_size;
+	if (adjusted > current_size)
+	{
+		//swallow the free block after us
+		removeFree(next);
+		absorb(block, next);
+		BlockHeader* after = offsetToBlock<BlockHeader>(p, blockSize(block) - BLOCK_HEADER_OVERHEAD);
+		setFlag(after, PREV_FREE_BIT, false);
+	}
+	trimUsed(block, adjusted);
+	m_used_bytes += blockSize(block);
+
+	return p;
+}
+
+/**
+ * Frees a block in O(1), merging it with free neighbours
+ *
+ * @param p: a block from alloc(), allocAligned() or realloc()
+ */
+void TlsfHeap::freeBlock(void* p)
+{
+	S_ASSERT(p != nullptr);
+
+	LockT lock(m_mut);
+	freeBlockUnlocked(p);
+}
+
+/**
+ * @param p: a live block from this heap
+ * @returns the usable size of the block (at least what was asked for)
+ */
+std::size_t TlsfHeap::getBlockSize(void* p)
+{
+	LockT lock(m_mut);
+	return blockSize(offsetToBlock<BlockHeader>(p, -std::ptrdiff_t(BLOCK_START_OFFSET)));
+}
+
+std::size_t TlsfHeap::getSize()
+{
+	return m_total_size;
+}
+
+std::size_t TlsfHeap::getUsedBytes()
+{
+	LockT lock(m_mut);
+	return m_used_bytes;
+}
+
+std::size_t TlsfHeap::getFreeBytes()
+{
+	LockT lock(m_mut);
+	return m_free_bytes;
+}
+
+std::size_t TlsfHeap::getNumFreeBlocks()
+{
+	LockT lock(m_mut);
+	return m_num_free_blocks;
+}
+
+/**
+ * @returns the biggest single allocation that could succeed right now.
+ *          Walks only the highest non-empty free list.
+ */
+std::size_t TlsfHeap::getLargestFreeBlock()
+{
+	LockT lock(m_mut);
+
+	if (!m_fl_bitmap)
+		return 0;
+
+	std::size_t fl = highestBit(m_fl_bitmap);
+	std::size_t sl = highestBit(m_sl_bitmap[fl]);
+
+	std::size_t largest = 0;
+	for (BlockHeader* block = m_blocks[fl][sl]; block; block = block->m_next_free)
+	{
+		if (blockSize(block) > largest)
+			largest = blockSize(block);
+	}
+	return largest;
+}
+
+/**
+ * @returns 0 when all free memory is one block, approaching 1
+ *          as it is scattered over many small blocks
+ */
+float TlsfHeap::getFragmentation()
+{
+	std::size_t free_bytes = getFreeBytes();
+	if (free_bytes == 0)
+		return 0.0f;
+
+	return 1.0f - (static_cast<float>(getLargestFreeBlock()) / static_cast<float>(free_bytes));
+}
+
+/**
+ * finds the free list a block of size belongs in
+ */
+void TlsfHeap::mappingInsert(std::size_t size, std::size_t& fl, std::size_t& sl)
+{
+	if (size < SMALL_BLOCK_SIZE)
+	{
+		//small blocks are all in the first list, linearly spaced
+		fl = 0;
+		sl = size / (SMALL_BLOCK_SIZE / SL_INDEX_COUNT);
+	}
+	else
+	{
+		std::size_t top_bit = highestBit(size);
+		sl = (size >> (top_bit - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+		fl = top_bit - (FL_INDEX_SHIFT - 1);
+	}
+}
+
+/**
+ * like mappingInsert, but rounds up to the next list so that
+ * any block found there is big enough without searching
+ */
+void TlsfHeap::mappingSearch(std::size_t size, std::size_t& fl, std::size_t& sl)
+{
+	if (size >= SMALL_BLOCK_SIZE)
+		size += (std::size_t(1) << (highestBit(size) - SL_INDEX_COUNT_LOG2)) - 1;
+
+	mappingInsert(size, fl, sl);
+}
+
+/**
+ * @returns the request rounded to a valid block size (0 if too big)
+ */
+std::size_t TlsfHeap::adjustRequest(std::size_t size_bytes)
+{
+	if (size_bytes == 0 || size_bytes >= BLOCK_SIZE_MAX)
+		return 0;
+
+	std::size_t aligned = alignUp(size_bytes, ALIGN_SIZE);
+	return (aligned < BLOCK_SIZE_MIN) ? BLOCK_SIZE_MIN : aligned;
+}
+
+/**
+ * splits block so it holds size bytes, the rest becomes a new free
+ * block right after it. Caller sets block's flags and lists.
+ *
+ * @returns the remainder
+ */
+TlsfHeap::BlockHeader* TlsfHeap::split(BlockHeader* block, std::size_t size)
+{
+	void* block_ptr = toPtr(block, BLOCK_START_OFFSET);
+	BlockHeader* remaining = offsetToBlock<BlockHeader>(block_ptr, size - BLOCK_HEADER_OVERHEAD);
+	std::size_t remain_size = blockSize(block) - (size + BLOCK_HEADER_OVERHEAD);
+
+	remaining->m_size = remain_size | BLOCK_FREE_BIT; //prev (block) counts as used
+	setBlockSize(block, size);
+
+	BlockHeader* after = offsetToBlock<BlockHeader>(toPtr(remaining, BLOCK_START_OFFSET),
+		remain_size - BLOCK_HEADER_OVERHEAD);
+	after->m_prev_phys = remaining;
+	setFlag(after, PREV_FREE_BIT, true);
+
+	return remaining;
+}
+
+/**
+ * merges block into prev, its physical predecessor
+ *
+ * @returns prev
+ */
+TlsfHeap::BlockHeader* TlsfHeap::absorb(BlockHeader* prev, BlockHeader* block)
+{
+	setBlockSize(prev, blockSize(prev) + blockSize(block) + BLOCK_HEADER_OVERHEAD);
+
+	BlockHeader* after = offsetToBlock<BlockHeader>(toPtr(prev, BLOCK_START_OFFSET),
+		blockSize(prev) - BLOCK_HEADER_OVERHEAD);
+	after->m_prev_phys = prev;
+
+	return prev;
+}
+
+void TlsfHeap::insertFree(BlockHeader* block)
+{
+	std::size_t fl, sl;
+	mappingInsert(blockSize(block), fl, sl);
+
+	BlockHeader* head = m_blocks[fl][sl];
+	block->m_next_free = head;
+	block->m_prev_free = nullptr;
+	if (head)
+		head->m_prev_free = block;
+	m_blocks[fl][sl] = block;
+
+	m_fl_bitmap |= (std::uint32_t(1) << fl);
+	m_sl_bitmap[fl] |= (std::uint32_t(1) << sl);
+
+	m_free_bytes += blockSize(block);
+	m_num_free_blocks++;
+}
+
+void TlsfHeap::removeFree(BlockHeader* block)
+{
+	std::size_t fl, sl;
+	mappingInsert(blockSize(block), fl, sl);
+
+	if (block->m_prev_free)
+		block->m_prev_free->m_next_free = block->m_next_free;
+	if (block->m_next_free)
+		block->m_next_free->m_prev_free = block->m_prev_free;
+
+	if (m_blocks[fl][sl] == block)
+	{
+		m_blocks[fl][sl] = block->m_next_free;
+		if (!block->m_next_free)
+		{
+			m_sl_bitmap[fl] &= ~(std::uint32_t(1) << sl);
+			if (!m_sl_bitmap[fl])
+				m_fl_bitmap &= ~(std::uint32_t(1) << fl);
+		}
+	}
+
+	m_free_bytes -= blockSize(block);
+	m_num_free_blocks--;
+}
+
+/**
+ * finds and unlinks a free block of at least size bytes using
+ * only the bitmaps: two bit scans, no list walking
+ */
+TlsfHeap::BlockHeader* TlsfHeap::locateFree(std::size_t size)
+{
+	std::size_t fl, sl;
+	mappingSearch(size, fl, sl);
+	if (fl >= FL_INDEX_COUNT)
+		return nullptr;
+
+	//anything in this first level list at or above sl?
+	std::uint32_t sl_map = m_sl_bitmap[fl] & (~std::uint32_t(0) << sl);
+	if (!sl_map)
+	{
+		//no, take the smallest list in a higher first level
+		if (fl + 1 >= FL_INDEX_COUNT)
+			return nullptr;
+		std::uint32_t fl_map = m_fl_bitmap & (~std::uint32_t(0) << (fl + 1));
+		if (!fl_map)
+			return nullptr;
+
+		fl = lowestBit(fl_map);
+		sl_map = m_sl_bitmap[fl];
+	}
+	sl = lowestBit(sl_map);
+
+	BlockHeader* block = m_blocks[fl][sl];
+	S_ASSERT(blockSize(block) >= size);
+	removeFree(block);
+	return block;
+}
+
+TlsfHeap::BlockHeader* TlsfHeap::mergePrev(BlockHeader* block)
+{
+	if (!isPrevFree(block))
+		return block;
+
+	BlockHeader* prev = block->m_prev_phys;
+	S_ASSERT(isFree(prev));
+	removeFree(prev);
+	return absorb(prev, block);
+}
+
+TlsfHeap::BlockHeader* TlsfHeap::mergeNext(BlockHeader* block)
+{
+	BlockHeader* next = offsetToBlock<BlockHeader>(toPtr(block, BLOCK_START_OFFSET),
+		blockSize(block) - BLOCK_HEADER_OVERHEAD);
+	if (!isFree(next))
+		return block;
+
+	removeFree(next);
+	return absorb(block, next);
+}
+
+/**
+ * gives the front of a free block back to the free lists
+ *
+ * @param size: bytes from block's payload start to keep free
+ * @returns the (still free, unlisted) block after the gap
+ */
+TlsfHeap::BlockHeader* TlsfHeap::trimFreeLeading(BlockHeader* block, std::size_t size)
+{
+	BlockHeader* remaining = split(block, size - BLOCK_HEADER_OVERHEAD);
+	setFlag(remaining, PREV_FREE_BIT, true);
+	remaining->m_prev_phys = block; //block stays free, so freeing remaining will merge back into it
+	insertFree(block);
+	return remaining;
+}
+
+/**
+ * gives the tail of a free block past size back to the free lists
+ */
+void TlsfHeap::trimFree(BlockHeader* block, std::size_t size)
+{
+	if (blockSize(block) >= sizeof(BlockHeader) + size)
+		insertFree(split(block, size));
+}
+
+/**
+ * gives the tail of a used block past size back to the free lists
+ */
+void TlsfHeap::trimUsed(BlockHeader* block, std::size_t size)
+{
+	if (blockSize(block) >= sizeof(BlockHeader) + size)
+		insertFree(mergeNext(split(block, size)));
+}
+
+/**
+ * trims a located block to size and marks it used
+ */
+void* TlsfHeap::prepareUsed(BlockHeader* block, std::size_t size)
+{
+	trimFree(block, size);
+
+	BlockHeader* next = offsetToBlock<BlockHeader>(toPtr(block, BLOCK_START_OFFSET),
+		blockSize(block) - BLOCK_HEADER_OVERHEAD);
+	setFlag(next, PREV_FREE_BIT, false);
+	setFlag(block, BLOCK_FREE_BIT, false);
+
+	m_used_bytes += blockSize(block);
+	return toPtr(block, BLOCK_START_OFFSET);
+}
+
+void* TlsfHeap::allocUnlocked(std::size_t size_bytes)
+{
+	std::size_t adjusted = adjustRequest(size_bytes);
+	if (!adjusted)
+		return nullptr;
+
+	BlockHeader* block = locateFree(adjusted);
+	if (!block)
+		return nullptr;
+
+	return prepareUsed(block, adjusted);
+}
+
+void TlsfHeap::freeBlockUnlocked(void* p)
+{
+	BlockHeader* block = offsetToBlock<BlockHeader>(p, -std::ptrdiff_t(BLOCK_START_OFFSET));
+	S_ASSERT(!isFree(block), "double free");
+	m_used_bytes -= blockSize(block);
+
+	setFlag(block, BLOCK_FREE_BIT, true);
+	BlockHeader* next = offsetToBlock<BlockHeader>(p, blockSize(block) - BLOCK_HEADER_OVERHEAD);
+	next->m_prev_phys = block;
+	setFlag(next, PREV_FREE_BIT, true);
+
+	block = mergePrev(block);
+	block = mergeNext(block);
+	insertFree(block);
+}
+
+} //namespace sentinel
@@ -0,0 +1,113 @@
+#ifndef TLSF_HEAP_H
+#define TLSF_HEAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "SentinelAssert.h"
+
+namespace sentinel
+{
+
+/**
+ * A two-level segregated-fit (TLSF) heap for variable sized blocks freed
+ * in any order, carved out of a caller-supplied region. Free blocks are
+ * kept in size-class lists indexed by a two-level bitmap, so alloc,
+ * freeBlock and realloc all run in O(1), with no searching and no
+ * latency spikes as the heap fragments. Neighbouring free blocks are
+ * merged on free.
+ *
+ * Every block costs one size word of overhead. Blocks are 8 byte aligned,
+ * allocAligned() handles anything bigger.
+ *
+ * The heap doesn't own the region, it must outlive the heap.
+ */
+class TlsfHeap
+{
+public:
+	TlsfHeap(void* region, std::size_t size_bytes);
+	TlsfHeap(const TlsfHeap& other)              = delete;
+	TlsfHeap& operator = (const TlsfHeap& other) = delete;
+	~TlsfHeap();
+
+	void* alloc(std::size_t size_bytes);
+	void* allocAligned(std::size_t size_bytes, std::size_t alignment);
+	void* realloc(void* p, std::size_t size_bytes);
+	void freeBlock(void* p);
+
+	std::size_t getBlockSize(void* p);
+
+	//fragmentation stats
+	std::size_t getSize();
+	std::size_t getUsedBytes();
+	std::size_t getFreeBytes();
+	std::size_t getNumFreeBlocks();
+	std::size_t getLargestFreeBlock();
+	float getFragmentation();
+
+	static constexpr std::size_t ALIGN_SIZE = 8;
+	static constexpr std::size_t SL_INDEX_COUNT_LOG2 = 5; //32 lists per power of 2
+	static constexpr std::size_t SL_INDEX_COUNT = std::size_t(1) << SL_INDEX_COUNT_LOG2;
+	static constexpr std::size_t FL_INDEX_MAX = 32; //blocks up to 4GB
+	static constexpr std::size_t FL_INDEX_SHIFT = SL_INDEX_COUNT_LOG2 + 3; //log2(ALIGN_SIZE)
+	static constexpr std::size_t FL_INDEX_COUNT = FL_INDEX_MAX - FL_INDEX_SHIFT + 1;
+	static constexpr std::size_t SMALL_BLOCK_SIZE = std::size_t(1) << FL_INDEX_SHIFT;
+
+private:
+	/*
+	 * m_prev_phys is really the last word of the previous block, and is
+	 * only valid while that block is free. m_next_free and m_prev_free
+	 * overlap the payload, so only exist while this block is free.
+	 */
+	struct BlockHeader
+	{
+		BlockHeader* m_prev_phys;
+		std::size_t m_size; //payload bytes, low bits are flags
+		BlockHeader* m_next_free;
+		BlockHeader* m_prev_free;
+	};
+
+	static constexpr std::size_t BLOCK_HEADER_OVERHEAD = sizeof(std::size_t);
+	static constexpr std::size_t BLOCK_START_OFFSET = sizeof(BlockHeader*) + sizeof(std::size_t);
+	static constexpr std::size_t BLOCK_SIZE_MIN = sizeof(BlockHeader) - sizeof(BlockHeader*);
+	static constexpr std::size_t BLOCK_SIZE_MAX = std::size_t(1) << FL_INDEX_MAX;
+
+	static void mappingInsert(std::size_t size, std::size_t& fl, std::size_t& sl);
+	static void mappingSearch(std::size_t size, std::size_t& fl, std::size_t& sl);
+	static std::size_t adjustRequest(std::size_t size_bytes);
+
+	static BlockHeader* split(BlockHeader* block, std::size_t size);
+	static BlockHeader* absorb(BlockHeader* prev, BlockHeader* block);
+
+	void insertFree(BlockHeader* block);
+	void removeFree(BlockHeader* block);
+	BlockHeader* locateFree(std::size_t size);
+	BlockHeader* mergePrev(BlockHeader* block);
+	BlockHeader* mergeNext(BlockHeader* block);
+	BlockHeader* trimFreeLeading(BlockHeader* block, std::size_t size);
+	void trimFree(BlockHeader* block, std::size_t size);
+	void trimUsed(BlockHeader* block, std::size_t size);
+	void* prepareUsed(BlockHeader* block, std::size_t size);
+
+	void* allocUnlocked(std::size_t size_bytes);
+	void freeBlockUnlocked(void* p);
+
+	std::size_t m_total_size;
+	std::size_t m_used_bytes;
+	std::size_t m_free_bytes;
+	std::size_t m_num_free_blocks;
+
+	std::uint32_t m_fl_bitmap;
+	std::uint32_t m_sl_bitmap[FL_INDEX_COUNT];
+	BlockHeader* m_blocks[FL_INDEX_COUNT][SL_INDEX_COUNT];
+
+	typedef std::mutex MutexT;
+	typedef std::unique_lock<MutexT> LockT;
+
+	MutexT m_mut;
+};
+
+} //namespace sentinel
+
+#endif //TLSF_HEAP_H
@@ -0,0 +1,257 @@
+#include "VirtualStack.h"
+
+#include <new>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace sentinel
+{
+
+//commit this much at a time so we aren't making a syscall per page
+static const std::size_t COMMIT_CHUNK_SIZE = 64 * 1024;
+static const std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+static inline uintptr_t roundUp(uintptr_t value, std::size_t granularity)
+{
+	return ((value + granularity - 1) / granularity) * granularity;
+}
+
+/**
+ * ctor. Reserves the address range but commits nothing.
+ *
+ * @param (optional) reserve_size_bytes: the most the stack can ever hold
+ * @param (optional) decommit_watermark_bytes: clear() gives back committed
+ *        memory above this (0, the default, keeps it all)
+ * @param (optional) huge_pages: back the stack with huge pages if possible
+ */
+VirtualStack::VirtualStack(std::size_t reserve_size_bytes,
+	std::size_t decommit_watermark_bytes, bool huge_pages) :
+	m_reservation(nullptr),
+	m_reservation_size(0),
+	m_commit_granularity(huge_pages ? HUGE_PAGE_SIZE : COMMIT_CHUNK_SIZE),
+	m_decommit_watermark(decommit_watermark_bytes)
+{
+	m_reserved_size = roundUp(reserve_size_bytes, m_commit_granularity);
+	//huge pages need a huge page aligned start, so reserve enough to align
+	m_reservation_size = m_reserved_size + (huge_pages ? HUGE_PAGE_SIZE : 0);
+
+#ifdef _WIN32
+	m_reservation = VirtualAlloc(nullptr, m_reservation_size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+	flags |= MAP_NORESERVE;
+#endif
+	m_reservation = mmap(nullptr, m_reservation_size, PROT_NONE, flags, -1, 0);
+	if (m_reservation == MAP_FAILED)
+		m_reservation = nullptr;
+#endif
+	if (!m_reservation)
+		throw std::bad_alloc();
+
+	//only huge pages need the bottom aligned, commit chunks are just page multiples,
+	//and the top has to stay inside what was actually mapped
+	m_stack_bottom = reinterpret_cast<uintptr_t>(m_reservation);
+	if (huge_pages)
+		m_stack_bottom = roundUp(m_stack_bottom, HUGE_PAGE_SIZE);
+	m_stack_top = m_stack_bottom + m_reserved_size;
+	m_stack_marker = m_stack_bottom;
+	m_committed_top = m_stack_bottom;
+
+#if defined(MADV_HUGEPAGE)
+	if (huge_pages)
+		madvise(reinterpret_cast<void*>(m_stack_bottom), m_reserved_size, MADV_HUGEPAGE);
+#endif
+}
+
+/**
+ * dtor. Releases the whole reservation.
+ */
+VirtualStack::~VirtualStack()
+{
+#ifdef _WIN32
+	VirtualFree(m_reservation, 0, MEM_RELEASE);
+#else
+	munmap(m_reservation, m_reservation_size);
+#endif
+}
+
+std::size_t VirtualStack::getReservedSize()
+{
+	return m_reserved_size;
+}
+
+/**
+ * @returns bytes currently backed by (or promised) physical memory
+ */
+std::size_t VirtualStack::getCommittedSize()
+{
+	LockT lock(m_mut);
+	return m_committed_top - m_stack_bottom;
+}
+
+std::size_t VirtualStack::getUsedBytes()
+{
+	LockT lock(m_mut);
+	return m_stack_marker - m_stack_bottom;
+}
+
+void* VirtualStack::getStackPtr()
+{
+	LockT lock(m_mut);
+	return reinterpret_cast<void*>(m_stack_marker);
+}
+
+/**
+ * Reserves some space, committing more pages if the marker passes
+ * the committed top.
+ *
+ * @param size_bytes: bytes to reserve
+ * @returns a pointer to the reserved data (nullptr if the reservation
+ *          is used up or the OS won't commit more)
+ */
+void* VirtualStack::alloc(std::size_t size_bytes)
+{
+	LockT lock(m_mut);
+
+	uintptr_t new_stack_marker = m_stack_marker + size_bytes;
+	if (new_stack_marker > m_stack_top)
+		return nullptr;
+	if (new_stack_marker > m_committed_top && !commitTo(new_stack_marker))
+		return nullptr;
+
+	void* mark = reinterpret_cast<void*>(m_stack_marker);
+	m_stack_marker = new_stack_marker;
+	return mark;
+}
+
+/**
+ * Allocates an aligned block of memory, same rules as
+ * MemoryStack::allocAligned
+ *
+ * @param size_bytes: size of allocated block in bytes
+ * @param alignment: alignment in bytes
+ */
+void* VirtualStack::allocAligned(std::size_t size_bytes, std::size_t alignment)
+{
+	S_ASSERT(alignment >= 1);
+	S_ASSERT(alignment <= 128);
+	S_ASSERT((alignment & (alignment - 1)) == 0); //pwr of 2
+
+	void* raw_ptr = alloc(size_bytes + alignment);
+	if (!raw_ptr)
+		return nullptr;
+
+	uintptr_t raw_address = reinterpret_cast<uintptr_t>(raw_ptr);
+	std::size_t mask = (alignment - 1);
+	uintptr_t misalignment = (raw_address & mask);
+	std::ptrdiff_t adjustment = alignment - misalignment;
+
+	uintptr_t aligned_address = raw_address + adjustment;
+
+	//write the adjustment to the preceding byte
+	S_ASSERT(adjustment < 256);
+	uint8_t* adjustment_ptr = reinterpret_cast<uint8_t*>(aligned_address - 1);
+	*adjustment_ptr = static_cast<uint8_t>(adjustment);
+
+	return reinterpret_cast<void*>(aligned_address);
+}
+
+/**
+ * Rolls back the stack marker. Pages stay committed.
+ *
+ * @param marker: the marker to roll back to
+ */
+void VirtualStack::freeTo(void* marker)
+{
+	LockT lock(m_mut);
+	S_ASSERT(reinterpret_cast<uintptr_t>(marker) <= m_stack_marker);
+	S_ASSERT(reinterpret_cast<uintptr_t>(marker) >= m_stack_bottom);
+
+	m_stack_marker = reinterpret_cast<uintptr_t>(marker);
+}
+
+/**
+ * free to aligned memory ptr
+ *
+ * @param marker: a ptr returned by allocAligned()
+ */
+void VirtualStack::freeToAligned(void* marker)
+{
+	uintptr_t raw_marker = reinterpret_cast<uintptr_t>(marker);
+	uint8_t adjustment = *(reinterpret_cast<uint8_t*>(raw_marker - 1));
+
+	freeTo(reinterpret_cast<void*>(raw_marker - adjustment));
+}
+
+/**
+ * Rolls the marker back to the bottom, and decommits whatever
+ * is committed above the decommit watermark (if there is one)
+ */
+void VirtualStack::clear()
+{
+	LockT lock(m_mut);
+	m_stack_marker = m_stack_bottom;
+
+	if (m_decommit_watermark > 0)
+		decommitAbove(m_stack_bottom + m_decommit_watermark);
+}
+
+/**
+ * commits whole chunks from the committed top up past new_marker.
+ * Caller holds the lock.
+ *
+ * @returns false if the OS refused
+ */
+bool VirtualStack::commitTo(uintptr_t new_marker)
+{
+	uintptr_t new_committed_top = roundUp(new_marker, m_commit_granularity);
+	if (new_committed_top > m_stack_top)
+		new_committed_top = m_stack_top;
+
+	void* start = reinterpret_cast<void*>(m_committed_top);
+	std::size_t size = new_committed_top - m_committed_top;
+
+#ifdef _WIN32
+	if (!VirtualAlloc(start, size, MEM_COMMIT, PAGE_READWRITE))
+		return false;
+#else
+	if (mprotect(start, size, PROT_READ | PROT_WRITE) != 0)
+		return false;
+#endif
+
+	m_committed_top = new_committed_top;
+	return true;
+}
+
+/**
+ * gives committed pages above keep_top back to the OS.
+ * Caller holds the lock.
+ *
+ * @param keep_top: everything below this stays committed
+ */
+void VirtualStack::decommitAbove(uintptr_t keep_top)
+{
+	keep_top = roundUp(keep_top, m_commit_granularity);
+	if (keep_top >= m_committed_top)
+		return;
+
+	void* start = reinterpret_cast<void*>(keep_top);
+	std::size_t size = m_committed_top - keep_top;
+
+#ifdef _WIN32
+	VirtualFree(start, size, MEM_DECOMMIT);
+#else
+	madvise(start, size, MADV_DONTNEED);
+	mprotect(start, size, PROT_NONE);
+#endif
+
+	m_committed_top = keep_top;
+}
+
+} //namespace sentinel
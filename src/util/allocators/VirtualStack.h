@@ -0,0 +1,67 @@
+#ifndef VIRTUAL_STACK_H
+#define VIRTUAL_STACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "SentinelAssert.h"
+
+namespace sentinel
+{
+
+/**
+ * A stack allocator over a reserved range of virtual memory. The whole
+ * range is reserved up front but pages are only committed as the marker
+ * advances past them, so a stack can be sized generously and only costs
+ * RSS for what it has actually touched.
+ *
+ * On clear(), anything committed above decommit_watermark_bytes is given
+ * back to the OS (0 keeps everything committed). Huge pages are only a
+ * hint: transparent huge pages on linux, ignored elsewhere.
+ */
+class VirtualStack
+{
+public:
+	VirtualStack(std::size_t reserve_size_bytes=(256 * 1024 * 1024),
+		std::size_t decommit_watermark_bytes=0, bool huge_pages=false);
+	VirtualStack(const VirtualStack& other)              = delete;
+	VirtualStack& operator = (const VirtualStack& other) = delete;
+	~VirtualStack();
+
+	std::size_t getReservedSize();
+	std::size_t getCommittedSize();
+	std::size_t getUsedBytes();
+
+	void* getStackPtr();
+	void* alloc(std::size_t size_bytes);
+	void* allocAligned(std::size_t size_bytes, std::size_t alignment);
+
+	void freeTo(void* marker);
+	void freeToAligned(void* marker);
+	void clear();
+
+private:
+	bool commitTo(uintptr_t new_marker);
+	void decommitAbove(uintptr_t keep_top);
+
+	void* m_reservation; //what the OS gave us, may start before m_stack_bottom
+	std::size_t m_reservation_size;
+
+	std::size_t m_reserved_size;
+	std::size_t m_commit_granularity;
+	std::size_t m_decommit_watermark;
+	uintptr_t m_stack_bottom;
+	uintptr_t m_stack_top;
+	uintptr_t m_stack_marker;
+	uintptr_t m_committed_top;
+
+	typedef std::mutex MutexT;
+	typedef std::unique_lock<MutexT> LockT;
+
+	MutexT m_mut;
+};
+
+} //namespace sentinel
+
+#endif //VIRTUAL_STACK_H
@@ -0,0 +1,211 @@
+#ifndef WORK_STEALING_DEQUE_H
+#define WORK_STEALING_DEQUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "SentinelAssert.h"
+
+namespace sentinel
+{
+
+/**
+ * A Chase-Lev work stealing deque of pointers (Le, Pop, Cohen, Zappa
+ * Nardelli, "Correct and Efficient Work-Stealing for Weak Memory Models").
+ * One owner thread pushes and pops at the bottom, LIFO, with no atomic
+ * read-modify-write unless it races a thief for the last item. Any
+ * thread can steal from the top, FIFO, with a single CAS.
+ *
+ * The ring grows when full (only the owner pushes, so only the owner
+ * grows it). Thieves may still be reading an old ring, so replaced rings
+ * are kept until the deque is destroyed.
+ */
+template <typename T>
+class WorkStealingDeque
+{
+	static_assert(std::is_pointer<T>::value, "WorkStealingDeque holds pointers, nullptr means empty");
+
+public:
+	WorkStealingDeque(std::size_t capacity=1024);
+	WorkStealingDeque(const WorkStealingDeque& other)              = delete;
+	WorkStealingDeque& operator = (const WorkStealingDeque& other) = delete;
+	~WorkStealingDeque();
+
+	void push(T item);
+	T pop();
+	T steal();
+
+	std::size_t getSize(); //only a hint while other threads are using it
+
+private:
+	struct Ring
+	{
+		explicit Ring(std::int64_t capacity) :
+			m_capacity(capacity),
+			m_mask(capacity - 1),
+			m_items(new std::atomic<T>[capacity]),
+			m_retired(nullptr)
+		{
+		}
+
+		~Ring()
+		{
+			delete[] m_items;
+		}
+
+		T get(std::int64_t i)
+		{
+			return m_items[i & m_mask].load(std::memory_order_relaxed);
+		}
+
+		void put(std::int64_t i, T item)
+		{
+			m_items[i & m_mask].store(item, std::memory_order_relaxed);
+		}
+
+		std::int64_t m_capacity;
+		std::int64_t m_mask;
+		std::atomic<T>* m_items;
+		Ring* m_retired; //the ring this one replaced
+	};
+
+	Ring* grow(Ring* ring, std::int64_t top, std::int64_t bottom);
+
+	//top is hammered by thieves, keep it off the owner's line
+	alignas(64) std::atomic<std::int64_t> m_top;
+	alignas(64) std::atomic<std::int64_t> m_bottom;
+	std::atomic<Ring*> m_ring;
+};
+
+/**
+ * ctor
+ *
+ * @param (optional) capacity: starting size of the ring, a pwr of 2
+ */
+template <typename T>
+WorkStealingDeque<T>::WorkStealingDeque(std::size_t capacity) :
+	m_top(0),
+	m_bottom(0),
+	m_ring(new Ring(static_cast<std::int64_t>(capacity)))
+{
+	S_ASSERT(capacity > 0 && (capacity & (capacity - 1)) == 0, "capacity must be a pwr of 2");
+}
+
+template <typename T>
+WorkStealingDeque<T>::~WorkStealingDeque()
+{
+	Ring* ring = m_ring.load(std::memory_order_relaxed);
+	while (ring)
+	{
+		Ring* retired = ring->m_retired;
+		delete ring;
+		ring = retired;
+	}
+}
+
+/**
+ * pushes onto the bottom, owner thread only
+ *
+ * @param item: the item to push (not nullptr)
+ */
+template <typename T>
+void WorkStealingDeque<T>::push(T item)
+{
+	std::int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+	std::int64_t top = m_top.load(std::memory_order_acquire);
+	Ring* ring = m_ring.load(std::memory_order_relaxed);
+
+	if (bottom - top > ring->m_capacity - 1)
+		ring = grow(ring, top, bottom);
+
+	ring->put(bottom, item);
+	m_bottom.store(bottom + 1, std::memory_order_release); //publishes the item to thieves
+}
+
+/**
+ * pops from the bottom, owner thread only
+ *
+ * @returns the most recently pushed item (nullptr if empty)
+ */
+template <typename T>
+T WorkStealingDeque<T>::pop()
+{
+	std::int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+	Ring* ring = m_ring.load(std::memory_order_relaxed);
+	m_bottom.store(bottom, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	std::int64_t top = m_top.load(std::memory_order_relaxed);
+
+	if (top > bottom)
+	{
+		m_bottom.store(bottom + 1, std::memory_order_relaxed); //was empty
+		return nullptr;
+	}
+
+	T item = ring->get(bottom);
+	if (top == bottom)
+	{
+		//last item, race any thieves for it
+		if (!m_top.compare_exchange_strong(top, top + 1,
+			std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			item = nullptr;
+		}
+		m_bottom.store(bottom + 1, std::memory_order_relaxed);
+	}
+	return item;
+}
+
+/**
+ * steals from the top, any thread
+ *
+ * @returns the oldest item (nullptr if empty, or another thread got it first)
+ */
+template <typename T>
+T WorkStealingDeque<T>::steal()
+{
+	std::int64_t top = m_top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	std::int64_t bottom = m_bottom.load(std::memory_order_acquire);
+
+	if (top >= bottom)
+		return nullptr;
+
+	Ring* ring = m_ring.load(std::memory_order_acquire);
+	T item = ring->get(top);
+	if (!m_top.compare_exchange_strong(top, top + 1,
+		std::memory_order_seq_cst, std::memory_order_relaxed))
+	{
+		return nullptr;
+	}
+	return item;
+}
+
+template <typename T>
+std::size_t WorkStealingDeque<T>::getSize()
+{
+	std::int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+	std::int64_t top = m_top.load(std::memory_order_relaxed);
+	return (bottom > top) ? static_cast<std::size_t>(bottom - top) : 0;
+}
+
+/**
+ * copies the live items into a ring twice the size and publishes it
+ */
+template <typename T>
+typename WorkStealingDeque<T>::Ring* WorkStealingDeque<T>::grow(Ring* ring, std::int64_t top, std::int64_t bottom)
+{
+	Ring* grown = new Ring(ring->m_capacity * 2);
+	for (std::int64_t i = top; i < bottom; i++)
+		grown->put(i, ring->get(i));
+
+	grown->m_retired = ring;
+	m_ring.store(grown, std::memory_order_release);
+	return grown;
+}
+
+} //namespace sentinel
+
+#endif //WORK_STEALING_DEQUE_H
@@ -0,0 +1,175 @@
+#ifndef XX_HASH_H
+#define XX_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace sentinel
+{
+
+/*
+ * XXH64 (https://github.com/Cyan4973/xxHash, xxhash_spec.md). The output
+ * is fixed by the spec, not by the compiler or standard library, so
+ * hashes can be written to disk and compared across builds and runs.
+ *
+ * Input is consumed as four independent 8 byte lanes per 32 byte stripe,
+ * which the CPU runs in parallel. xxHash64() is constexpr and reads a
+ * byte at a time, xxHash64Fast() gives the same result with unaligned
+ * word loads, use it at runtime.
+ */
+namespace xxh
+{
+	constexpr std::uint64_t PRIME_1 = 0x9E3779B185EBCA87ULL;
+	constexpr std::uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+	constexpr std::uint64_t PRIME_3 = 0x165667B19E3779F9ULL;
+	constexpr std::uint64_t PRIME_4 = 0x85EBCA77C2B2AE63ULL;
+	constexpr std::uint64_t PRIME_5 = 0x27D4EB2F165667C5ULL;
+
+	constexpr std::uint64_t rotl(std::uint64_t x, int r)
+	{
+		return (x << r) | (x >> (64 - r));
+	}
+
+	constexpr std::uint64_t round(std::uint64_t acc, std::uint64_t input)
+	{
+		acc += input * PRIME_2;
+		acc = rotl(acc, 31);
+		return acc * PRIME_1;
+	}
+
+	constexpr std::uint64_t mergeRound(std::uint64_t acc, std::uint64_t val)
+	{
+		acc ^= round(0, val);
+		return acc * PRIME_1 + PRIME_4;
+	}
+
+	//little endian loads, a byte at a time so they work in constant expressions
+	struct ByteReader
+	{
+		static constexpr std::uint64_t read64(const char* p)
+		{
+			std::uint64_t v = 0;
+			for (int i = 7; i >= 0; i--)
+				v = (v << 8) | static_cast<unsigned char>(p[i]);
+			return v;
+		}
+
+		static constexpr std::uint32_t read32(const char* p)
+		{
+			std::uint32_t v = 0;
+			for (int i = 3; i >= 0; i--)
+				v = (v << 8) | static_cast<unsigned char>(p[i]);
+			return v;
+		}
+	};
+
+	//unaligned word loads, only right on little endian targets
+	struct WordReader
+	{
+		static std::uint64_t read64(const char* p)
+		{
+			std::uint64_t v;
+			std::memcpy(&v, p, sizeof(v));
+			return v;
+		}
+
+		static std::uint32_t read32(const char* p)
+		{
+			std::uint32_t v;
+			std::memcpy(&v, p, sizeof(v));
+			return v;
+		}
+	};
+
+	template <typename ReaderT>
+	constexpr std::uint64_t hash64(const char* p, std::size_t len, std::uint64_t seed)
+	{
+		const char* const end = p + len;
+		std::uint64_t h = 0;
+
+		if (len >= 32)
+		{
+			std::uint64_t v1 = seed + PRIME_1 + PRIME_2;
+			std::uint64_t v2 = seed + PRIME_2;
+			std::uint64_t v3 = seed;
+			std::uint64_t v4 = seed - PRIME_1;
+
+			const char* const limit = end - 32;
+			do
+			{
+				v1 = round(v1, ReaderT::read64(p));
+				v2 = round(v2, ReaderT::read64(p + 8));
+				v3 = round(v3, ReaderT::read64(p + 16));
+				v4 = round(v4, ReaderT::read64(p + 24));
+				p += 32;
+			} while (p <= limit);
+
+			h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+			h = mergeRound(h, v1);
+			h = mergeRound(h, v2);
+			h = mergeRound(h, v3);
+			h = mergeRound(h, v4);
+		}
+		else
+		{
+			h = seed + PRIME_5;
+		}
+
+		h += static_cast<std::uint64_t>(len);
+
+		for (; p + 8 <= end; p += 8)
+		{
+			h ^= round(0, ReaderT::read64(p));
+			h = rotl(h, 27) * PRIME_1 + PRIME_4;
+		}
+		if (p + 4 <= end)
+		{
+			h ^= static_cast<std::uint64_t>(ReaderT::read32(p)) * PRIME_1;
+			h = rotl(h, 23) * PRIME_2 + PRIME_3;
+			p += 4;
+		}
+		for (; p < end; p++)
+		{
+			h ^= static_cast<unsigned char>(*p) * PRIME_5;
+			h = rotl(h, 11) * PRIME_1;
+		}
+
+		//avalanche
+		h ^= h >> 33;
+		h *= PRIME_2;
+		h ^= h >> 29;
+		h *= PRIME_3;
+		h ^= h >> 32;
+		return h;
+	}
+} //namespace xxh
+
+/**
+ * XXH64 of a string, usable in constant expressions
+ *
+ * @param str: the chars to hash
+ * @param len: number of chars
+ * @param (optional) seed: hash seed (default is 0)
+ * @returns the 64 bit hash
+ */
+constexpr std::uint64_t xxHash64(const char* str, std::size_t len, std::uint64_t seed=0)
+{
+	return xxh::hash64<xxh::ByteReader>(str, len, seed);
+}
+
+/**
+ * same result as xxHash64(), faster at runtime
+ */
+inline std::uint64_t xxHash64Fast(const char* str, std::size_t len, std::uint64_t seed=0)
+{
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	return xxh::hash64<xxh::ByteReader>(str, len, seed);
+#else
+	return xxh::hash64<xxh::WordReader>(str, len, seed);
+#endif
+}
+
+} //namespace sentinel
+
+#endif //XX_HASH_H
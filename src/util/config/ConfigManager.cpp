@@ -3,9 +3,6 @@
 namespace sentinel
 {
 
-StrId ConfigManager::m_engine_cfg_path_sid = INTERN_STR("engine.cfg");
-StrId ConfigManager::m_user_cfg_path_sid = INTERN_STR("user.cfg");
-
 std::size_t ConfigManager::CFG_BUF_SIZE = 10240; //10kB should be enough
 
 /**
@@ -19,8 +16,8 @@ void ConfigManager::startUp(int argc, const char** argv, IoManager& io_manager,
 	char* engine_cfg_read_buf = (char*) frame_allocator.alloc(CFG_BUF_SIZE);
 	char* user_cfg_read_buf = (char*) frame_allocator.alloc(CFG_BUF_SIZE);
 
-	FileHandle engine_cfg_f = io_manager.openFile(STR(m_engine_cfg_path_sid));
-	FileHandle user_cfg_f = io_manager.openFile(STR(m_user_cfg_path_sid));
+	FileHandle engine_cfg_f = io_manager.openFile(ENGINE_CFG_PATH);
+	FileHandle user_cfg_f = io_manager.openFile(USER_CFG_PATH);
 
 	AsyncJobHandle engine_cfg_read = io_manager.asyncRead(
             engine_cfg_f, engine_cfg_read_buf, CFG_BUF_SIZE, 
@@ -55,8 +52,8 @@ void ConfigManager::shutDown(IoManager& io_manager, DbFrameAllocator& frame_allo
 	char* engine_cfg_write_buf = (char*)frame_allocator.alloc(CFG_BUF_SIZE);
 	char* user_cfg_write_buf = (char*)frame_allocator.alloc(CFG_BUF_SIZE);
 
-	FileHandle engine_cfg_f = io_manager.openFile(STR(m_engine_cfg_path_sid), true);
-	FileHandle user_cfg_f = io_manager.openFile(STR(m_user_cfg_path_sid), true);
+	FileHandle engine_cfg_f = io_manager.openFile(ENGINE_CFG_PATH, true);
+	FileHandle user_cfg_f = io_manager.openFile(USER_CFG_PATH, true);
 
 	//serialize to buffers
     int user_svar_count = 0;
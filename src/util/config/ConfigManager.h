@@ -30,9 +30,8 @@ private:
 
 	std::map<StrId, SVar> m_svars;
 
-    //interned strings we'll need for faster parse
-	static StrId m_engine_cfg_path_sid;
-	static StrId m_user_cfg_path_sid;
+	static constexpr const char* ENGINE_CFG_PATH = "engine.cfg";
+	static constexpr const char* USER_CFG_PATH = "user.cfg";
 
     static std::size_t CFG_BUF_SIZE;
 };
@@ -88,7 +88,7 @@ bool SVar::hasFlag(SVarFlag flag)
 void SVar::serialize(char* buffer)
 {
     //serialize name
-    const std::string& name = STR(m_name_sid);
+    std::string_view name = STR(m_name_sid);
     S_ASSERT( (name.length() < (SVAR_MAX_STR_LEN - 1)),
             "max str len exceed for SVar name value");
     STR(m_name_sid).copy(buffer, (SVAR_MAX_STR_LEN - 1), 0);
@@ -107,7 +107,7 @@ void SVar::serialize(char* buffer)
         S_ASSERT(STR(m_name_sid).length() < (SVAR_MAX_STR_LEN - 1),
                 "max str len exceed for SVar str value field");
 
-        std::string str_val = STR(getStrIdVal());
+        std::string_view str_val = STR(getStrIdVal());
         str_val.copy(buffer + SVAR_MAX_STR_LEN, str_val.length(), 0);
         buffer[SVAR_MAX_STR_LEN+STR(getStrIdVal()).length()] = '\0';
     }
@@ -143,7 +143,7 @@ SVar SVar::deserialize(const char* buffer)
         flag_mask[i] = buffer[(SVAR_MAX_STR_LEN*2) + i];
 
     //now create the SVar
-    StrId name_sid = INTERN_STR(std::string(name));
+    StrId name_sid = INTERN_STR(name);
 
     std::uint32_t flags = *(
             reinterpret_cast<std::uint32_t*>(flag_mask) );
@@ -156,7 +156,7 @@ SVar SVar::deserialize(const char* buffer)
     }
     else
     {
-        StrId sid_val = INTERN_STR(std::string(value));
+        StrId sid_val = INTERN_STR(value);
         return SVar(name_sid, sid_val, flags);
     }
 }
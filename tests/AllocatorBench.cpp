@@ -0,0 +1,93 @@
+/**
+ * Allocator scaling benchmarks. Not a pass/fail test, just prints
+ * throughput so allocators can be compared from 1 to N threads.
+ *
+ * usage: AllocatorBench [max_threads] [iterations_per_thread]
+ */
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "LockFreePool.h"
+#include "MagazinePool.h"
+#include "MemoryPool.h"
+
+namespace s_bench
+{
+
+using namespace sentinel;
+
+static const std::size_t ITEM_SIZE = 64;
+static const std::size_t BATCH = 16; //blocks each thread holds at once
+
+/*
+ * every thread repeatedly allocs a batch of blocks then frees them.
+ *
+ * @returns millions of alloc+free pairs per second
+ */
+template<typename PoolT>
+double runPoolBench(PoolT& pool, std::size_t num_threads, std::size_t iterations)
+{
+	std::vector<std::thread> threads;
+	auto start = std::chrono::steady_clock::now();
+
+	for (std::size_t t = 0; t < num_threads; t++)
+	{
+		threads.emplace_back([&pool, iterations]()
+		{
+			void* held[BATCH];
+			for (std::size_t i = 0; i < iterations; i++)
+			{
+				for (std::size_t j = 0; j < BATCH; j++)
+					held[j] = pool.alloc();
+				for (std::size_t j = 0; j < BATCH; j++)
+					pool.freeBlock(held[j]);
+			}
+		});
+	}
+	for (std::thread& t : threads)
+		t.join();
+
+	std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+	double pairs = static_cast<double>(num_threads * iterations * BATCH);
+	return (pairs / secs.count()) / 1e6;
+}
+
+void benchPools(std::size_t max_threads, std::size_t iterations)
+{
+	printf("pool alloc+free pairs, %zu byte items (Mops/s)\n", ITEM_SIZE);
+	printf("%8s %14s %14s %14s\n", "threads", "MemoryPool", "LockFreePool", "MagazinePool");
+
+	for (std::size_t n = 1; n <= max_threads; n++)
+	{
+		MemoryPool mutex_pool(ITEM_SIZE, n * BATCH);
+		LockFreePool lock_free_pool(ITEM_SIZE, n * BATCH);
+		MagazinePool magazine_pool(ITEM_SIZE, n * BATCH);
+
+		double mutex_rate = runPoolBench(mutex_pool, n, iterations);
+		double lock_free_rate = runPoolBench(lock_free_pool, n, iterations);
+		double magazine_rate = runPoolBench(magazine_pool, n, iterations);
+		printf("%8zu %14.2f %14.2f %14.2f\n", n, mutex_rate, lock_free_rate, magazine_rate);
+	}
+}
+
+} //namespace s_bench
+
+int main(int argc, char* argv[])
+{
+	std::size_t max_threads = std::thread::hardware_concurrency();
+	std::size_t iterations = 100000;
+	if (argc > 1)
+		max_threads = std::strtoul(argv[1], nullptr, 10);
+	if (argc > 2)
+		iterations = std::strtoul(argv[2], nullptr, 10);
+	if (max_threads == 0)
+		max_threads = 4;
+
+	s_bench::benchPools(max_threads, iterations);
+	return 0;
+}
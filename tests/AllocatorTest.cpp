@@ -1,14 +1,36 @@
 #define CATCH_CONFIG_MAIN
 
+#include <atomic>
 #include <iostream>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory_resource>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include "catch.hpp"
+#include "AllocatorStats.h"
 #include "MemoryPool.h"
 #include "DbFrameAllocator.h"
+#include "DoubleEndedStack.h"
+#include "HandleHeap.h"
+#include "HandlePool.h"
+#include "LockFreePool.h"
+#include "MagazinePool.h"
+#include "ObjectPool.h"
 #include "SentinelAssert.h"
+#include "SmallObjectAllocator.h"
+#include "StlAllocators.h"
+#include "ThreadPool.h"
+#include "ThreadLocalStack.h"
+#include "TlsfHeap.h"
+#include "VirtualStack.h"
 
 
 namespace s_test
@@ -24,7 +46,8 @@ using namespace sentinel;
 * @param pool: the pool to allocate to
 * @param aligned: true if allocating aligned, else false
 */
-void poolAllocSome(std::vector<void*>& arr, MemoryPool& pool, bool aligned)
+template<typename PoolT>
+void poolAllocSome(std::vector<void*>& arr, PoolT& pool, bool aligned)
 {
 	for (auto iter = arr.begin(); iter < arr.end(); iter++)
 	{
@@ -45,7 +68,8 @@ void poolAllocSome(std::vector<void*>& arr, MemoryPool& pool, bool aligned)
 * @param pool: the pool to use
 * @param aligned: true if aligned, false otherwise
 */
-void poolDeallocSome(std::vector<void*>& arr, MemoryPool& pool, bool aligned)
+template<typename PoolT>
+void poolDeallocSome(std::vector<void*>& arr, PoolT& pool, bool aligned)
 {
 	for (auto iter = arr.begin(); iter < arr.end(); iter++)
 	{
@@ -102,6 +126,100 @@ void* stackAlloc100(DbFrameAllocator& frame, bool aligned)
 	return t;
 }
 
+TEST_CASE("allocator statistics and the live allocator registry")
+{
+	SECTION("counters, peaks and the size histogram")
+	{
+		AllocatorStats stats("test stats");
+		stats.recordAlloc(16);
+		stats.recordAlloc(100);
+		stats.recordFree(16);
+		stats.recordFailedAlloc(1 << 20);
+		stats.recordFrame(300);
+		stats.recordFrame(200);
+
+		AllocatorStatsSnapshot snap = stats.snapshot();
+		REQUIRE(snap.m_current_bytes == 100);
+		REQUIRE(snap.m_peak_bytes == 116);
+		REQUIRE(snap.m_num_allocs == 2);
+		REQUIRE(snap.m_num_frees == 1);
+		REQUIRE(snap.m_num_failed_allocs == 1);
+		REQUIRE(snap.m_last_frame_peak_bytes == 200);
+		REQUIRE(snap.m_max_frame_peak_bytes == 300);
+		REQUIRE(snap.m_size_histogram[0] == 1); //16
+		REQUIRE(snap.m_size_histogram[3] == 1); //100 is in (64, 128]
+		REQUIRE(snap.m_size_histogram[AllocatorStatsSnapshot::NUM_HISTOGRAM_BUCKETS - 1] == 1);
+	}
+
+	SECTION("every live allocator shows up in snapshotAll() and the JSON dump")
+	{
+		auto countNamed = [](const char* name)
+		{
+			int count = 0;
+			for (const AllocatorStatsSnapshot& snap : AllocatorStats::snapshotAll())
+				count += (std::strcmp(snap.m_name, name) == 0);
+			return count;
+		};
+
+		{
+			AllocatorStats a("registry test");
+			AllocatorStats b("registry test");
+			REQUIRE(countNamed("registry test") == 2);
+
+			std::string json = AllocatorStats::toJson({ a.snapshot() });
+			REQUIRE(json.find("\"name\": \"registry test\"") != std::string::npos);
+			REQUIRE(json.find("\"size_histogram\": [") != std::string::npos);
+		}
+		REQUIRE(countNamed("registry test") == 0);
+	}
+
+	SECTION("moving stats hands the counts over instead of copying them")
+	{
+		AllocatorStats source("move test");
+		source.recordAlloc(64);
+		AllocatorStats moved(std::move(source));
+
+		std::size_t total_allocs = 0;
+		for (const AllocatorStatsSnapshot& snap : AllocatorStats::snapshotAll())
+		{
+			if (std::strcmp(snap.m_name, "move test") == 0)
+				total_allocs += snap.m_num_allocs;
+		}
+		REQUIRE(total_allocs == 1);
+		REQUIRE(moved.snapshot().m_current_bytes == 64);
+		REQUIRE(source.snapshot().m_current_bytes == 0);
+	}
+
+#ifdef ALLOCATOR_STATS_ENABLED
+	SECTION("pools, stacks and frames feed their stats")
+	{
+		MemoryPool pool(32, 4);
+		void* blocks[5];
+		for (void*& block : blocks)
+			block = pool.alloc();
+		pool.freeBlock(blocks[0]);
+		AllocatorStatsSnapshot pool_snap = pool.getStats().snapshot();
+		REQUIRE(pool_snap.m_num_allocs == 4);
+		REQUIRE(pool_snap.m_num_failed_allocs == 1);
+		REQUIRE(pool_snap.m_current_bytes == 3 * 32);
+		REQUIRE(pool_snap.m_peak_bytes == 4 * 32);
+
+		MemoryStack stack(1024);
+		stack.alloc(100);
+		stack.clear();
+		REQUIRE(stack.getStats().snapshot().m_peak_bytes == 100);
+		REQUIRE(stack.getStats().snapshot().m_current_bytes == 0);
+
+		DbFrameAllocator frame(128);
+		frame.alloc(100);
+		frame.alloc(100); //overflows
+		frame.clearCurrentBuffer();
+		REQUIRE(frame.getStats().snapshot().m_num_failed_allocs == 1);
+		REQUIRE(frame.getStats().snapshot().m_max_frame_peak_bytes >= 200);
+	}
+#endif //ALLOCATOR_STATS_ENABLED
+}
+
 TEST_CASE("various allocation tests on various pools of different item sizes")
 {
 	std::vector<void*> pool_allocs_first(5);
@@ -163,6 +281,346 @@ TEST_CASE("various allocation tests on various pools of different item sizes")
 	}
 }
 
+TEST_CASE("growable pools chain slabs instead of running dry")
+{
+	MemoryPool pool(sizeof(uintptr_t) * 2, 4, true);
+	std::vector<void*> allocs(10);
+
+	SECTION("allocating past capacity chains more slabs")
+	{
+		poolAllocSome(allocs, pool, false);
+		for (void* p : allocs)
+			REQUIRE(p != nullptr);
+		REQUIRE(pool.getNumSlabs() == 3);
+
+		//still LIFO across slabs
+		std::vector<void*> allocs_second(10);
+		poolDeallocSome(allocs, pool, false);
+		poolAllocSome(allocs_second, pool, false);
+		REQUIRE(poolValidateAlloc(allocs, allocs_second));
+		poolDeallocSome(allocs_second, pool, false);
+	}
+
+	SECTION("only fully free slabs go back to the OS")
+	{
+		poolAllocSome(allocs, pool, false);
+		poolDeallocSome(allocs, pool, false);
+		REQUIRE(pool.releaseEmptySlabs() == 2);
+		REQUIRE(pool.getNumSlabs() == 1);
+
+		//what's left of the free list is still usable
+		std::vector<void*> allocs_second(6);
+		poolAllocSome(allocs_second, pool, false);
+		for (void* p : allocs_second)
+			REQUIRE(p != nullptr);
+		REQUIRE(pool.releaseEmptySlabs() == 0);
+		REQUIRE(pool.getNumSlabs() == 2);
+		poolDeallocSome(allocs_second, pool, false);
+	}
+}
+
+TEST_CASE("lock free pool allocations")
+{
+	std::vector<void*> pool_allocs_first(5);
+	std::vector<void*> pool_allocs_second(5);
+	LockFreePool pool(sizeof(uintptr_t) * 2, 64);
+
+	SECTION("single threaded, same LIFO order as MemoryPool")
+	{
+		poolAllocSome(pool_allocs_first, pool, false);
+		poolDeallocSome(pool_allocs_first, pool, false);
+		poolAllocSome(pool_allocs_second, pool, false);
+		poolDeallocSome(pool_allocs_second, pool, false);
+
+		REQUIRE(poolValidateAlloc(pool_allocs_first, pool_allocs_second));
+	}
+
+	SECTION("aligned allocations")
+	{
+		poolAllocSome(pool_allocs_first, pool, true);
+		poolDeallocSome(pool_allocs_first, pool, true);
+		poolAllocSome(pool_allocs_second, pool, true);
+		poolDeallocSome(pool_allocs_second, pool, true);
+
+		REQUIRE(poolValidateAlloc(pool_allocs_first, pool_allocs_second));
+	}
+
+	SECTION("exhausting the pool returns nullptr")
+	{
+		std::vector<void*> all(64);
+		poolAllocSome(all, pool, false);
+		REQUIRE(pool.alloc() == nullptr);
+		poolDeallocSome(all, pool, false);
+		REQUIRE(pool.alloc() != nullptr);
+	}
+
+	SECTION("a growable pool keeps handing out distinct blocks")
+	{
+		LockFreePool growable(sizeof(uintptr_t) * 2, 8, true);
+		std::vector<void*> allocs(100);
+		poolAllocSome(allocs, growable, false);
+
+		std::set<void*> unique(allocs.begin(), allocs.end());
+		REQUIRE(unique.count(nullptr) == 0);
+		REQUIRE(unique.size() == allocs.size());
+		REQUIRE(growable.getNumSlabs() > 1);
+		for (std::size_t i = 0; i < allocs.size(); i++)
+			REQUIRE(growable.getBlock(growable.getBlockIndex(allocs[i])) == allocs[i]);
+
+		poolDeallocSome(allocs, growable, false);
+	}
+
+	SECTION("concurrent alloc/free never hands a block out twice")
+	{
+		const int num_threads = 4;
+		std::vector<std::vector<void*>> held(num_threads, std::vector<void*>(16));
+		std::vector<std::thread> threads;
+
+		for (int i = 0; i < num_threads; i++)
+		{
+			threads.emplace_back([&pool, &held, i]()
+			{
+				for (int j = 0; j < 1000; j++)
+				{
+					poolAllocSome(held[i], pool, false);
+					poolDeallocSome(held[i], pool, false);
+				}
+				poolAllocSome(held[i], pool, false);
+			});
+		}
+		for (std::thread& t : threads)
+			t.join();
+
+		std::set<void*> unique;
+		for (std::vector<void*>& v : held)
+		{
+			for (void* p : v)
+			{
+				REQUIRE(p != nullptr);
+				unique.insert(p);
+			}
+		}
+		REQUIRE(unique.size() == num_threads * 16);
+	}
+}
+
+TEST_CASE("magazine pool allocations across threads")
+{
+	MagazinePool pool(sizeof(uintptr_t) * 4, 32, 8);
+
+	SECTION("a thread gets back what it just freed")
+	{
+		void* p = pool.alloc();
+		REQUIRE(p != nullptr);
+		pool.freeBlock(p);
+		REQUIRE(pool.alloc() == p);
+	}
+
+	SECTION("blocks allocated on one thread and freed on another")
+	{
+		std::vector<void*> allocs(200);
+		poolAllocSome(allocs, pool, false);
+
+		//free everything on a worker, like a finished ThreadPool job
+		std::thread worker([&pool, &allocs]()
+		{
+			poolDeallocSome(allocs, pool, false);
+		});
+		worker.join();
+
+		//live blocks must never be handed out twice
+		std::vector<void*> allocs_second(400);
+		poolAllocSome(allocs_second, pool, false);
+		std::set<void*> unique(allocs_second.begin(), allocs_second.end());
+		REQUIRE(unique.count(nullptr) == 0);
+		REQUIRE(unique.size() == allocs_second.size());
+
+		//some of them came back through the depot from the worker
+		std::size_t reused = 0;
+		for (void* p : allocs)
+			reused += unique.count(p);
+		REQUIRE(reused > 0);
+
+		poolDeallocSome(allocs_second, pool, false);
+		pool.flushThreadCache();
+	}
+}
+
+TEST_CASE("generational handles from a handle pool")
+{
+	HandlePool pool(sizeof(std::uint64_t), 16);
+
+	SECTION("live handles resolve to their slot")
+	{
+		PoolHandle a = pool.alloc();
+		PoolHandle b = pool.alloc();
+		REQUIRE(a != NULL_POOL_HANDLE);
+		REQUIRE(b != NULL_POOL_HANDLE);
+		REQUIRE(pool.isValid(a));
+		REQUIRE(pool.get(a) != pool.get(b));
+
+		*reinterpret_cast<std::uint64_t*>(pool.get(a)) = 42;
+		REQUIRE(*reinterpret_cast<std::uint64_t*>(pool.get(a)) == 42);
+		REQUIRE(pool.isValid(NULL_POOL_HANDLE) == false);
+		REQUIRE(pool.get(NULL_POOL_HANDLE) == nullptr);
+	}
+
+	SECTION("freed handles go stale, even once their slot is reused")
+	{
+		PoolHandle old_handle = pool.alloc();
+		REQUIRE(pool.freeHandle(old_handle));
+		REQUIRE(pool.isValid(old_handle) == false);
+		REQUIRE(pool.get(old_handle) == nullptr);
+
+		PoolHandle new_handle = pool.alloc();
+		REQUIRE(HandlePool::getIndex(new_handle) == HandlePool::getIndex(old_handle));
+		REQUIRE(HandlePool::getGeneration(new_handle) != HandlePool::getGeneration(old_handle));
+		REQUIRE(pool.isValid(new_handle));
+		REQUIRE(pool.isValid(old_handle) == false);
+	}
+
+	SECTION("exhausting the pool returns NULL_POOL_HANDLE")
+	{
+		for (int i = 0; i < 16; i++)
+			REQUIRE(pool.alloc() != NULL_POOL_HANDLE);
+		REQUIRE(pool.alloc() == NULL_POOL_HANDLE);
+	}
+
+	SECTION("a growable pool chains on slabs instead of running out")
+	{
+		HandlePool growable(sizeof(std::uint64_t), 16, true);
+		std::vector<PoolHandle> handles;
+		for (std::uint64_t i = 0; i < 1000; i++)
+		{
+			PoolHandle handle = growable.alloc();
+			REQUIRE(handle != NULL_POOL_HANDLE);
+			*reinterpret_cast<std::uint64_t*>(growable.get(handle)) = i;
+			handles.push_back(handle);
+		}
+		REQUIRE(growable.getCapacity() >= 1000);
+
+		//earlier slots didn't move when later slabs were added
+		for (std::uint64_t i = 0; i < handles.size(); i++)
+			REQUIRE(*reinterpret_cast<std::uint64_t*>(growable.get(handles[i])) == i);
+
+		REQUIRE(growable.freeHandle(handles[500]));
+		REQUIRE(growable.isValid(handles[500]) == false);
+		PoolHandle reused = growable.alloc();
+		REQUIRE(HandlePool::getIndex(reused) == HandlePool::getIndex(handles[500]));
+		REQUIRE(growable.isValid(reused));
+	}
+}
+
+struct alignas(32) PooledVec
+{
+	static int s_num_alive;
+
+	float m_v[8];
+	int m_id;
+
+	PooledVec(int id) : m_id(id) { s_num_alive++; }
+	~PooledVec() { s_num_alive--; }
+};
+int PooledVec::s_num_alive = 0;
+
+TEST_CASE("typed object pool construction, iteration and destruction")
+{
+	PooledVec::s_num_alive = 0;
+	ObjectPool<PooledVec, 100>* pool = new ObjectPool<PooledVec, 100>();
+
+	SECTION("objects are constructed in place and over-aligned")
+	{
+		std::vector<PooledVec*> objs;
+		for (int i = 0; i < 100; i++)
+		{
+			PooledVec* obj = pool->create(i);
+			REQUIRE(obj != nullptr);
+			REQUIRE(obj->m_id == i);
+			REQUIRE((reinterpret_cast<uintptr_t>(obj) % alignof(PooledVec)) == 0);
+			objs.push_back(obj);
+		}
+		REQUIRE(pool->create(100) == nullptr);
+		REQUIRE(PooledVec::s_num_alive == 100);
+
+		pool->destroy(objs[42]);
+		REQUIRE(PooledVec::s_num_alive == 99);
+		REQUIRE(pool->create(7) == objs[42]);
+	}
+
+	SECTION("forEach visits only live objects")
+	{
+		std::vector<PooledVec*> objs;
+		for (int i = 0; i < 70; i++)
+			objs.push_back(pool->create(i));
+		for (int i = 0; i < 70; i += 2)
+			pool->destroy(objs[i]);
+
+		int sum = 0;
+		int count = 0;
+		pool->forEach([&sum, &count](PooledVec& v) { sum += v.m_id; count++; });
+		REQUIRE(count == 35);
+		REQUIRE(sum == 35 * 35); //sum of the odd ids below 70
+		REQUIRE(pool->getNumLive() == 35);
+	}
+
+	SECTION("destroyAll destructs everything and frees every block")
+	{
+		for (int i = 0; i < 50; i++)
+			pool->create(i);
+		pool->destroyAll();
+		REQUIRE(PooledVec::s_num_alive == 0);
+		REQUIRE(pool->getNumLive() == 0);
+
+		for (int i = 0; i < 100; i++)
+			REQUIRE(pool->create(i) != nullptr);
+	}
+
+	delete pool;
+	REQUIRE(PooledVec::s_num_alive == 0);
+}
+
+TEST_CASE("size class allocations from the small object allocator")
+{
+	SmallObjectAllocator small_alloc(8);
+
+	SECTION("requests round up to the next size class")
+	{
+		REQUIRE(SmallObjectAllocator::getSizeClassSize(1) == 16);
+		REQUIRE(SmallObjectAllocator::getSizeClassSize(16) == 16);
+		REQUIRE(SmallObjectAllocator::getSizeClassSize(17) == 32);
+		REQUIRE(SmallObjectAllocator::getSizeClassSize(129) == 160);
+		REQUIRE(SmallObjectAllocator::getSizeClassSize(512) == 512);
+		REQUIRE(SmallObjectAllocator::getSizeClassSize(513) == 513);
+	}
+
+	SECTION("every size gets distinct, 16 byte aligned memory")
+	{
+		std::vector<void*> allocs;
+		for (std::size_t size = 1; size <= 600; size += 7)
+		{
+			void* p = small_alloc.alloc(size);
+			REQUIRE(p != nullptr);
+			REQUIRE((reinterpret_cast<uintptr_t>(p) % 16) == 0);
+			memset(p, 0xAB, size);
+			allocs.push_back(p);
+		}
+
+		std::set<void*> unique(allocs.begin(), allocs.end());
+		REQUIRE(unique.size() == allocs.size());
+
+		std::size_t i = 0;
+		for (std::size_t size = 1; size <= 600; size += 7)
+			small_alloc.freeBlock(allocs[i++], size);
+	}
+
+	SECTION("freed blocks are reused by the same size class")
+	{
+		void* p = small_alloc.alloc(40);
+		small_alloc.freeBlock(p, 40);
+		REQUIRE(small_alloc.alloc(33) == p);
+	}
+}
+
 TEST_CASE("various allocation tests on on a stack allocator")
 {
     DbFrameAllocator frame;
@@ -223,4 +681,598 @@ TEST_CASE("various allocation tests on on a stack allocator")
 	}
 }
 
+TEST_CASE("two level segregated fit heap allocations")
+{
+	const std::size_t REGION_SIZE = 1 << 20;
+	std::vector<unsigned char> region(REGION_SIZE);
+	TlsfHeap heap(region.data(), REGION_SIZE);
+	std::size_t initial_free = heap.getFreeBytes();
+	REQUIRE(heap.getNumFreeBlocks() == 1);
+	REQUIRE(heap.getLargestFreeBlock() == initial_free);
+
+	SECTION("random sized allocs freed in random order don't overlap, and coalesce")
+	{
+		std::mt19937 rng(1234);
+		std::vector<std::pair<unsigned char*, std::size_t>> live;
+
+		for (int round = 0; round < 2000; round++)
+		{
+			if (live.empty() || (rng() % 3) != 0)
+			{
+				std::size_t size = 1 + (rng() % 2000);
+				unsigned char* p = static_cast<unsigned char*>(heap.alloc(size));
+				if (!p)
+					continue;
+				REQUIRE((reinterpret_cast<uintptr_t>(p) % TlsfHeap::ALIGN_SIZE) == 0);
+				std::memset(p, static_cast<int>(live.size() & 0xFF), size);
+				live.push_back({ p, size });
+			}
+			else
+			{
+				std::size_t i = rng() % live.size();
+				std::swap(live[i], live.back());
+				heap.freeBlock(live.back().first);
+				live.pop_back();
+			}
+		}
+
+		//everything still holds its own fill pattern
+		for (std::size_t i = 0; i < live.size(); i++)
+		{
+			unsigned char* p = live[i].first;
+			REQUIRE(p[0] == p[live[i].second - 1]);
+		}
+
+		for (auto& block : live)
+			heap.freeBlock(block.first);
+		REQUIRE(heap.getUsedBytes() == 0);
+		REQUIRE(heap.getNumFreeBlocks() == 1);
+		REQUIRE(heap.getFreeBytes() == initial_free);
+		REQUIRE(heap.getFragmentation() == 0.0f);
+	}
+
+	SECTION("aligned allocations")
+	{
+		std::vector<void*> blocks;
+		for (std::size_t alignment = 16; alignment <= 4096; alignment *= 2)
+		{
+			void* p = heap.allocAligned(100, alignment);
+			REQUIRE(p != nullptr);
+			REQUIRE((reinterpret_cast<uintptr_t>(p) % alignment) == 0);
+			blocks.push_back(p);
+		}
+
+		//newest first, so each block merges back through the gap in front of
+		//it rather than having that gap absorbed by an earlier free
+		for (auto it = blocks.rbegin(); it != blocks.rend(); ++it)
+			heap.freeBlock(*it);
+		REQUIRE(heap.getNumFreeBlocks() == 1);
+		REQUIRE(heap.getFreeBytes() == initial_free);
+	}
+
+	SECTION("realloc grows and shrinks in place when it can")
+	{
+		char* p = static_cast<char*>(heap.alloc(100));
+		std::memset(p, 7, 100);
+
+		REQUIRE(heap.realloc(p, 5000) == p); //everything after p is free
+		REQUIRE(p[99] == 7);
+		REQUIRE(heap.getBlockSize(p) >= 5000);
+
+		REQUIRE(heap.realloc(p, 50) == p);
+		REQUIRE(heap.getBlockSize(p) < 100);
+
+		//block the way, then growing has to move
+		void* wall = heap.alloc(64);
+		REQUIRE(wall != nullptr);
+		char* moved = static_cast<char*>(heap.realloc(p, 5000));
+		REQUIRE(moved != p);
+		REQUIRE(moved[49] == 7);
+	}
+
+	SECTION("fragmentation stats and running out")
+	{
+		std::vector<void*> blocks;
+		void* p;
+		while ((p = heap.alloc(1000)) != nullptr)
+			blocks.push_back(p);
+		REQUIRE(heap.getLargestFreeBlock() < 1000);
+
+		//free every other block: lots of free memory, none of it contiguous
+		for (std::size_t i = 0; i < blocks.size(); i += 2)
+			heap.freeBlock(blocks[i]);
+		REQUIRE(heap.getFreeBytes() > 400000);
+		REQUIRE(heap.getLargestFreeBlock() < 2000);
+		REQUIRE(heap.getFragmentation() > 0.99f);
+		REQUIRE(heap.alloc(2000) == nullptr);
+		//searches round up a size class so they never walk a list, the
+		//holes only serve requests a class below their own size
+		REQUIRE(heap.alloc(900) != nullptr);
+	}
+}
+
+TEST_CASE("relocatable handle heap with incremental defragmentation")
+{
+	HandleHeap heap(64 * 1024, 256);
+
+	//fill the heap with blocks tagged by their index
+	std::vector<HeapHandle> handles;
+	HeapHandle h;
+	while ((h = heap.alloc(500)) != NULL_HEAP_HANDLE)
+	{
+		std::memset(heap.get(h), static_cast<int>(handles.size() & 0xFF), 500);
+		handles.push_back(h);
+	}
+	REQUIRE(handles.size() == 64 * 1024 / 512);
+	REQUIRE(heap.getBlockSize(handles[0]) == 512);
+	REQUIRE(heap.getContiguousFreeBytes() == 0);
+
+	//free every other block, the holes aren't usable until defrag
+	for (std::size_t i = 0; i < handles.size(); i += 2)
+	{
+		heap.freeHandle(handles[i]);
+		REQUIRE_FALSE(heap.isValid(handles[i]));
+		REQUIRE(heap.get(handles[i]) == nullptr);
+	}
+	REQUIRE(heap.getFreeBytes() == 32 * 1024);
+	REQUIRE(heap.alloc(4096) == NULL_HEAP_HANDLE);
+
+	auto checkContents = [&]() {
+		for (std::size_t i = 1; i < handles.size(); i += 2)
+		{
+			unsigned char* p = static_cast<unsigned char*>(heap.get(handles[i]));
+			REQUIRE(p != nullptr);
+			REQUIRE(p[0] == (i & 0xFF));
+			REQUIRE(p[499] == (i & 0xFF));
+		}
+	};
+
+	SECTION("bounded defrag steps")
+	{
+		//pin a block near the end, it has to stay put
+		std::size_t pinned_index = handles.size() - 3;
+		void* pinned = heap.pin(handles[pinned_index]);
+		REQUIRE(pinned != nullptr);
+
+		std::size_t total_moved = 0;
+		std::size_t steps = 0;
+		std::size_t moved;
+		do
+		{
+			moved = heap.defrag(2048);
+			REQUIRE(moved <= 2048);
+			total_moved += moved;
+			steps++;
+			checkContents(); //handles always find the data, mid pass too
+		} while (moved > 0);
+		REQUIRE(steps > 4);
+		REQUIRE(total_moved > 0);
+		REQUIRE(heap.get(handles[pinned_index]) == pinned);
+
+		//only the pinned block and the one after it are left above the compacted run
+		REQUIRE(heap.getContiguousFreeBytes() == 64 * 1024 - (handles.size() - 1) * 512);
+		heap.unpin(handles[pinned_index]);
+
+		//with the pin gone the next pass closes the last hole
+		while (heap.defrag(2048) > 0)
+			;
+		REQUIRE(heap.getContiguousFreeBytes() == heap.getFreeBytes());
+		checkContents();
+
+		HeapHandle big = heap.alloc(16 * 1024);
+		REQUIRE(big != NULL_HEAP_HANDLE);
+		REQUIRE(heap.getUsedBytes() == 48 * 1024);
+	}
+
+	SECTION("defrag as a thread pool job")
+	{
+		ThreadPool pool(2);
+
+		//a pinned block can be used while the job runs
+		unsigned char* pinned = static_cast<unsigned char*>(heap.pin(handles[1]));
+		AsyncJobHandle job = heap.defragAsync(pool, 4096);
+		REQUIRE(pinned[0] == 1);
+		pool.wait(job);
+		REQUIRE(heap.get(handles[1]) == pinned);
+		heap.unpin(handles[1]);
+
+		std::size_t jobs = 1;
+		while (heap.getContiguousFreeBytes() != heap.getFreeBytes())
+		{
+			pool.wait(heap.defragAsync(pool, 4096));
+			jobs++;
+		}
+		REQUIRE(jobs > 1);
+		checkContents();
+		REQUIRE(heap.alloc(32 * 1024) != NULL_HEAP_HANDLE);
+	}
+}
+
+TEST_CASE("double ended stack allocations")
+{
+	DoubleEndedStack stack(1024);
+	uintptr_t bottom = reinterpret_cast<uintptr_t>(stack.getLowerStackPtr());
+	uintptr_t top = reinterpret_cast<uintptr_t>(stack.getUpperStackPtr());
+	REQUIRE(top - bottom == 1024);
+
+	SECTION("each end allocates and rolls back independently")
+	{
+		void* lower_marker = stack.getLowerStackPtr();
+		void* upper_marker = stack.getUpperStackPtr();
+
+		char* low = static_cast<char*>(stack.allocLower(100));
+		char* high = static_cast<char*>(stack.allocUpper(100));
+		REQUIRE(reinterpret_cast<uintptr_t>(low) == bottom);
+		REQUIRE(reinterpret_cast<uintptr_t>(high) == top - 100);
+		std::memset(low, 1, 100);
+		std::memset(high, 2, 100);
+		REQUIRE(stack.getFreeBytes() == 1024 - 200);
+
+		stack.freeToUpper(upper_marker);
+		REQUIRE(low[99] == 1);
+		REQUIRE(stack.getFreeBytes() == 1024 - 100);
+
+		stack.freeToLower(lower_marker);
+		REQUIRE(stack.getFreeBytes() == 1024);
+	}
+
+	SECTION("aligned allocations from both ends")
+	{
+		void* low = stack.allocAlignedLower(10, 32);
+		void* high = stack.allocAlignedUpper(10, 32);
+		REQUIRE((reinterpret_cast<uintptr_t>(low) % 32) == 0);
+		REQUIRE((reinterpret_cast<uintptr_t>(high) % 32) == 0);
+
+		stack.freeToAlignedLower(low);
+		REQUIRE(reinterpret_cast<uintptr_t>(stack.getLowerStackPtr()) == bottom);
+	}
+
+	SECTION("the ends can't collide")
+	{
+		REQUIRE(stack.allocLower(600) != nullptr);
+		REQUIRE(stack.allocUpper(500) == nullptr);
+		REQUIRE(stack.allocAlignedUpper(424, 64) == nullptr);
+		REQUIRE(stack.allocUpper(424) != nullptr);
+		REQUIRE(stack.getFreeBytes() == 0);
+		REQUIRE(stack.allocLower(1) == nullptr);
+
+		stack.clear();
+		REQUIRE(stack.getFreeBytes() == 1024);
+	}
+}
+
+TEST_CASE("lazily committed virtual memory stacks")
+{
+	const std::size_t MB = 1024 * 1024;
+
+	SECTION("pages are only committed as the marker advances")
+	{
+		VirtualStack stack(512 * MB);
+		REQUIRE(stack.getReservedSize() >= 512 * MB);
+		REQUIRE(stack.getCommittedSize() == 0);
+
+		char* p = static_cast<char*>(stack.alloc(100));
+		REQUIRE(p != nullptr);
+		p[99] = 1;
+		REQUIRE(stack.getCommittedSize() > 0);
+		REQUIRE(stack.getCommittedSize() < MB);
+
+		char* big = static_cast<char*>(stack.allocAligned(8 * MB, 64));
+		REQUIRE(big != nullptr);
+		REQUIRE((reinterpret_cast<uintptr_t>(big) % 64) == 0);
+		std::memset(big, 0xAB, 8 * MB);
+		REQUIRE(stack.getCommittedSize() >= 8 * MB);
+
+		stack.freeToAligned(big);
+		REQUIRE(stack.getUsedBytes() == 100);
+	}
+
+	SECTION("small stacks can be filled to their whole reservation")
+	{
+		//several alive at once, so a stack reaching past its own reservation
+		//runs into a neighbour's instead of something harmless
+		for (std::size_t reserve : { std::size_t(64 * 1024), std::size_t(100 * 1024) })
+		{
+			std::vector<std::unique_ptr<VirtualStack>> stacks;
+			std::vector<char*> bottoms;
+			for (int i = 0; i < 8; i++)
+				stacks.emplace_back(new VirtualStack(reserve, 4096));
+
+			for (std::size_t i = 0; i < stacks.size(); i++)
+			{
+				std::size_t reserved = stacks[i]->getReservedSize();
+				REQUIRE(reserved >= reserve);
+				char* p = static_cast<char*>(stacks[i]->alloc(reserved));
+				REQUIRE(p != nullptr);
+				std::memset(p, static_cast<int>(i + 1), reserved);
+				REQUIRE(stacks[i]->alloc(1) == nullptr);
+				bottoms.push_back(p);
+			}
+
+			//nobody's fill landed in anybody else's stack
+			for (std::size_t i = 0; i < stacks.size(); i++)
+			{
+				std::size_t reserved = stacks[i]->getReservedSize();
+				REQUIRE(bottoms[i][0] == static_cast<char>(i + 1));
+				REQUIRE(bottoms[i][reserved - 1] == static_cast<char>(i + 1));
+			}
+
+			//decommits everything past the watermark, then commits it again
+			stacks[0]->clear();
+			char* p = static_cast<char*>(stacks[0]->alloc(stacks[0]->getReservedSize()));
+			REQUIRE(p != nullptr);
+			std::memset(p, 0xEF, stacks[0]->getReservedSize());
+		}
+	}
+
+	SECTION("clear() decommits above the watermark")
+	{
+		VirtualStack stack(64 * MB, MB);
+		std::memset(stack.alloc(16 * MB), 1, 16 * MB);
+		stack.clear();
+
+		REQUIRE(stack.getCommittedSize() <= MB);
+		REQUIRE(stack.getUsedBytes() == 0);
+
+		//decommitted memory comes back (zeroed) when reused
+		char* p = static_cast<char*>(stack.alloc(16 * MB));
+		REQUIRE(p != nullptr);
+		p[(16 * MB) - 1] = 2;
+	}
+
+	SECTION("huge page stacks, and running out of reservation")
+	{
+		VirtualStack stack(4 * MB, 0, true);
+		REQUIRE(stack.alloc(3 * MB) != nullptr);
+		REQUIRE(stack.alloc(2 * MB) == nullptr);
+		REQUIRE(stack.alloc(MB) != nullptr);
+	}
+}
+
+TEST_CASE("per-thread allocations on a thread local stack")
+{
+	const std::size_t num_threads = 4;
+	ThreadLocalStack stack(1024, num_threads);
+
+	SECTION("each thread bumps its own slice")
+	{
+		std::vector<uintptr_t> firsts(num_threads);
+		std::vector<uintptr_t> lasts(num_threads);
+		std::vector<std::thread> threads;
+
+		for (std::size_t i = 0; i < num_threads; i++)
+		{
+			threads.emplace_back([&stack, &firsts, &lasts, i]()
+			{
+				firsts[i] = reinterpret_cast<uintptr_t>(stack.alloc(16));
+				for (int j = 0; j < 30; j++)
+					lasts[i] = reinterpret_cast<uintptr_t>(stack.alloc(16));
+			});
+		}
+		for (std::thread& t : threads)
+			t.join();
+
+		//no slice overlaps another
+		for (std::size_t i = 0; i < num_threads; i++)
+		{
+			REQUIRE(firsts[i] != 0);
+			REQUIRE(lasts[i] == firsts[i] + (30 * 16));
+			for (std::size_t j = 0; j < num_threads; j++)
+			{
+				if (i != j)
+					REQUIRE((lasts[i] + 16 <= firsts[j] || lasts[j] + 16 <= firsts[i]));
+			}
+		}
+	}
+
+	SECTION("slice overflow, then clearAll() rolls every slice back")
+	{
+		void* first = stack.alloc(512);
+		REQUIRE(first != nullptr);
+		REQUIRE(stack.alloc(1024) == nullptr);
+
+		stack.clearAll();
+		REQUIRE(stack.getStackPtr() == first);
+
+		void* aligned = stack.allocAligned(24, 32);
+		REQUIRE((reinterpret_cast<uintptr_t>(aligned) % 32) == 0);
+		stack.freeToAligned(aligned);
+		REQUIRE(stack.getStackPtr() == first);
+	}
+
+	SECTION("threads past max_threads get nullptr, exited threads' slices are reused")
+	{
+		ThreadLocalStack small_stack(1024, 2);
+		REQUIRE(small_stack.alloc(16) != nullptr); //this thread takes one slice
+
+		uintptr_t first_thread_alloc = 0;
+		std::thread first([&small_stack, &first_thread_alloc]() {
+			first_thread_alloc = reinterpret_cast<uintptr_t>(small_stack.alloc(16));
+		});
+		first.join();
+		REQUIRE(first_thread_alloc != 0);
+
+		//first has exited, so its slice goes to the next thread, after what it left
+		std::atomic<bool> holding(false);
+		std::atomic<bool> release(false);
+		uintptr_t second_thread_alloc = 0;
+		std::thread second([&small_stack, &second_thread_alloc, &holding, &release]() {
+			second_thread_alloc = reinterpret_cast<uintptr_t>(small_stack.alloc(16));
+			holding = true;
+			while (!release)
+				std::this_thread::yield();
+		});
+		while (!holding)
+			std::this_thread::yield();
+		REQUIRE(second_thread_alloc == first_thread_alloc + 16);
+
+		//both slices belong to live threads now
+		void* third_thread_alloc = &holding;
+		std::thread third([&small_stack, &third_thread_alloc]() {
+			third_thread_alloc = small_stack.alloc(16);
+			small_stack.freeTo(small_stack.getStackPtr()); //a no-op without a slice
+		});
+		third.join();
+		REQUIRE(third_thread_alloc == nullptr);
+
+		release = true;
+		second.join();
+	}
+
+	SECTION("per-thread frame memory from a DbFrameAllocator")
+	{
+		DbFrameAllocator frame(1024, 256, num_threads);
+		void* marker = frame.getThreadStackPtr();
+		REQUIRE(frame.allocThreadLocal(128) == marker);
+
+		void* other_thread_alloc = nullptr;
+		std::thread t([&frame, &other_thread_alloc]() {
+			other_thread_alloc = frame.allocThreadLocal(128);
+		});
+		t.join();
+
+		REQUIRE(other_thread_alloc != nullptr);
+		REQUIRE(other_thread_alloc != marker);
+
+		frame.clearCurrentBuffer();
+		REQUIRE(frame.getThreadStackPtr() == marker);
+	}
+
+	SECTION("without thread slices, per-thread frame memory overflows to the heap")
+	{
+		DbFrameAllocator frame(1024); //max_threads defaults to 0
+		void* p = frame.allocThreadLocal(128);
+		REQUIRE(p != nullptr);
+		std::memset(p, 0, 128);
+
+		void* other_thread_alloc = nullptr;
+		std::thread t([&frame, &other_thread_alloc]() {
+			other_thread_alloc = frame.allocAlignedThreadLocal(64, 16);
+		});
+		t.join();
+		REQUIRE(other_thread_alloc != nullptr);
+		REQUIRE((reinterpret_cast<uintptr_t>(other_thread_alloc) % 16) == 0);
+
+		frame.clearCurrentBuffer();
+		REQUIRE(frame.getHighWaterMark() >= 128 + 64);
+	}
+}
+
+TEST_CASE("N-buffered frame allocation with overflow")
+{
+	SECTION("a frame's data survives until the ring comes back around")
+	{
+		DbFrameAllocator frame(1024, 0, 0, 3);
+		REQUIRE(frame.getNumBuffers() == 3);
+
+		int* first_frame = static_cast<int*>(frame.allocAligned(sizeof(int), alignof(int)));
+		*first_frame = 1234;
+
+		for (int i = 0; i < 2; i++)
+		{
+			frame.swapBuffers();
+			frame.clearCurrentBuffer();
+			void* p = frame.alloc(512);
+			std::memset(p, 0xFF, 512);
+		}
+		REQUIRE(*first_frame == 1234);
+
+		frame.swapBuffers();
+		REQUIRE(frame.getCurrentBuffer() == 0);
+	}
+
+	SECTION("overflowing a frame falls back to the heap and is measured")
+	{
+		DbFrameAllocator frame(256, 128, 2);
+
+		void* in_buffer = frame.alloc(200);
+		void* overflow = frame.alloc(200);
+		REQUIRE(in_buffer != nullptr);
+		REQUIRE(overflow != nullptr);
+		std::memset(overflow, 0, 200);
+		frame.freeTo(overflow); //a no-op, not a crash
+
+		void* aligned = frame.allocAlignedThreadLocal(256, 32);
+		REQUIRE(aligned != nullptr);
+		REQUIRE((reinterpret_cast<uintptr_t>(aligned) % 32) == 0);
+
+		frame.clearCurrentBuffer();
+		REQUIRE(frame.getHighWaterMark() >= 200 + 200 + 256);
+		REQUIRE(frame.alloc(200) == in_buffer);
+	}
+}
+
+TEST_CASE("standard containers on engine allocators")
+{
+	SECTION("a vector on a stack allocator lives inside the stack")
+	{
+		MemoryStack stack(4096);
+		uintptr_t bottom = reinterpret_cast<uintptr_t>(stack.getStackPtr());
+
+		std::vector<int, StackAllocator<int>> vec{StackAllocator<int>(stack)};
+		for (int i = 0; i < 100; i++)
+			vec.push_back(i);
+
+		uintptr_t data = reinterpret_cast<uintptr_t>(vec.data());
+		REQUIRE(data >= bottom);
+		REQUIRE(data < bottom + 4096);
+		REQUIRE(vec[99] == 99);
+	}
+
+	SECTION("a full stack throws std::bad_alloc")
+	{
+		MemoryStack stack(256);
+		std::vector<int, StackAllocator<int>> vec{StackAllocator<int>(stack)};
+		REQUIRE_THROWS_AS(vec.reserve(1024), std::bad_alloc);
+	}
+
+	SECTION("map nodes come from a pool, and go back to it")
+	{
+		MemoryPool pool(64, 16, true);
+		typedef std::pair<const int, int> PairT;
+		std::map<int, int, std::less<int>, PoolAllocator<PairT>> map{PoolAllocator<PairT>(pool)};
+
+		for (int i = 0; i < 64; i++)
+			map[i] = i * 2;
+		REQUIRE(pool.getNumSlabs() > 1);
+		REQUIRE(map[63] == 126);
+
+		map.clear();
+		REQUIRE(pool.releaseEmptySlabs() > 0);
+	}
+
+	SECTION("pmr containers on a frame are freed wholesale with the frame")
+	{
+		DbFrameAllocator frame(4096);
+		FrameMemoryResource resource(frame);
+		void* marker = frame.getStackPtr();
+
+		{
+			std::pmr::vector<double> vec(&resource);
+			for (int i = 0; i < 64; i++)
+				vec.push_back(i);
+			REQUIRE((reinterpret_cast<uintptr_t>(vec.data()) % alignof(double)) == 0);
+		}
+		REQUIRE(frame.getStackPtr() != marker);
+
+		frame.clearCurrentBuffer();
+		REQUIRE(frame.getStackPtr() == marker);
+	}
+
+	SECTION("pmr pool resource sends big blocks upstream")
+	{
+		MemoryPool pool(64, 16, true);
+		PoolMemoryResource resource(pool);
+
+		std::pmr::list<int> list(&resource);
+		for (int i = 0; i < 32; i++)
+			list.push_back(i);
+		REQUIRE(pool.getNumSlabs() > 1);
+
+		std::pmr::vector<int> vec(&resource);
+		vec.resize(1000); //4000 bytes can't fit a 64 byte block
+		REQUIRE(vec.size() == 1000);
+	}
+}
+
 }
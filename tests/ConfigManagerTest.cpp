@@ -70,6 +70,7 @@ TEST_CASE("Try to read/write config files.")
     {
         SVar& loaded_sv1 = conf.getSVar(INTERN_STR("test_svar1"));
         REQUIRE(loaded_sv1.getFloatVal() == 32.0f);
+        REQUIRE(loaded_sv1.getNameStrId() == SID("test_svar1"));
 
         SVar& loaded_sv2 = conf.getSVar(INTERN_STR("test_svar2"));
         REQUIRE(loaded_sv2.getStrIdVal() == INTERN_STR("hello world"));
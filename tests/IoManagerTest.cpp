@@ -1,6 +1,7 @@
 #define CATCH_CONFIG_MAIN
 
 #include <stdlib.h>
+#include <atomic>
 #include <chrono>
 #include <thread>
 #include <cstring>
@@ -10,6 +11,7 @@
 
 #include "catch.hpp"
 #include "IoManager.h"
+#include "Task.h"
 
 namespace s_test
 {
@@ -144,7 +146,76 @@ TEST_CASE("Try IoManager read/writes to disk (muti & single-threaded)")
 
 	}
 
+	SECTION("closing a file while reads on it are still queued")
+	{
+		FileHandle f_closing = io.openFile("test_close_while_reading.txt", true);
+		REQUIRE(f_closing != NULL_FILE_HANDLE);
+
+		const char write_buf[] = "read me before I'm closed\n";
+		FileOpStatus write_status;
+		io.writeFile(f_closing, write_buf, sizeof(write_buf) - 1, write_status);
+		REQUIRE(write_status == IO_SUCCESS);
+
+		//reads either beat the close or fail cleanly, never touch a freed file
+		std::atomic<int> succeeded(0);
+		std::atomic<int> failed(0);
+		std::vector<std::vector<char>> read_bufs(32, std::vector<char>(64));
+		std::vector<AsyncJobHandle> read_jobs;
+		for (std::vector<char>& read_buf : read_bufs)
+		{
+			read_jobs.push_back(io.asyncRead(f_closing, read_buf.data(), read_buf.size(),
+				[&succeeded, &failed](FileOpStatus status, std::size_t /*bytes*/)
+				{
+					if (status == IO_SUCCESS)
+						succeeded++;
+					else
+						failed++;
+				}));
+		}
+		io.closeFile(f_closing);
+
+		for (AsyncJobHandle job : read_jobs)
+			io.waitAsyncIo(job);
+		REQUIRE(succeeded + failed == 32);
+
+		FileOpStatus read_status;
+		char read_buf[64];
+		io.readFile(f_closing, read_buf, sizeof(read_buf), read_status);
+		REQUIRE(read_status == IO_FAILED);
+	}
+
+	io.shutDown();
+}
+
+#ifdef COROUTINES_ENABLED
+static Task<std::string> writeThenRead(IoManager& io, FileHandle file, std::string str)
+{
+	//runs on the io threads, so no REQUIREs in here
+	IoManager::IoResult written = co_await io.write(file, str.c_str(), str.size());
+	if (written.m_status != IO_SUCCESS || written.m_bytes != str.size())
+		co_return "write failed";
+
+	char read_buf[1024];
+	IoManager::IoResult read = co_await io.read(file, read_buf, sizeof(read_buf));
+	if (read.m_status != IO_SUCCESS)
+		co_return "read failed";
+	co_return std::string(read_buf, read.m_bytes);
+}
+
+TEST_CASE("co_await IoManager reads and writes")
+{
+	static IoManager io;
+	io.startUp();
+
+	FileHandle file = io.openFile("test_coroutine_io.txt", true);
+	REQUIRE(file != NULL_FILE_HANDLE);
+
+	std::string str = "written and read back by a coroutine\n";
+	REQUIRE(syncWait(writeThenRead(io, file, str)) == str);
+
+	io.closeFile(file);
 	io.shutDown();
 }
+#endif //COROUTINES_ENABLED
 
 } //namespace s_test
@@ -0,0 +1,107 @@
+/**
+ * String intern table benchmarks. Not a pass/fail test, just prints
+ * throughput of interning and lookups from 1 to N threads.
+ *
+ * usage: StringIdBench [max_threads] [strings_per_thread]
+ */
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "StringId.h"
+
+namespace s_bench
+{
+
+using namespace sentinel;
+
+/*
+ * runs op(thread, i) count times on each of num_threads threads
+ *
+ * @returns millions of ops per second
+ */
+template<typename OpT>
+double runStrBench(std::size_t num_threads, std::size_t count, OpT op)
+{
+	std::vector<std::thread> threads;
+	auto start = std::chrono::steady_clock::now();
+
+	for (std::size_t t = 0; t < num_threads; t++)
+	{
+		threads.emplace_back([t, count, &op]()
+		{
+			for (std::size_t i = 0; i < count; i++)
+				op(t, i);
+		});
+	}
+	for (std::thread& t : threads)
+		t.join();
+
+	std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+	return (static_cast<double>(num_threads * count) / secs.count()) / 1e6;
+}
+
+void benchIntern(std::size_t max_threads, std::size_t count)
+{
+	printf("string interning, %zu strings per thread (Mops/s)\n", count);
+	printf("%8s %14s %14s %14s\n", "threads", "new strings", "re-intern", "STR()");
+
+	//build the strings up front so the bench measures the table, not formatting
+	std::vector<std::vector<std::string>> strings(max_threads);
+	std::vector<std::vector<StrId>> sids(max_threads);
+
+	for (std::size_t n = 1; n <= max_threads; n++)
+	{
+		for (std::size_t t = 0; t < n; t++)
+		{
+			strings[t].clear();
+			sids[t].clear();
+			for (std::size_t i = 0; i < count; i++)
+			{
+				strings[t].push_back("bench_" + std::to_string(n) + "_" +
+					std::to_string(t) + "_" + std::to_string(i));
+			}
+			sids[t].resize(count);
+		}
+
+		double insert_rate = runStrBench(n, count, [&](std::size_t t, std::size_t i)
+		{
+			sids[t][i] = INTERN_STR(strings[t][i]);
+		});
+
+		//every thread re-interns thread 0's strings, all hits on shared keys
+		double hit_rate = runStrBench(n, count, [&](std::size_t /*t*/, std::size_t i)
+		{
+			INTERN_STR(strings[0][i]);
+		});
+
+		std::vector<std::size_t> total_len(n, 0); //keeps the lookups from being optimized out
+		double lookup_rate = runStrBench(n, count, [&](std::size_t t, std::size_t i)
+		{
+			total_len[t] += STR(sids[t][i]).size();
+		});
+
+		printf("%8zu %14.2f %14.2f %14.2f\n", n, insert_rate, hit_rate, lookup_rate);
+	}
+}
+
+} //namespace s_bench
+
+int main(int argc, char* argv[])
+{
+	std::size_t max_threads = std::thread::hardware_concurrency();
+	std::size_t count = 100000;
+	if (argc > 1)
+		max_threads = std::strtoul(argv[1], nullptr, 10);
+	if (argc > 2)
+		count = std::strtoul(argv[2], nullptr, 10);
+	if (max_threads == 0)
+		max_threads = 4;
+
+	s_bench::benchIntern(max_threads, count);
+	return 0;
+}
@@ -0,0 +1,226 @@
+#define CATCH_CONFIG_MAIN
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "catch.hpp"
+#include "StringId.h"
+#include "StringPool.h"
+
+namespace s_test
+{
+
+using namespace sentinel;
+
+TEST_CASE("string ids hash literals at compile time")
+{
+	//XXH64 reference values, ids are stable across builds and runs
+	static_assert(SID("") == 0xEF46DB3751D8E999ULL, "XXH64 of an empty string");
+	static_assert(SID("abc") == 0x44BC2CF5AD770999ULL, "XXH64 reference value");
+	static_assert(SID("The quick brown fox jumps over the lazy dog") == 0x0B242D361FDA71BCULL,
+		"XXH64 reference value, long enough to use the 4 lanes");
+
+	StrId sid = INTERN_STR("engine.cfg");
+	REQUIRE(sid == SID("engine.cfg"));
+	REQUIRE(INTERN_STR(std::string("engine.cfg")) == sid);
+	REQUIRE(STR(sid) == "engine.cfg");
+
+	//views point into the arena: stable, and null terminated for C apis
+	std::string_view view = STR(sid);
+	REQUIRE(view.data()[view.size()] == '\0');
+	REQUIRE(STR(INTERN_STR(std::string_view("engine.cfg"))).data() == view.data());
+
+	//literal ids are constants, so they can be switch cases
+	bool matched = false;
+	switch (INTERN_LITERAL("user.cfg"))
+	{
+	case SID("engine.cfg"):
+		break;
+	case SID("user.cfg"):
+		matched = true;
+		break;
+	}
+	REQUIRE(matched);
+}
+
+TEST_CASE("compile time and runtime xxHash64 agree")
+{
+	//every length through the 32 byte stripes and each tail path
+	char buf[256];
+	for (std::size_t i = 0; i < sizeof(buf); i++)
+		buf[i] = static_cast<char>(i * 37 + 11);
+
+	for (std::size_t len = 0; len <= sizeof(buf); len++)
+	{
+		REQUIRE(xxHash64(buf, len) == xxHash64Fast(buf, len));
+		REQUIRE(xxHash64(buf, len, 42) == xxHash64Fast(buf, len, 42));
+	}
+	REQUIRE(xxHash64(buf, 64, 1) != xxHash64(buf, 64, 2));
+
+	//unaligned input
+	REQUIRE(xxHash64Fast(buf + 3, 100) == xxHash64(buf + 3, 100));
+}
+
+TEST_CASE("string table images mapped at boot")
+{
+	const char* image_path = "string_table_test.bin";
+	const char* bad_path = "string_table_bad.bin";
+
+	std::vector<std::string> strings;
+	for (std::size_t i = 0; i < 1000; i++)
+		strings.push_back("image_string_" + std::to_string(i));
+	std::vector<std::string_view> views(strings.begin(), strings.end());
+	views.push_back(views[0]); //duplicates are only stored once
+
+	REQUIRE(StringId::writeImage(image_path, views));
+
+	//anything that isn't an image is rejected
+	FILE* bad = fopen(bad_path, "wb");
+	REQUIRE(bad != nullptr);
+	fputs("definitely not a string table", bad);
+	fclose(bad);
+	REQUIRE_FALSE(StringId::loadImage(bad_path));
+	REQUIRE_FALSE(StringId::loadImage("no_such_string_table.bin"));
+
+	//and so are images with slots pointing outside the chars, or no empty slot
+	std::vector<char> image_bytes;
+	FILE* good = fopen(image_path, "rb");
+	REQUIRE(good != nullptr);
+	for (int c = fgetc(good); c != EOF; c = fgetc(good))
+		image_bytes.push_back(static_cast<char>(c));
+	fclose(good);
+
+	const std::size_t header_size = 32; //magic, version, count, capacity, chars size
+	std::uint64_t capacity = 0;
+	std::memcpy(&capacity, image_bytes.data() + 16, sizeof(capacity));
+	auto writeCorrupted = [&](bool fill_table)
+	{
+		std::vector<char> corrupted = image_bytes;
+		for (std::uint64_t i = 0; i < capacity; i++)
+		{
+			char* slot = corrupted.data() + header_size + i * 16;
+			std::uint64_t key = 0;
+			std::memcpy(&key, slot, sizeof(key));
+			if (fill_table && key == 0)
+			{
+				key = i + 1;
+				std::memcpy(slot, &key, sizeof(key));
+			}
+			else if (!fill_table && key != 0)
+			{
+				std::uint64_t location = (std::uint64_t(0x7FFFFFFF) << 32) | 16;
+				std::memcpy(slot + 8, &location, sizeof(location));
+				break;
+			}
+		}
+		FILE* out = fopen(bad_path, "wb");
+		fwrite(corrupted.data(), 1, corrupted.size(), out);
+		fclose(out);
+	};
+	writeCorrupted(false);
+	REQUIRE_FALSE(StringId::loadImage(bad_path));
+	writeCorrupted(true);
+	REQUIRE_FALSE(StringId::loadImage(bad_path));
+
+	REQUIRE(StringId::loadImage(image_path));
+
+	//image strings can be looked up without ever being interned
+	for (const std::string& str : strings)
+		REQUIRE(STR(hashStr(str.data(), str.size())) == str);
+	REQUIRE(STR(SID("image_string_7")) == "image_string_7");
+	REQUIRE(INTERN_STR("image_string_7") == SID("image_string_7"));
+
+	//and strings the image doesn't have are still interned at runtime
+	StrId sid = INTERN_STR("not_in_the_image");
+	REQUIRE(STR(sid) == "not_in_the_image");
+
+	std::remove(image_path);
+	std::remove(bad_path);
+}
+
+TEST_CASE("scoped string pools release their strings together")
+{
+	StringPool level_pool("level strings", 256);
+
+	StrId player = level_pool.intern("player_one_with_a_long_name");
+	REQUIRE(player == SID("player_one_with_a_long_name"));
+	REQUIRE(level_pool.intern(std::string("player_one_with_a_long_name")) == player);
+	REQUIRE(level_pool.getStr(player) == "player_one_with_a_long_name");
+	REQUIRE(level_pool.contains(player));
+	REQUIRE(level_pool.getNumStrings() == 1);
+	REQUIRE(level_pool.getUsedBytes() == sizeof("player_one_with_a_long_name"));
+
+	//pool strings stay out of the global table
+	std::string_view global;
+	REQUIRE_FALSE(StringId::tryGetStr(player, global));
+
+	//globally interned strings aren't copied, but the pool can still look them up
+	StrId permanent = INTERN_STR("a_permanent_string");
+	REQUIRE(level_pool.intern("a_permanent_string") == permanent);
+	REQUIRE_FALSE(level_pool.contains(permanent));
+	REQUIRE(level_pool.getStr(permanent) == "a_permanent_string");
+	REQUIRE(level_pool.getNumStrings() == 1);
+
+	//fill a few chunks, strings longer than a chunk get their own
+	for (std::size_t i = 0; i < 100; i++)
+		level_pool.intern("asset/path/" + std::to_string(i));
+	std::string big(1000, 'x');
+	StrId big_sid = level_pool.intern(big);
+	REQUIRE(level_pool.getStr(big_sid) == big);
+	REQUIRE(level_pool.getNumStrings() == 102);
+	REQUIRE(level_pool.getReservedBytes() >= level_pool.getUsedBytes());
+	REQUIRE(level_pool.getReservedBytes() > 1000);
+
+	level_pool.clear();
+	REQUIRE(level_pool.getNumStrings() == 0);
+	REQUIRE(level_pool.getUsedBytes() == 0);
+	REQUIRE(level_pool.getReservedBytes() == 0);
+	REQUIRE_FALSE(level_pool.contains(player));
+
+	//and the pool is reusable for the next level
+	REQUIRE(level_pool.intern("player_two") == SID("player_two"));
+	REQUIRE(level_pool.getStr(SID("player_two")) == "player_two");
+}
+
+TEST_CASE("interning strings from many threads")
+{
+	const std::size_t num_threads = 8;
+	const std::size_t num_strings = 4000; //enough to grow every shard's table
+
+	std::vector<std::string> strings;
+	for (std::size_t i = 0; i < num_strings; i++)
+		strings.push_back("concurrent_string_" + std::to_string(i));
+
+	//every thread interns every string (7 is coprime with the count) from
+	//a different start, so each one races the others to insert the same
+	//strings, and reads back strings others inserted
+	std::atomic<std::size_t> mismatches(0);
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; t < num_threads; t++)
+	{
+		threads.emplace_back([&strings, &mismatches, t]()
+		{
+			for (std::size_t i = 0; i < strings.size(); i++)
+			{
+				const std::string& str = strings[(i * 7 + t * 613) % strings.size()];
+				StrId sid = INTERN_STR(str);
+				if (sid != hashStr(str.data(), str.size()) || STR(sid) != str)
+					mismatches++;
+			}
+		});
+	}
+	for (std::thread& t : threads)
+		t.join();
+
+	REQUIRE(mismatches == 0);
+	for (const std::string& str : strings)
+		REQUIRE(STR(hashStr(str.data(), str.size())) == str);
+}
+
+} //namespace s_test
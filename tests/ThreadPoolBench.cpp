@@ -0,0 +1,182 @@
+/**
+ * ThreadPool scaling benchmarks. Not a pass/fail test, just prints
+ * empty job throughput and fork-join latency from 1 to N workers.
+ *
+ * usage: ThreadPoolBench [max_threads] [jobs_per_round]
+ */
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "Fiber.h"
+#include "ThreadPool.h"
+
+namespace s_bench
+{
+
+using namespace sentinel;
+
+static const std::size_t ROUNDS = 20;
+static const std::size_t FORK_JOIN_ROUNDS = 2000;
+
+typedef std::chrono::steady_clock ClockT;
+
+/*
+ * empty jobs submitted from outside the pool, through the injector
+ *
+ * @returns millions of jobs per second
+ */
+double benchExternal(ThreadPool& pool, std::size_t num_jobs)
+{
+	std::vector<AsyncJobHandle> jobs(num_jobs);
+	auto start = ClockT::now();
+
+	for (std::size_t r = 0; r < ROUNDS; r++)
+	{
+		for (std::size_t i = 0; i < num_jobs; i++)
+			jobs[i] = pool.asyncDo([]() {});
+		for (std::size_t i = 0; i < num_jobs; i++)
+			pool.wait(jobs[i]);
+	}
+
+	std::chrono::duration<double> secs = ClockT::now() - start;
+	return (static_cast<double>(ROUNDS * num_jobs) / secs.count()) / 1e6;
+}
+
+/*
+ * empty jobs spawned from inside a job, onto a worker's own deque,
+ * with the rest of the pool stealing them
+ *
+ * @returns millions of jobs per second
+ */
+double benchSpawned(ThreadPool& pool, std::size_t num_jobs)
+{
+	std::atomic<std::size_t> done(0);
+	auto start = ClockT::now();
+
+	for (std::size_t r = 0; r < ROUNDS; r++)
+	{
+		done = 0;
+		pool.asyncDo([&pool, &done, num_jobs]()
+		{
+			for (std::size_t i = 0; i < num_jobs; i++)
+				pool.asyncDo([&done]() { done.fetch_add(1, std::memory_order_relaxed); });
+		});
+		while (done.load(std::memory_order_relaxed) < num_jobs)
+			std::this_thread::yield();
+	}
+
+	std::chrono::duration<double> secs = ClockT::now() - start;
+	return (static_cast<double>(ROUNDS * num_jobs) / secs.count()) / 1e6;
+}
+
+/*
+ * fans out one tiny job per worker and joins on all of them
+ *
+ * @returns mean microseconds per fork-join
+ */
+double benchForkJoin(ThreadPool& pool, std::size_t num_threads)
+{
+	std::vector<AsyncJobHandle> jobs(num_threads);
+	std::atomic<std::size_t> sink(0);
+	auto start = ClockT::now();
+
+	for (std::size_t r = 0; r < FORK_JOIN_ROUNDS; r++)
+	{
+		for (std::size_t i = 0; i < num_threads; i++)
+			jobs[i] = pool.asyncDo([&sink]() { sink.fetch_add(1, std::memory_order_relaxed); });
+		for (std::size_t i = 0; i < num_threads; i++)
+			pool.wait(jobs[i]);
+	}
+
+	std::chrono::duration<double, std::micro> usecs = ClockT::now() - start;
+	return usecs.count() / FORK_JOIN_ROUNDS;
+}
+
+#ifdef FIBERS_ENABLED
+static const std::size_t FIBER_SWITCHES = 1000000;
+
+struct PingPong
+{
+	Fiber m_thread_fiber;
+	Fiber* m_fiber;
+};
+
+void pingPong(void* arg)
+{
+	PingPong* ping_pong = static_cast<PingPong*>(arg);
+	while (true)
+		Fiber::switchTo(*ping_pong->m_fiber, ping_pong->m_thread_fiber);
+}
+
+/*
+ * switches into a fiber and straight back out, over and over
+ *
+ * @returns mean nanoseconds per switch (half a round trip)
+ */
+double benchFiberSwitch()
+{
+	PingPong ping_pong;
+	Fiber fiber(&pingPong, &ping_pong, ThreadPool::DEFAULT_FIBER_STACK_SIZE);
+	ping_pong.m_fiber = &fiber;
+
+	auto start = ClockT::now();
+	for (std::size_t i = 0; i < FIBER_SWITCHES; i++)
+		Fiber::switchTo(ping_pong.m_thread_fiber, fiber);
+
+	std::chrono::duration<double, std::nano> nsecs = ClockT::now() - start;
+	return nsecs.count() / (FIBER_SWITCHES * 2);
+}
+#endif //FIBERS_ENABLED
+
+void benchThreadPool(std::size_t max_threads, std::size_t num_jobs)
+{
+	printf("empty jobs (Mjobs/s), %zu jobs per round; fork-join of one job per worker (us)\n", num_jobs);
+	printf("%8s %14s %14s %14s\n", "threads", "external", "spawned", "fork-join");
+
+	for (std::size_t n = 1; n <= max_threads; n++)
+	{
+		ThreadPool pool(n);
+
+		double external_rate = benchExternal(pool, num_jobs);
+		double spawned_rate = benchSpawned(pool, num_jobs);
+		double fork_join_us = benchForkJoin(pool, n);
+		printf("%8zu %14.2f %14.2f %14.2f\n", n, external_rate, spawned_rate, fork_join_us);
+	}
+
+#ifdef FIBERS_ENABLED
+	printf("\nfiber context switch: %.1f ns\n", benchFiberSwitch());
+
+	printf("on fibers:\n");
+	for (std::size_t n = 1; n <= max_threads; n++)
+	{
+		ThreadPool pool(n, true);
+
+		double external_rate = benchExternal(pool, num_jobs);
+		double spawned_rate = benchSpawned(pool, num_jobs);
+		double fork_join_us = benchForkJoin(pool, n);
+		printf("%8zu %14.2f %14.2f %14.2f\n", n, external_rate, spawned_rate, fork_join_us);
+	}
+#endif
+}
+
+} //namespace s_bench
+
+int main(int argc, char* argv[])
+{
+	std::size_t max_threads = std::thread::hardware_concurrency();
+	std::size_t num_jobs = 10000;
+	if (argc > 1)
+		max_threads = std::strtoul(argv[1], nullptr, 10);
+	if (argc > 2)
+		num_jobs = std::strtoul(argv[2], nullptr, 10);
+	if (max_threads == 0)
+		max_threads = 4;
+
+	s_bench::benchThreadPool(max_threads, num_jobs);
+	return 0;
+}
@@ -1,8 +1,15 @@
 #define CATCH_CONFIG_MAIN
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+#include <thread>
 #include <vector>
 
 #include "catch.hpp"
+#include "FiberSync.h"
+#include "Task.h"
 #include "ThreadPool.h"
 
 namespace s_test
@@ -44,6 +51,540 @@ TEST_CASE("Test various thread pool basic functions")
 		}
 		REQUIRE(answer == test_answer);
 	}
+
+	SECTION("more jobs in flight than the job pool's starting capacity")
+	{
+		std::atomic<int> count(0);
+		std::vector<AsyncJobHandle> jobs;
+		for (int i = 0; i < 1000; i++)
+		{
+			jobs.push_back(pool.asyncDo([&count]()
+			{
+				std::this_thread::sleep_for(std::chrono::microseconds(10));
+				count++;
+			}));
+		}
+
+		for (AsyncJobHandle h : jobs)
+			pool.wait(h);
+		REQUIRE(count == 1000);
+	}
+}
+
+TEST_CASE("work stealing: spawning, stealing and cancelling jobs")
+{
+	ThreadPool pool(4);
+	REQUIRE(pool.getNumThreads() == 4);
+
+	SECTION("jobs spawned from jobs go on the worker's deque and get stolen")
+	{
+		//a tree of jobs, each spawning children until a depth, so
+		//most jobs are pushed locally and the rest of the pool steals
+		const int depth = 10;
+		std::atomic<int> count(0);
+		std::function<void(int)> spawn = [&](int level)
+		{
+			if (level < depth)
+			{
+				pool.asyncDo([&spawn, level]() { spawn(level + 1); });
+				pool.asyncDo([&spawn, level]() { spawn(level + 1); });
+			}
+			count++; //last, so spawn is done with once count is full
+		};
+		pool.asyncDo([&spawn]() { spawn(0); });
+
+		const int total = (1 << (depth + 1)) - 1;
+		while (count < total)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		REQUIRE(count == total);
+	}
+
+	SECTION("many threads submitting at once")
+	{
+		std::atomic<int> count(0);
+		std::vector<std::thread> submitters;
+		for (int t = 0; t < 4; t++)
+		{
+			submitters.emplace_back([&pool, &count]()
+			{
+				std::vector<AsyncJobHandle> jobs;
+				for (int i = 0; i < 2000; i++)
+					jobs.push_back(pool.asyncDo([&count]() { count++; }));
+				for (AsyncJobHandle h : jobs)
+					pool.wait(h);
+			});
+		}
+		for (std::thread& t : submitters)
+			t.join();
+		REQUIRE(count == 8000);
+	}
+}
+
+TEST_CASE("cancelling a queued job")
+{
+	ThreadPool pool(1);
+	std::atomic<bool> release(false);
+	std::atomic<bool> ran(false);
+
+	//keep the only worker busy so the next job stays queued
+	AsyncJobHandle blocker = pool.asyncDo([&release]()
+	{
+		while (!release)
+			std::this_thread::yield();
+	});
+	AsyncJobHandle job = pool.asyncDo([&ran]() { ran = true; });
+
+	REQUIRE(pool.cancelAsyncJob(job));
+	REQUIRE_FALSE(pool.cancelAsyncJob(job)); //already cancelled
+	release = true;
+
+	pool.wait(blocker);
+	pool.wait(job);
+	REQUIRE_FALSE(ran);
+	REQUIRE_FALSE(pool.cancelAsyncJob(job)); //done, the handle is stale
+}
+
+TEST_CASE("a burst of queued jobs past the initial handle capacity")
+{
+	ThreadPool pool(1);
+	std::atomic<bool> started(false);
+	std::atomic<bool> release(false);
+	std::atomic<int> count(0);
+
+	AsyncJobHandle blocker = pool.asyncDo([&started, &release]()
+	{
+		started = true;
+		while (!release)
+			std::this_thread::yield();
+	});
+	while (!started)
+		std::this_thread::yield();
+
+	//all live at once behind the busy worker
+	std::vector<AsyncJobHandle> jobs;
+	for (int i = 0; i < 70000; i++)
+	{
+		jobs.push_back(pool.asyncDo([&count]() { count++; }));
+		REQUIRE(jobs.back() != NULL_JOB_HANDLE);
+	}
+	release = true;
+
+	pool.wait(blocker);
+	for (AsyncJobHandle job : jobs)
+		pool.wait(job);
+	REQUIRE(count == 70000);
+}
+
+TEST_CASE("job graphs: dependencies, continuations and child jobs")
+{
+	ThreadPool pool(4);
+
+	SECTION("a stage only runs once every job it depends on is done")
+	{
+		//decode -> process -> upload, submitted as one graph up front
+		const int num_frames = 16;
+		std::atomic<int> decoded(0);
+		std::atomic<int> processed(0);
+		std::atomic<bool> in_order(true);
+
+		std::vector<AsyncJobHandle> decode_jobs;
+		for (int i = 0; i < num_frames; i++)
+		{
+			decode_jobs.push_back(pool.asyncDo([&decoded]()
+			{
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+				decoded++;
+			}));
+		}
+
+		AsyncJobHandle process = pool.asyncAfter(decode_jobs, [&]()
+		{
+			if (decoded != num_frames)
+				in_order = false;
+			processed++;
+		});
+		AsyncJobHandle upload = pool.then(process, [&]()
+		{
+			if (processed != 1)
+				in_order = false;
+		});
+
+		pool.wait(upload);
+		REQUIRE(in_order);
+		REQUIRE(processed == 1);
+	}
+
+	SECTION("depending on done or stale jobs doesn't hold a job back")
+	{
+		AsyncJobHandle done = pool.asyncDo([]() {});
+		pool.wait(done);
+
+		std::atomic<bool> ran(false);
+		pool.wait(pool.asyncAfter({ done, NULL_JOB_HANDLE }, [&ran]() { ran = true; }));
+		REQUIRE(ran);
+	}
+
+	SECTION("waiting on a parent covers its children")
+	{
+		std::atomic<int> children_done(0);
+		AsyncJobHandle parent = pool.asyncDo([&pool, &children_done]()
+		{
+			for (int i = 0; i < 8; i++)
+			{
+				pool.asyncChild([&pool, &children_done]()
+				{
+					//grandchildren count too
+					pool.asyncChild([&children_done]()
+					{
+						std::this_thread::sleep_for(std::chrono::microseconds(200));
+						children_done++;
+					});
+					children_done++;
+				});
+			}
+		});
+
+		std::atomic<int> seen_by_continuation(0);
+		AsyncJobHandle next = pool.then(parent, [&]() { seen_by_continuation = children_done.load(); });
+
+		pool.wait(parent);
+		REQUIRE(children_done == 16);
+		pool.wait(next);
+		REQUIRE(seen_by_continuation == 16);
+	}
+
+	SECTION("a cancelled dependency still releases its dependents")
+	{
+		std::atomic<bool> release(false);
+		AsyncJobHandle blocker = pool.asyncDo([&release]()
+		{
+			while (!release)
+				std::this_thread::yield();
+		});
+
+		std::atomic<bool> dep_ran(false);
+		std::atomic<bool> cont_ran(false);
+		AsyncJobHandle dep = pool.then(blocker, [&dep_ran]() { dep_ran = true; });
+		AsyncJobHandle cont = pool.then(dep, [&cont_ran]() { cont_ran = true; });
+
+		REQUIRE(pool.cancelAsyncJob(dep)); //still held back by blocker
+		release = true;
+
+		pool.wait(cont);
+		REQUIRE_FALSE(dep_ran);
+		REQUIRE(cont_ran);
+	}
+
+	SECTION("many jobs joining on many dependencies")
+	{
+		std::atomic<int> count(0);
+		std::vector<AsyncJobHandle> roots;
+		for (int i = 0; i < 64; i++)
+			roots.push_back(pool.asyncDo([&count]() { count++; }));
+
+		std::vector<AsyncJobHandle> joins;
+		for (int i = 0; i < 64; i++)
+			joins.push_back(pool.asyncAfter(roots, [&count]() { count++; }));
+
+		for (AsyncJobHandle h : joins)
+			pool.wait(h);
+		REQUIRE(count == 128);
+	}
+}
+
+TEST_CASE("helping wait: waiting threads run jobs instead of blocking")
+{
+	SECTION("jobs waiting on their children can't deadlock the pool")
+	{
+		//far more jobs blocked in wait() at once than there are workers
+		ThreadPool pool(2);
+		std::function<int(int)> fib = [&pool, &fib](int n) -> int
+		{
+			if (n < 2)
+				return n;
+			int a = 0;
+			int b = 0;
+			AsyncJobHandle job_a = pool.asyncDo([&fib, &a, n]() { a = fib(n - 1); });
+			AsyncJobHandle job_b = pool.asyncDo([&fib, &b, n]() { b = fib(n - 2); });
+			pool.wait(job_a);
+			pool.wait(job_b);
+			return a + b;
+		};
+
+		int result = 0;
+		pool.wait(pool.asyncDo([&fib, &result]() { result = fib(15); }));
+		REQUIRE(result == 610);
+	}
+
+	SECTION("a job nobody has started runs on the waiting thread")
+	{
+		ThreadPool pool(1);
+		std::atomic<bool> started(false);
+		std::atomic<bool> release(false);
+		AsyncJobHandle blocker = pool.asyncDo([&started, &release]()
+		{
+			started = true;
+			while (!release)
+				std::this_thread::yield();
+		});
+		while (!started) //or wait() below could pick up the blocker itself
+			std::this_thread::yield();
+
+		std::thread::id ran_on;
+		AsyncJobHandle job = pool.asyncDo([&ran_on]() { ran_on = std::this_thread::get_id(); });
+		pool.wait(job);
+		REQUIRE(ran_on == std::this_thread::get_id());
+		REQUIRE_FALSE(pool.cancelAsyncJob(job));
+
+		release = true;
+		pool.wait(blocker);
+	}
+
+	SECTION("a held back job waits for its deps, the waiter runs them")
+	{
+		ThreadPool pool(1);
+		std::atomic<bool> started(false);
+		std::atomic<bool> release(false);
+		AsyncJobHandle blocker = pool.asyncDo([&started, &release]()
+		{
+			started = true;
+			while (!release)
+				std::this_thread::yield();
+		});
+		while (!started) //or wait() below could pick up the blocker itself
+			std::this_thread::yield();
+
+		std::atomic<int> stage(0);
+		AsyncJobHandle first = pool.asyncDo([&stage]() { stage = 1; });
+		AsyncJobHandle second = pool.then(first, [&stage]()
+		{
+			if (stage == 1)
+				stage = 2;
+		});
+
+		//the only worker is busy, so this thread runs both in order
+		pool.wait(second);
+		REQUIRE(stage == 2);
+
+		release = true;
+		pool.wait(blocker);
+	}
+}
+
+#ifdef FIBERS_ENABLED
+TEST_CASE("fiber mode: jobs suspend instead of blocking their worker")
+{
+	SECTION("a job waiting on another suspends, its worker runs the other")
+	{
+		//one worker, so the waited on job can only run if the waiter gets out of the way
+		ThreadPool pool(1, true);
+		REQUIRE(pool.isUsingFibers());
+
+		std::atomic<bool> release(false);
+		std::atomic<int> order(0);
+		int waiter_saw = -1;
+
+		AsyncJobHandle outer = pool.asyncDo([&]()
+		{
+			AsyncJobHandle gate = pool.asyncDo([&release]()
+			{
+				while (!release)
+					std::this_thread::yield();
+			});
+			AsyncJobHandle inner = pool.then(gate, [&order]() { order = 1; });
+			release = true;
+			pool.wait(inner); //inner is held back, so this has to suspend
+			waiter_saw = order;
+		});
+
+		pool.wait(outer);
+		REQUIRE(waiter_saw == 1);
+	}
+
+	SECTION("recursive fork-join on fibers")
+	{
+		ThreadPool pool(2, true);
+		std::function<int(int)> fib = [&pool, &fib](int n) -> int
+		{
+			if (n < 2)
+				return n;
+			int a = 0;
+			int b = 0;
+			AsyncJobHandle job_a = pool.asyncDo([&fib, &a, n]() { a = fib(n - 1); });
+			AsyncJobHandle job_b = pool.asyncDo([&fib, &b, n]() { b = fib(n - 2); });
+			pool.wait(job_a);
+			pool.wait(job_b);
+			return a + b;
+		};
+
+		int result = 0;
+		pool.wait(pool.asyncDo([&fib, &result]() { result = fib(15); }));
+		REQUIRE(result == 610);
+	}
+
+	SECTION("fiber events and mutexes park fibers, not workers")
+	{
+		ThreadPool pool(2, true);
+		FiberEvent go;
+		FiberMutex mut;
+		int total = 0;
+
+		//more waiters than workers, blocking a worker each would deadlock
+		std::vector<AsyncJobHandle> jobs;
+		for (int i = 0; i < 32; i++)
+		{
+			jobs.push_back(pool.asyncDo([&go, &mut, &total]()
+			{
+				go.wait();
+				for (int j = 0; j < 100; j++)
+				{
+					std::lock_guard<FiberMutex> lock(mut);
+					total++;
+				}
+			}));
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		REQUIRE_FALSE(go.isSet());
+		go.set();
+
+		for (AsyncJobHandle h : jobs)
+			pool.wait(h);
+		REQUIRE(total == 3200);
+	}
+
+	SECTION("per fiber stack stats")
+	{
+		ThreadPool pool(1, true, 32 * 1024);
+		pool.asyncDo([]()
+		{
+			volatile char scratch[8 * 1024];
+			for (std::size_t i = 0; i < sizeof(scratch); i++)
+				scratch[i] = static_cast<char>(i);
+		});
+
+		//not wait(), that could run the job inline on this thread instead
+		std::vector<ThreadPool::FiberStats> stats;
+		while (stats.empty() || stats[0].m_jobs_run == 0)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			stats = pool.getFiberStats();
+		}
+		REQUIRE(stats.size() == 1);
+		REQUIRE(stats[0].m_stack_size == 32 * 1024);
+		REQUIRE(stats[0].m_stack_used >= 8 * 1024);
+		REQUIRE(stats[0].m_stack_used <= stats[0].m_stack_size);
+		REQUIRE(stats[0].m_jobs_run >= 1);
+	}
+}
+#endif //FIBERS_ENABLED
+
+#ifdef COROUTINES_ENABLED
+static Task<std::thread::id> workerId(ThreadPool& pool)
+{
+	co_await pool.schedule();
+	co_return std::this_thread::get_id();
+}
+
+static Task<int> square(ThreadPool& pool, int x)
+{
+	co_await pool.schedule();
+	co_return x * x;
+}
+
+static Task<int> sumOfSquares(ThreadPool& pool, int n)
+{
+	int sum = 0;
+	for (int i = 1; i <= n; i++)
+		sum += co_await square(pool, i);
+	co_return sum;
+}
+
+static Task<void> countOnPool(ThreadPool& pool, std::atomic<int>& count,
+	std::atomic<int>& running, std::atomic<int>& max_running)
+{
+	co_await pool.schedule();
+
+	int now_running = running.fetch_add(1) + 1;
+	int prev_max = max_running.load();
+	while (now_running > prev_max && !max_running.compare_exchange_weak(prev_max, now_running)) {}
+
+	//hang on until another task is running too (or give up), so overlap doesn't hinge on timing
+	auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while (max_running.load() < 2 && std::chrono::steady_clock::now() < give_up)
+		std::this_thread::yield();
+
+	running.fetch_sub(1);
+	count.fetch_add(1);
+}
+
+static Task<int> throwOnPool(ThreadPool& pool)
+{
+	co_await pool.schedule();
+	throw std::runtime_error("from a worker");
+	co_return 0;
+}
+
+static Task<int> catchFromTask(ThreadPool& pool)
+{
+	try
+	{
+		co_return co_await throwOnPool(pool);
+	}
+	catch (const std::runtime_error&)
+	{
+		co_return -1;
+	}
+}
+
+TEST_CASE("coroutine tasks: schedule, awaiting tasks and whenAll")
+{
+	ThreadPool pool(4);
+
+	SECTION("schedule() resumes a task on a worker")
+	{
+		REQUIRE(syncWait(workerId(pool)) != std::this_thread::get_id());
+	}
+
+	SECTION("awaiting a task gives its result")
+	{
+		REQUIRE(syncWait(sumOfSquares(pool, 10)) == 385);
+	}
+
+	SECTION("exceptions are rethrown from co_await")
+	{
+		REQUIRE(syncWait(catchFromTask(pool)) == -1);
+		REQUIRE_THROWS_AS(syncWait(throwOnPool(pool)), std::runtime_error);
+	}
+
+	SECTION("whenAll runs tasks together and keeps their results in order")
+	{
+		std::vector<Task<int>> tasks;
+		for (int i = 0; i < 64; i++)
+			tasks.push_back(square(pool, i));
+
+		std::vector<int> results = syncWait(whenAll(std::move(tasks)));
+		REQUIRE(results.size() == 64);
+		for (int i = 0; i < 64; i++)
+			REQUIRE(results[i] == i * i);
+	}
+
+	SECTION("whenAll of void tasks, and of none")
+	{
+		std::atomic<int> count(0);
+		std::atomic<int> running(0);
+		std::atomic<int> max_running(0);
+		std::vector<Task<void>> tasks;
+		for (int i = 0; i < 16; i++)
+			tasks.push_back(countOnPool(pool, count, running, max_running));
+
+		syncWait(whenAll(std::move(tasks)));
+		REQUIRE(count.load() == 16);
+		REQUIRE(max_running.load() >= 2); //they overlapped
+
+		REQUIRE(syncWait(whenAll(std::vector<Task<int>>())).empty());
+	}
 }
+#endif //COROUTINES_ENABLED
 
 } //namespace s_test
\ No newline at end of file